@@ -0,0 +1,118 @@
+from contextlib import contextmanager
+from dataclasses import dataclass
+import subprocess
+import argparse
+import tempfile
+import statistics
+import os
+import re
+
+COLOR_RED    = '\033[31m'
+COLOR_GREEN  = '\033[32m'
+COLOR_YELLOW = '\033[33m'
+COLOR_RESET  = '\033[0m'
+
+# Function, which takes a while to lower & compile (branches, loop, arithmetic)
+WORK_FUNCTION_TEMPLATE = '''
+fn work_{idx}(n: i32): i32 {{
+  var acc: i32 = {idx};
+  for (var i: i32 = 0; i < n; i = i + 1) {{
+    if (i / 2 * 2 == i) {{
+      acc = acc + i * {idx};
+    }} else {{
+      acc = acc - i;
+    }}
+    acc = acc + (i * 3 - 1) / 2;
+  }}
+  return acc;
+}}
+'''
+
+# Calls every work function, so every one of them is compiled
+WORK_MAIN_TEMPLATE = '''
+fn main(): i32 {{
+  var acc: i32 = 0;
+{calls}
+  return acc - acc;
+}}
+'''
+
+
+@dataclass
+class Sample:
+    """Measurements (ms) of one configuration"""
+    name: str
+    ms: list[float]
+
+    @property
+    def median(self) -> float:
+        return statistics.median(self.ms)
+
+    def percentile(self, p: float) -> float:
+        ordered = sorted(self.ms)
+        return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+class Benchmark:
+    """Runs xcc over a generated program, subclasses define the program (generate) & what is measured (run)"""
+
+    def __init__(self, executable: str, repeat: int = 1):
+        self.executable = executable
+        self.repeat = repeat
+
+    def generate(self, f):
+        raise NotImplementedError
+
+    @contextmanager
+    def program(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            source = os.path.join(tmp, 'bench.xc')
+            with open(source, 'w') as f:
+                self.generate(f)
+            yield source
+
+    def xcc(self, args: list[str], what: str, input: str | None = None) -> subprocess.CompletedProcess:
+        result = subprocess.run([self.executable, *args], input=input, capture_output=True, text=True)
+
+        if result.returncode != 0:
+            raise RuntimeError(f'xcc failed ({what}):\n{result.stdout}\n{result.stderr}')
+
+        return result
+
+    @staticmethod
+    def phases_ms(stdout: str, phase: str) -> list[float]:
+        """Times of every `--time` report of phase"""
+        return [float(ms) for ms in re.findall(rf"Phase '{re.escape(phase)}' took ([\d.]+)ms", stdout)]
+
+    @staticmethod
+    def phase_ms(stdout: str, phase: str, what: str) -> float:
+        phases = Benchmark.phases_ms(stdout, phase)
+
+        if not phases:
+            raise RuntimeError(f'Can\'t find \'{phase}\' time in xcc output ({what}):\n{stdout}')
+
+        return phases[0]
+
+
+def write_work_functions(f, functions: int):
+    for idx in range(functions):
+        f.write(WORK_FUNCTION_TEMPLATE.format(idx=idx))
+
+
+def write_work_main(f, functions: int, n: int):
+    """Writes main, which calls every work function with `n`"""
+    f.write(WORK_MAIN_TEMPLATE.format(calls='\n'.join(f'  acc = acc + work_{idx}({n});' for idx in range(functions))))
+
+
+def make_parser(prog: str, description: str) -> argparse.ArgumentParser:
+    """Argument parser with the common -e/--executable option"""
+    result = argparse.ArgumentParser(
+         prog=prog,
+         description=description,
+         formatter_class=lambda prog: argparse.RawTextHelpFormatter(prog, max_help_position=50)
+    )
+
+    result.add_argument('-e', '--executable', action='store', dest='executable', required=True,
+                        help='Path to xcc executable')
+
+    return result
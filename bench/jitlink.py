@@ -0,0 +1,91 @@
+from dataclasses import dataclass, field
+import statistics
+import os
+
+from common import COLOR_GREEN, COLOR_YELLOW, COLOR_RESET, Benchmark, Sample, make_parser
+
+FUNCTION_TEMPLATE = '''
+fn small_{idx}(x: i32): i32 {{
+  return x + {idx};
+}}
+'''
+
+CONFIGURATIONS = {
+    'rtdyld':       ['--jit-linker', 'rtdyld'],
+    'jitlink':      ['--jit-linker', 'jitlink', '--jit-slab-size', '0'],
+    'jitlink-slab': ['--jit-linker', 'jitlink'],
+}
+
+
+@dataclass
+class LinkerSample(Sample):
+    max_rss_kb: list[int] = field(default_factory=list)
+
+
+class JitlinkBenchmark(Benchmark):
+    def __init__(self, executable: str, modules: int, repeat: int):
+        super().__init__(executable, repeat)
+        self.modules = modules
+
+    def generate(self, f):
+        # Every function is lowered into its own module, main references all of them,
+        # so all modules get linked during main lookup
+        for idx in range(self.modules):
+            f.write(FUNCTION_TEMPLATE.format(idx=idx))
+        f.write('fn main(): i32 {\n  var acc: i32 = 0;\n')
+        for idx in range(self.modules):
+            f.write(f'  acc = small_{idx}(acc);\n')
+        f.write('  return 0;\n}\n')
+
+    def measure(self, source: str, name: str, args: list[str]) -> LinkerSample:
+        sample = LinkerSample(name, [])
+
+        for _ in range(self.repeat):
+            sample.ms.append(self.phase_ms(self.xcc(['--time', *args, source], name).stdout, 'materialize', name))
+            sample.max_rss_kb.append(self.max_rss(source, args))
+
+        return sample
+
+    def max_rss(self, source: str, args: list[str]) -> int:
+        # Separate run, as subprocess reaps the child itself and doesn't expose its rusage
+        pid = os.fork()
+
+        if pid == 0:
+            devnull = os.open(os.devnull, os.O_WRONLY)
+            os.dup2(devnull, 1)
+            os.dup2(devnull, 2)
+            os.execv(self.executable, [self.executable, *args, source])
+
+        _, _, rusage = os.wait4(pid, 0)
+        return rusage.ru_maxrss
+
+    def run(self) -> list[LinkerSample]:
+        with self.program() as source:
+            return [self.measure(source, name, args) for name, args in CONFIGURATIONS.items()]
+
+
+def report(samples: list[LinkerSample]):
+    print(f'{"linker":>14} {"link (ms)":>12} {"max rss (KiB)":>15}')
+
+    for sample in samples:
+        print(f'{COLOR_YELLOW}{sample.name:>14}{COLOR_RESET} '
+              f'{sample.median:>12.3f} '
+              f'{COLOR_GREEN}{int(statistics.median(sample.max_rss_kb)):>15}{COLOR_RESET}')
+
+
+def main():
+    parser = make_parser('jitlink', 'XCC JIT object linking layer benchmark (RuntimeDyld vs JITLink)')
+
+    parser.add_argument('-m', '--modules', action='store', dest='modules', type=int, default=5000,
+                        help='Amount of generated modules (functions) (default: 5000)')
+
+    parser.add_argument('-r', '--repeat', action='store', dest='repeat', type=int, default=3,
+                        help='Runs per configuration, median is reported (default: 3)')
+
+    args = parser.parse_args()
+
+    report(JitlinkBenchmark(args.executable, args.modules, args.repeat).run())
+
+
+if __name__ == '__main__':
+    main()
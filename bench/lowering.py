@@ -0,0 +1,63 @@
+import os
+
+from common import COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_RESET, Benchmark, Sample, make_parser, write_work_functions
+
+# Only lowering time of generated functions is measured, main barely runs any code
+MAIN_TEMPLATE = '''
+fn main(): i32 {{
+  return work_0(1) - work_0(1) + {functions} - {functions};
+}}
+'''
+
+
+class LoweringBenchmark(Benchmark):
+    def __init__(self, executable: str, functions: int, max_jobs: int, repeat: int):
+        super().__init__(executable, repeat)
+        self.functions = functions
+        self.max_jobs = max_jobs
+
+    def generate(self, f):
+        write_work_functions(f, self.functions)
+        f.write(MAIN_TEMPLATE.format(functions=self.functions))
+
+    def measure(self, source: str, jobs: int) -> Sample:
+        what = f'jobs={jobs}'
+        return Sample(str(jobs), [self.phase_ms(self.xcc(['--time', '-j', str(jobs), source], what).stdout, 'lower', what)
+                                  for _ in range(self.repeat)])
+
+    def run(self) -> list[Sample]:
+        with self.program() as source:
+            return [self.measure(source, jobs) for jobs in range(1, self.max_jobs + 1)]
+
+
+def report(samples: list[Sample]):
+    baseline = samples[0].median
+
+    print(f'{"jobs":>6} {"lower (ms)":>12} {"speedup":>9} {"efficiency":>11}')
+
+    for sample in samples:
+        speedup = baseline / sample.median if sample.median else 0.0
+        efficiency = speedup / int(sample.name)
+        color = COLOR_GREEN if efficiency >= 0.5 else COLOR_RED
+        print(f'{COLOR_YELLOW}{sample.name:>6}{COLOR_RESET} {sample.median:>12.3f} {speedup:>8.2f}x {color}{efficiency:>10.0%}{COLOR_RESET}')
+
+
+def main():
+    parser = make_parser('lowering', 'XCC parallel lowering scaling benchmark')
+
+    parser.add_argument('-f', '--functions', action='store', dest='functions', type=int, default=2000,
+                        help='Amount of generated functions (default: 2000)')
+
+    parser.add_argument('-j', '--max-jobs', action='store', dest='max_jobs', type=int, default=os.cpu_count(),
+                        help='Maximal amount of lowering threads (default: cpu count)')
+
+    parser.add_argument('-r', '--repeat', action='store', dest='repeat', type=int, default=5,
+                        help='Runs per thread count, median is reported (default: 5)')
+
+    args = parser.parse_args()
+
+    report(LoweringBenchmark(args.executable, args.functions, args.max_jobs, args.repeat).run())
+
+
+if __name__ == '__main__':
+    main()
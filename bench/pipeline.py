@@ -0,0 +1,107 @@
+from dataclasses import dataclass, field
+import time
+import os
+import re
+
+from common import COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_RESET, Benchmark, Sample, make_parser, write_work_functions, write_work_main
+
+
+@dataclass
+class Stage:
+    name: str
+    items: int
+    workers: int
+    busy_ms: float
+    utilization: float
+    max_depth: int
+    avg_depth: float
+
+
+@dataclass
+class PipelineSample(Sample):
+    stages: list[Stage] = field(default_factory=list)
+
+
+class PipelineBenchmark(Benchmark):
+    STAGE_REGEX = re.compile(
+        r"Stage '(\w+)': (\d+) items, (\d+) workers, busy ([\d.]+)ms, utilization ([\d.]+)%, queue depth max (\d+) avg ([\d.]+)",
+        re.MULTILINE
+    )
+
+    def __init__(self, executable: str, functions: int, jobs: int, repeat: int):
+        super().__init__(executable, repeat)
+        self.functions = functions
+        self.jobs = jobs
+
+    def generate(self, f):
+        # Every function is called, so every function is compiled by phased driver too
+        write_work_functions(f, self.functions)
+        write_work_main(f, self.functions, 1)
+
+    def measure(self, source: str, mode: str, args: list[str]) -> PipelineSample:
+        sample = PipelineSample(mode, [])
+
+        for _ in range(self.repeat):
+            start = time.perf_counter()
+            result = self.xcc(['--time', '-j', str(self.jobs), *args, source], mode)
+            sample.ms.append((time.perf_counter() - start) * 1000)
+
+            sample.stages = [
+                Stage(m[0], int(m[1]), int(m[2]), float(m[3]), float(m[4]), int(m[5]), float(m[6]))
+                for m in self.STAGE_REGEX.findall(result.stdout)
+            ]
+
+        return sample
+
+    def run(self) -> list[PipelineSample]:
+        with self.program() as source:
+            return [
+                self.measure(source, 'phased', []),
+                self.measure(source, 'pipelined', ['--pipeline']),
+            ]
+
+
+def report(samples: list[PipelineSample]):
+    baseline = samples[0].median
+
+    print(f'{"mode":>10} {"wall (ms)":>12} {"speedup":>9}')
+
+    for sample in samples:
+        speedup = baseline / sample.median if sample.median else 0.0
+        color = COLOR_GREEN if speedup >= 1.0 else COLOR_RED
+        print(f'{COLOR_YELLOW}{sample.name:>10}{COLOR_RESET} {sample.median:>12.3f} {color}{speedup:>8.2f}x{COLOR_RESET}')
+
+    stages = samples[-1].stages
+
+    if stages:
+        print()
+        print(f'{"stage":>10} {"items":>7} {"workers":>8} {"busy (ms)":>11} {"util":>7} {"depth max":>10} {"depth avg":>10}')
+
+        # Stage with the highest utilization is the bottleneck
+        bottleneck = max(stages, key=lambda stage: stage.utilization)
+
+        for stage in stages:
+            color = COLOR_RED if stage is bottleneck else COLOR_YELLOW
+            print(f'{color}{stage.name:>10}{COLOR_RESET} {stage.items:>7} {stage.workers:>8} {stage.busy_ms:>11.3f} '
+                  f'{stage.utilization:>6.1f}% {stage.max_depth:>10} {stage.avg_depth:>10.2f}')
+
+
+def main():
+    parser = make_parser('pipeline', 'XCC phased vs pipelined compilation benchmark')
+
+    parser.add_argument('-f', '--functions', action='store', dest='functions', type=int, default=2000,
+                        help='Amount of generated functions (default: 2000)')
+
+    parser.add_argument('-j', '--jobs', action='store', dest='jobs', type=int, default=os.cpu_count(),
+                        help='Threads of lowering & codegen stages (default: cpu count)')
+
+    parser.add_argument('-r', '--repeat', action='store', dest='repeat', type=int, default=5,
+                        help='Runs per mode, median is reported (default: 5)')
+
+    args = parser.parse_args()
+
+    report(PipelineBenchmark(args.executable, args.functions, args.jobs, args.repeat).run())
+
+
+if __name__ == '__main__':
+    main()
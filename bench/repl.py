@@ -0,0 +1,85 @@
+import statistics
+
+from common import COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_RESET, Benchmark, Sample, make_parser
+
+PRELUDE = [
+    'var counter: i32 = 0;',
+    'fn square(x: i32): i32 { return x * x; }',
+    'fn sum(n: i32): i32 { var acc: i32 = 0; for (var i: i32 = 0; i < n; i = i + 1) { acc = acc + i; } return acc; }',
+]
+
+EXPRESSION_TEMPLATES = [
+    '{idx} + 1;',
+    'square({idx});',
+    'sum({idx} - {idx} / 10 * 10);',
+    'counter + {idx} / 2;',
+]
+
+TARGET_MS = 1.0
+
+
+class ReplBenchmark(Benchmark):
+    def __init__(self, executable: str, lines: int, args: list[str]):
+        super().__init__(executable)
+        self.lines = lines
+        self.args = args
+
+    def script(self) -> list[str]:
+        lines = list(PRELUDE)
+        for idx in range(self.lines):
+            lines.append(EXPRESSION_TEMPLATES[idx % len(EXPRESSION_TEMPLATES)].format(idx=idx))
+        return lines
+
+    def run(self) -> list[Sample]:
+        script = self.script()
+
+        result = self.xcc(['--time', *self.args], 'repl', '\n'.join(script) + '\n')
+        latencies = self.phases_ms(result.stdout, 'repl-line')
+
+        if len(latencies) != len(script):
+            raise RuntimeError(f'Expected {len(script)} line timings, got {len(latencies)} (failed lines?):\n{result.stdout}')
+
+        return [
+            Sample('definitions', latencies[:len(PRELUDE)]),
+            Sample('expressions', latencies[len(PRELUDE):]),
+        ]
+
+
+def report(samples: list[Sample]):
+    print(f'{"lines":>12} {"count":>7} {"p50 (ms)":>10} {"p99 (ms)":>10} {"max (ms)":>10}')
+
+    for sample in samples:
+        p50 = sample.percentile(50)
+        color = COLOR_GREEN if p50 < TARGET_MS else COLOR_RED
+        print(f'{COLOR_YELLOW}{sample.name:>12}{COLOR_RESET} '
+              f'{len(sample.ms):>7} '
+              f'{color}{p50:>10.3f}{COLOR_RESET} '
+              f'{sample.percentile(99):>10.3f} '
+              f'{max(sample.ms):>10.3f}')
+
+    print(f'(target: p50 of simple expressions under {TARGET_MS}ms, mean {statistics.mean(samples[-1].ms):.3f}ms)')
+
+
+def main():
+    parser = make_parser('repl', 'XCC REPL per-line latency benchmark (scripted session)')
+
+    parser.add_argument('-l', '--lines', action='store', dest='lines', type=int, default=1000,
+                        help='Amount of evaluated expression lines (default: 1000)')
+
+    parser.add_argument('args', nargs='*',
+                        help='Additional xcc options (e.g. -- --jit-linker jitlink)')
+
+    parser.add_argument('-c', '--compare', action='store_true', dest='compare',
+                        help='Also run with --no-interpreter (every expression JIT compiled)')
+
+    args = parser.parse_args()
+
+    report(ReplBenchmark(args.executable, args.lines, args.args).run())
+
+    if args.compare:
+        print('--no-interpreter:')
+        report(ReplBenchmark(args.executable, args.lines, [*args.args, '--no-interpreter']).run())
+
+
+if __name__ == '__main__':
+    main()
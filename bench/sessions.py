@@ -0,0 +1,86 @@
+import subprocess
+import time
+import os
+
+from common import COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_RESET, Benchmark, Sample, make_parser, write_work_functions, write_work_main
+
+
+def throughput(sessions: int, sample: Sample) -> float:
+    return 1000 * sessions / sample.median if sample.median else 0.0
+
+
+class SessionsBenchmark(Benchmark):
+    def __init__(self, executable: str, functions: int, sessions: list[int], repeat: int):
+        super().__init__(executable, repeat)
+        self.functions = functions
+        self.sessions = sessions
+
+    def generate(self, f):
+        write_work_functions(f, self.functions)
+        write_work_main(f, self.functions, 10)
+
+    def in_process(self, source: str, sessions: int) -> float:
+        start = time.perf_counter()
+        self.xcc(['--sessions', str(sessions), source], f'--sessions {sessions}')
+        return (time.perf_counter() - start) * 1000
+
+    def processes(self, source: str, sessions: int) -> float:
+        start = time.perf_counter()
+        running = [subprocess.Popen([self.executable, source], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL) for _ in range(sessions)]
+        codes = [process.wait() for process in running]
+        elapsed = (time.perf_counter() - start) * 1000
+
+        if any(codes):
+            raise RuntimeError(f'xcc failed in one of {sessions} processes')
+
+        return elapsed
+
+    def run(self) -> list[tuple[int, Sample, Sample]]:
+        samples = []
+
+        with self.program() as source:
+            for sessions in self.sessions:
+                in_process = Sample('in-process', [])
+                processes = Sample('processes', [])
+
+                for _ in range(self.repeat):
+                    in_process.ms.append(self.in_process(source, sessions))
+                    processes.ms.append(self.processes(source, sessions))
+
+                samples.append((sessions, in_process, processes))
+
+        return samples
+
+
+def report(samples: list[tuple[int, Sample, Sample]]):
+    print(f'{"sessions":>9} {"in-process (runs/s)":>20} {"processes (runs/s)":>19} {"ratio":>7}')
+
+    for sessions, in_process_sample, processes_sample in samples:
+        in_process = throughput(sessions, in_process_sample)
+        processes = throughput(sessions, processes_sample)
+        ratio = in_process / processes if processes else 0.0
+        color = COLOR_GREEN if ratio >= 1.0 else COLOR_RED
+        print(f'{COLOR_YELLOW}{sessions:>9}{COLOR_RESET} {in_process:>20.1f} {processes:>19.1f} {color}{ratio:>6.2f}x{COLOR_RESET}')
+
+
+def main():
+    parser = make_parser('sessions', 'XCC concurrent sessions throughput benchmark (one process with shared JIT vs a process per session)')
+
+    parser.add_argument('-f', '--functions', action='store', dest='functions', type=int, default=200,
+                        help='Amount of generated functions (default: 200)')
+
+    parser.add_argument('-s', '--sessions', action='store', dest='sessions', default=f'1,2,4,{os.cpu_count()}',
+                        help='Comma separated amounts of concurrent sessions (default: 1,2,4,cpu count)')
+
+    parser.add_argument('-r', '--repeat', action='store', dest='repeat', type=int, default=5,
+                        help='Runs per amount of sessions, median is reported (default: 5)')
+
+    args = parser.parse_args()
+
+    sessions = sorted({int(count) for count in args.sessions.split(',')})
+
+    report(SessionsBenchmark(args.executable, args.functions, sessions, args.repeat).run())
+
+
+if __name__ == '__main__':
+    main()
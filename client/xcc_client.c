@@ -0,0 +1,218 @@
+/**
+ * XCC compile server client
+ *
+ * Thin client of `xcc --server SOCKET`, doesn't link with LLVM, so it starts instantly.
+ * Sends arguments, working directory, absolute path & source of FILE to the server, program output is written by the server
+ * directly into client's stdout & stderr. Exits with exit code of the request
+ *
+ * Usage: xcc-client SOCKET [OPTIONS] FILE
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "xcc/server_protocol.h"
+
+static int writeExact(int fd, const void * data, size_t size) {
+  const char * ptr = (const char *) data;
+
+  while (size) {
+    ssize_t result = write(fd, ptr, size);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (result <= 0) {
+      return 0;
+    }
+
+    ptr += result;
+    size -= (size_t) result;
+  }
+
+  return 1;
+}
+
+static int readExact(int fd, void * data, size_t size) {
+  char * ptr = (char *) data;
+
+  while (size) {
+    ssize_t result = read(fd, ptr, size);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (result <= 0) {
+      return 0;
+    }
+
+    ptr += result;
+    size -= (size_t) result;
+  }
+
+  return 1;
+}
+
+static int writeString(int fd, const char * data, size_t size) {
+  uint32_t length = (uint32_t) size;
+  return writeExact(fd, &length, sizeof(length)) && writeExact(fd, data, size);
+}
+
+static char * readFile(const char * path, size_t * size) {
+  FILE * file = fopen(path, "rb");
+
+  if (!file) {
+    return NULL;
+  }
+
+  size_t capacity = 4096;
+  char * data = malloc(capacity);
+  *size = 0;
+
+  while (data) {
+    *size += fread(data + *size, 1, capacity - *size, file);
+
+    if (*size < capacity) {
+      break;
+    }
+
+    capacity *= 2;
+    char * grown = realloc(data, capacity);
+
+    if (!grown) {
+      free(data);
+    }
+
+    data = grown;
+  }
+
+  if (data && ferror(file)) {
+    free(data);
+    data = NULL;
+  }
+
+  fclose(file);
+  return data;
+}
+
+/**
+ * Sends protocol version byte, carrying stdin, stdout & stderr
+ */
+static int sendDescriptors(int conn) {
+  char version = XCC_SERVER_PROTOCOL_VERSION;
+  struct iovec iov = {&version, 1};
+
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(int) * XCC_SERVER_FD_COUNT)];
+  } control;
+
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buffer;
+  msg.msg_controllen = sizeof(control.buffer);
+
+  struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * XCC_SERVER_FD_COUNT);
+
+  int fds[XCC_SERVER_FD_COUNT] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  return sendmsg(conn, &msg, 0) == 1;
+}
+
+int main(int argc, char ** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s SOCKET [OPTIONS] FILE\n", argv[0]);
+    return 1;
+  }
+
+  const char * socket_path = argv[1];
+  const char * file_path = argv[argc - 1];
+
+  size_t source_size;
+  char * source = readFile(file_path, &source_size);
+
+  if (!source) {
+    fprintf(stderr, "xcc-client: Failed to read '%s': %s\n", file_path, strerror(errno));
+    return 1;
+  }
+
+  // Server resolves relative options against client's working directory & imports against path of FILE
+  char cwd[PATH_MAX];
+
+  if (!getcwd(cwd, sizeof(cwd))) {
+    fprintf(stderr, "xcc-client: Can't get working directory: %s\n", strerror(errno));
+    return 1;
+  }
+
+  char absolute_path[PATH_MAX];
+  int absolute_size = file_path[0] == '/'
+    ? snprintf(absolute_path, sizeof(absolute_path), "%s", file_path)
+    : snprintf(absolute_path, sizeof(absolute_path), "%s/%s", cwd, file_path);
+
+  if (absolute_size < 0 || (size_t) absolute_size >= sizeof(absolute_path) || absolute_size > XCC_SERVER_MAX_PATH_SIZE) {
+    fprintf(stderr, "xcc-client: Path '%s' is too long\n", file_path);
+    return 1;
+  }
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "xcc-client: Socket path '%s' is too long\n", socket_path);
+    return 1;
+  }
+
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+  int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (conn < 0 || connect(conn, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "xcc-client: Can't connect to '%s': %s\n", socket_path, strerror(errno));
+    return 1;
+  }
+
+  // Everything between SOCKET & FILE is passed to the server as options, FILE itself is sent as source
+  uint32_t args = (uint32_t) (argc - 3);
+
+  int sent = sendDescriptors(conn) && writeExact(conn, &args, sizeof(args));
+
+  for (int i = 2; sent && i < argc - 1; ++i) {
+    sent = writeString(conn, argv[i], strlen(argv[i]));
+  }
+
+  sent = sent && writeString(conn, cwd, strlen(cwd));
+  sent = sent && writeString(conn, absolute_path, (size_t) absolute_size);
+  sent = sent && writeString(conn, source, source_size);
+
+  free(source);
+
+  int32_t code;
+
+  if (!sent || !readExact(conn, &code, sizeof(code))) {
+    fprintf(stderr, "xcc-client: Connection to server was lost\n");
+    close(conn);
+    return 1;
+  }
+
+  close(conn);
+  return code;
+}
@@ -0,0 +1,62 @@
+/**
+ * XCC executor
+ *
+ * Runs JIT'd code of `xcc --out-of-process` in a separate process. Compiler spawns the executor with
+ * two pipes & drives it over ORC remote executor protocol (SimpleRemoteEPC) - allocates memory, writes
+ * linked code into it & runs `main`. Compilation (and object cache) stays in the compiler, so a crashing
+ * program takes down only its executor
+ *
+ * Links xcc runtime, so JIT'd code finds the same `xcc_*` helpers, as in the compiler process
+ *
+ * Usage: xcc-executor IN_FD OUT_FD
+ */
+
+#include <llvm/ExecutionEngine/Orc/TargetProcess/SimpleExecutorMemoryManager.h>
+#include <llvm/ExecutionEngine/Orc/TargetProcess/SimpleRemoteEPCServer.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char ** argv) {
+  if (argc != 3) {
+    std::fprintf(stderr, "Usage: %s IN_FD OUT_FD\n", argv[0]);
+    return 1;
+  }
+
+  int in_fd = std::atoi(argv[1]);
+  int out_fd = std::atoi(argv[2]);
+
+  // Output of a program shows up right away, not when executor exits
+  std::setvbuf(stdout, nullptr, _IOLBF, 0);
+
+  // Symbols of executor (libc, xcc runtime) are resolved by compiler through dylib manager
+  llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+  auto server = llvm::orc::SimpleRemoteEPCServer::Create<llvm::orc::FDSimpleRemoteEPCTransport>(
+    [](llvm::orc::SimpleRemoteEPCServer::Setup& setup) -> llvm::Error {
+      setup.setDispatcher(std::make_unique<llvm::orc::SimpleRemoteEPCServer::ThreadDispatcher>());
+      setup.bootstrapSymbols() = llvm::orc::SimpleRemoteEPCServer::defaultBootstrapSymbols();
+      setup.services().push_back(std::make_unique<llvm::orc::rt_bootstrap::SimpleExecutorMemoryManager>());
+      return llvm::Error::success();
+    },
+    in_fd, out_fd
+  );
+
+  if (!server) {
+    llvm::errs() << "xcc-executor: " << llvm::toString(server.takeError()) << "\n";
+    return 1;
+  }
+
+  // Returns once compiler ends its session (or dies)
+  if (auto err = (*server)->waitForDisconnect()) {
+    llvm::errs() << "xcc-executor: " << llvm::toString(std::move(err)) << "\n";
+    return 1;
+  }
+
+  std::fflush(nullptr);
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/Support/CodeGen.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "xcc/options.h"
+#include "xcc/remarks.h"
+
+namespace xcc::codegen {
+
+/**
+ * Ahead Of Time compilation context
+ *
+ * Takes the same modules, that would be added to JIT, links them into one,
+ * and emits it through TargetMachine as object/assembly/IR. Executables are
+ * linked by system linker (`$CC`, or `cc`) together with xcc runtime library,
+ * which provides `xcc_*` helpers
+ */
+class AOT {
+private:
+  Options options;
+
+  std::unique_ptr<llvm::TargetMachine> target_machine;
+
+public:
+  AOT(std::unique_ptr<llvm::TargetMachine> target_machine, Options options);
+  ~AOT() = default;
+
+  static std::unique_ptr<AOT> create(const Options& options);
+
+  /**
+   * Links modules into one & emits it into options.output (kind is selected by options.emit)
+   *
+   * Modules are not modified (they are copied into a new LLVMContext)
+   *
+   * @param modules Lowered modules (global module & all functions)
+   * @param remarks Collector of codegen remarks, nullptr if disabled
+   */
+  void compile(const std::vector<const llvm::Module *>& modules, Remarks * remarks = nullptr);
+
+  /**
+   * Links modules into one, owned by ctx
+   */
+  std::unique_ptr<llvm::Module> link(llvm::LLVMContext& ctx, const std::vector<const llvm::Module *>& modules);
+
+  /**
+   * Runs LLVM pipeline of options.opt_level over module
+   */
+  void optimize(llvm::Module& module);
+
+  /**
+   * Emits module as object file or assembly
+   */
+  void emitFile(llvm::Module& module, const std::string& path, llvm::CodeGenFileType type);
+
+  /**
+   * Links object file with xcc runtime into an executable, using system linker
+   */
+  void linkExecutable(const std::string& object, const std::string& output);
+
+  /**
+   * Returns path to xcc runtime library (`$XCC_RUNTIME` overrides built-in path)
+   */
+  static std::string getRuntimeLibrary();
+};
+
+} /* namespace xcc::codegen */
@@ -10,6 +10,7 @@
 #include "xcc/ast/for.h"
 #include "xcc/ast/identifier.h"
 #include "xcc/ast/if.h"
+#include "xcc/ast/import.h"
 #include "xcc/ast/member.h"
 #include "xcc/ast/node.h"
 #include "xcc/ast/number.h"
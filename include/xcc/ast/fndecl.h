@@ -8,6 +8,14 @@
 
 namespace xcc::ast {
 
+/**
+ * Function attribute (e.g. `#[target_clones("avx2", "default")]`)
+ */
+struct FnAttribute {
+  std::string name;
+  std::vector<std::string> args;
+};
+
 class FnDecl : public Node, public std::enable_shared_from_this<FnDecl> {
 public:
   std::shared_ptr<Identifier> name;
@@ -15,6 +23,7 @@ public:
   std::vector<std::shared_ptr<TypedIdentifier>> args;
   bool isExtern;
   bool isVariadic;
+  std::vector<FnAttribute> attributes;
 
 public:
   FnDecl(
@@ -35,6 +44,20 @@ public:
       bool isVariadic = false
   );
 
+  /**
+   * Generates function metadata (signature) from declaration, without generating any LLVM IR
+   *
+   * Used by declaration phase, to register all function signatures before bodies are lowered
+   *
+   * @param ctx Module Context, used to resolve types
+   */
+  std::shared_ptr<meta::Function> generateMetaFunction(codegen::ModuleContext& ctx);
+
+  /**
+   * Returns attribute by name, or nullptr if function doesn't have it
+   */
+  const FnAttribute * getAttribute(const std::string& name) const;
+
   llvm::Function * generateFunction(codegen::ModuleContext& ctx, PayloadList payload) override;
 };
 
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "xcc/ast/node.h"
+
+#include <string>
+
+namespace xcc::ast {
+
+/**
+ * Import of another source file (unit), only allowed at top-level scope. Imports are
+ * resolved & compiled before anything else in the importing file (see xcc::Importer)
+ */
+class Import : public Node {
+public:
+  /* Path, as written in source (relative to importing file) */
+  std::string path;
+
+public:
+  explicit Import(std::string path);
+  virtual ~Import() override = default;
+
+  static std::shared_ptr<Import> create(std::string path);
+};
+
+} /* namespace xcc::ast */
@@ -45,6 +45,7 @@ enum NodeType {
   AST_FOR,                    // for (init; cond; inc) body | for (typed_id in expr) body
   AST_WHILE,                  // while (cond) body
   AST_RETURN,                 // return expr
+  AST_IMPORT,                 // import "path"
 };
 
 /**
@@ -96,6 +97,9 @@ public:
 public:
   NodeType type;
 
+  /** Source line of node's first token, 0 - unknown (statements & functions, used for debug info) */
+  size_t line = 0;
+
 public:
   explicit Node(NodeType type);
   virtual ~Node() = default;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xcc/codegen.h"
+#include "xcc/options.h"
+
+namespace xcc {
+
+/**
+ * Batch runner (--batch) - runs many programs in one xcc invocation
+ *
+ * LLVM & GlobalContext (image) are initialized once, every program is run in a child, forked from
+ * the runner, so it gets its own JIT (JITDylib), globals, types & functions, while paying nothing
+ * for initialization. Up to options.jobs programs run at once. Output of every program is captured
+ * & reported in input order, each preceded by a header:
+ *
+ *   ==> FILE <== exit CODE TIMEms
+ *
+ * Captured stdout is written to stdout, captured stderr (with the same header, if not empty) to stderr
+ *
+ * Programs aren't run as in-process sessions (see --sessions), as their output & exit code couldn't be told apart:
+ * JIT'd code writes to process-wide descriptors 1 & 2 (libc printf, puts), may call exit() or crash. A child per program
+ * gets its own pipes for stdout & stderr & its own exit status, while fork of the image keeps start up cost low
+ */
+class Batch {
+public:
+  /**
+   * Result of a program
+   */
+  struct Result {
+    std::string path;
+    int code = 0;
+    double ms = 0;
+    std::string out;
+    std::string err;
+  };
+
+private:
+  Options options;
+
+  /* Programs in input order (manifests are expanded) */
+  std::vector<std::string> programs;
+
+  /* Pre-created GlobalContext, inherited by children. Never runs any code itself */
+  std::unique_ptr<codegen::GlobalContext> image;
+
+public:
+  explicit Batch(Options options);
+  ~Batch() = default;
+
+  static std::unique_ptr<Batch> create(Options options);
+
+  /**
+   * Runs all programs & reports their output. Returns 0 if every program succeeded, 1 otherwise
+   */
+  int run();
+
+  /**
+   * Expands batch inputs - `@FILE` is a manifest, which lists programs (one per line, relative to
+   * manifest, empty lines & lines starting with `#` are skipped), anything else is a program
+   */
+  static std::vector<std::string> expand(const std::vector<std::string>& inputs);
+
+private:
+  /**
+   * Runs program in the current (forked) process, returns its exit code
+   */
+  int runProgram(const std::string& path);
+
+  void report(const Result& result) const;
+};
+
+} /* namespace xcc */
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "xcc/ast/node.h"
+#include "xcc/meta/type.h"
+#include "xcc/meta/function.h"
+#include "xcc/util/llvm.h"
+
+namespace xcc::codegen {
+class GlobalContext;
+}
+
+namespace xcc::bytecode {
+
+/**
+ * Maximal amount of arguments of a call, made from bytecode
+ */
+constexpr size_t MAX_CALL_ARGS = 6;
+
+/**
+ * Bytecode instruction opcodes
+ *
+ * Integer registers always hold values normalized to their type (sign/zero extended to 64 bits),
+ * float registers hold doubles (rounded to float precision for f32)
+ */
+enum class OpCode : uint8_t {
+  INT,      /** dst = imm */
+  FLOAT,    /** dst = bit_cast<double>(imm) */
+  ADD,      /** dst = a + b (integer) */
+  SUB,      /** dst = a - b (integer) */
+  MUL,      /** dst = a * b (integer) */
+  SDIV,     /** dst = a / b (signed integer) */
+  UDIV,     /** dst = a / b (unsigned integer) */
+  FADD,     /** dst = a + b (float) */
+  FSUB,     /** dst = a - b (float) */
+  FMUL,     /** dst = a * b (float) */
+  FDIV,     /** dst = a / b (float) */
+  EQ,       /** dst = a == b */
+  NE,       /** dst = a != b */
+  UGE,      /** dst = a >= b (unsigned) */
+  UGT,      /** dst = a > b (unsigned) */
+  ULE,      /** dst = a <= b (unsigned) */
+  ULT,      /** dst = a < b (unsigned) */
+  AND,      /** dst = a & b */
+  OR,       /** dst = a | b */
+  SEXT,     /** dst = a, sign extended from imm bits */
+  ZEXT,     /** dst = a, zero extended from imm bits */
+  ITOF,     /** dst = (double) a (signed) */
+  FTOI,     /** dst = (int64_t) a */
+  FTRUNC,   /** dst = (float) a */
+  LOAD,     /** dst = *globals[imm], b - TypeTag of global */
+  CALL,     /** dst = calls[imm](...) */
+  RET,      /** return a (or nothing, if imm is 0) */
+};
+
+/**
+ * Bytecode instruction (register based)
+ */
+struct Instruction {
+  OpCode op;
+  uint16_t dst = 0;
+  uint16_t a = 0;
+  uint16_t b = 0;
+  int64_t imm = 0;
+};
+
+/**
+ * Call of a JIT'd function or host extern
+ */
+struct CallSite {
+  std::shared_ptr<meta::Function> function;
+  std::vector<uint16_t> args;
+};
+
+/**
+ * Compiled top-level code
+ */
+struct Chunk {
+  std::vector<Instruction> code;
+
+  /* Names of referenced globals, resolved through JIT on run */
+  std::vector<std::string> globals;
+
+  std::vector<CallSite> calls;
+
+  size_t registers = 0;
+
+  /* Result type */
+  std::shared_ptr<meta::Type> type;
+};
+
+/**
+ * Compiles typed AST of top-level code into bytecode
+ *
+ * Supports only straight-line integer/float code - literals, arithmetic & comparisons, casts,
+ * globals & calls. Anything else (loops, locals, strings, pointers) is left to JIT, as is any code
+ * that runs more than once - function bodies are always JIT compiled
+ */
+class Compiler {
+private:
+  /**
+   * Thrown on any unsupported construct, caught by compile()
+   */
+  struct Unsupported {};
+
+  /**
+   * Typed register
+   */
+  struct Operand {
+    uint16_t reg;
+    std::shared_ptr<meta::Type> type;
+
+    /* Result of a comparison (i1 in JIT'd code), which is typed as its operands */
+    bool boolean = false;
+  };
+
+  codegen::GlobalContext& globalContext;
+  Chunk chunk;
+
+public:
+  explicit Compiler(codegen::GlobalContext& globalContext);
+  ~Compiler() = default;
+
+  /**
+   * Compiles expression (or block of expressions, value of the last one is the result)
+   *
+   * @return Compiled chunk, or nothing if code must be JIT compiled
+   */
+  static std::optional<Chunk> compile(codegen::GlobalContext& globalContext, std::shared_ptr<ast::Node> expr);
+
+private:
+  uint16_t allocate();
+  uint16_t emit(Instruction instruction);
+
+  Operand compileNode(ast::Node * node);
+  Operand compileNumber(ast::Node * node);
+  Operand compileIdentifier(ast::Node * node);
+  Operand compileBinary(ast::Node * node);
+  Operand compileCast(ast::Node * node);
+  Operand compileCall(ast::Node * node);
+
+  /**
+   * Converts operand into `type`, same as codegen::castIfNotSame does in JIT'd code
+   */
+  Operand convert(const Operand& operand, const std::shared_ptr<meta::Type>& type);
+
+  /**
+   * Sign/zero extends integer register from type width to 64 bits
+   */
+  void normalize(uint16_t reg, const std::shared_ptr<meta::Type>& type);
+
+  /**
+   * Returns true if type can be held in a register
+   */
+  static bool isScalar(const std::shared_ptr<meta::Type>& type);
+};
+
+/**
+ * Executes bytecode chunks
+ */
+class Interpreter {
+private:
+  union Value {
+    int64_t i;
+    uint64_t u;
+    double f;
+  };
+
+  codegen::GlobalContext& globalContext;
+
+public:
+  explicit Interpreter(codegen::GlobalContext& globalContext);
+  ~Interpreter() = default;
+
+  /**
+   * Runs chunk. Globals are committed & referenced symbols are resolved (materialized) first
+   */
+  util::GenericValueContainer run(const Chunk& chunk);
+
+private:
+  void * resolve(const std::string& name);
+  Value call(const CallSite& call, const std::vector<Value>& registers);
+};
+
+} /* namespace xcc::bytecode */
@@ -4,6 +4,7 @@
 #include <llvm/ADT/STLExtras.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
@@ -22,8 +23,15 @@
 #include <llvm/Transforms/Scalar/SimplifyCFG.h>
 
 #include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
 
+#include "xcc/context_pool.h"
 #include "xcc/jit.h"
+#include "xcc/options.h"
+#include "xcc/profile.h"
+#include "xcc/remarks.h"
 #include "xcc/meta/value.h"
 #include "xcc/meta/function.h"
 #include "xcc/ast/fndecl.h"
@@ -33,52 +41,161 @@ namespace xcc::codegen {
 
 constexpr char DEFAULT_MODULE_NAME[] = "<module>";
 
+/* Prefix of REPL expression functions (and their modules) */
+constexpr char ANONYMOUS_EXPR_FN_NAME[] = "__anonymous__";
+
+/* Source file name in debug info of code without an input file (REPL, server) */
+constexpr char REPL_SOURCE_FILE[] = "<repl>";
+
 class ModuleContext;
 
 /**
- * Global compiler context, holds functions/globals, global ModuleContext and JIT
+ * Global compiler context (session), holds types/functions/globals, global ModuleContext and JIT
+ *
+ * Function bodies may be lowered concurrently (each in its own ModuleContext), so
+ * types/functions/globals tables and globalModule are guarded by mutexes. Access them
+ * through member functions, not directly
+ *
+ * All compilation state is per session, so many sessions can compile & run concurrently on different
+ * threads. Sessions, created with a shared JITEngine, share its ExecutionSession & thread pool, each
+ * with its own JITDylib
+ *
+ * JIT is created on first use (getJIT), so modes, that don't run code (--check, --emit-ir-only,
+ * ahead of time compilation), never initialize it
  */
 class GlobalContext {
-public:
-  /* JIT Context */
+private:
+  /* Shared JIT engine, if nullptr - JIT gets its own */
+  std::shared_ptr<JITEngine> engine;
+
+  /* Optimization remarks, nullptr if disabled. Declared before JIT, so it outlives every context its handler is installed on */
+  std::unique_ptr<Remarks> remarks;
+
+  /* JIT Context, nullptr until first getJIT() */
   std::unique_ptr<JIT> jit;
+  std::once_flag jit_once;
+
+  /* User-defined types (structs) */
+  std::unordered_map<std::string, std::shared_ptr<meta::Type>> types;
+  std::shared_mutex types_mutex;
+
+public:
+  /* Compiler Options */
+  Options options;
+
+  /* PGO instrumentation/annotation, nullptr if disabled */
+  std::unique_ptr<Profiler> profiler;
 
   /* Functions */
   std::unordered_map<std::string, std::shared_ptr<meta::Function>> functions;
-
-  /* Current Function Name */
-  std::string current_function;
+  std::shared_mutex functions_mutex;
 
   /* Global Module */
   std::shared_ptr<ModuleContext> globalModule;
 
+  /* Must be held while globalModule is modified during lowering (string interning, globals) */
+  std::mutex global_module_mutex;
+
   /* Global Variable Types */
   std::unordered_map<std::string, std::shared_ptr<meta::Type>> globals;
+  std::shared_mutex globals_mutex;
 
-public:
-  GlobalContext();
-  ~GlobalContext() = default;
+  /* Globals (variables & strings), already added to JIT by commitGlobals(), guarded by globals_mutex */
+  std::unordered_set<std::string> committed_globals;
+
+  /* Reusable LLVM contexts of REPL expression modules */
+  std::unique_ptr<ContextPool> contexts;
+
+  /* Amount of evaluated REPL expressions, every expression gets its own entry symbol */
+  size_t expr_counter = 0;
+
+  /* Interface hashes of units, already imported into this context, by canonical path (see Importer) */
+  std::unordered_map<std::string, uint64_t> imported_units;
 
-  static std::unique_ptr<GlobalContext> create();
+public:
+  explicit GlobalContext(Options options = {}, std::shared_ptr<JITEngine> engine = nullptr);
+  ~GlobalContext();
+
+  /**
+   * @param options Compiler options
+   * @param engine Shared JIT engine (options must be compatible with its ones), if nullptr - JIT gets its own
+   */
+  static std::unique_ptr<GlobalContext> create(Options options = {}, std::shared_ptr<JITEngine> engine = nullptr);
+
+  /**
+   * Returns JIT, creating it on first call. Thread safe
+   */
+  JIT& getJIT();
+
+  /**
+   * Returns true if JIT was already created
+   */
+  bool hasJIT() const;
+
+  /**
+   * Returns optimization remarks collector, nullptr if disabled
+   */
+  Remarks * getRemarks();
 
   std::unique_ptr<ModuleContext> createModule(const std::string& name = DEFAULT_MODULE_NAME);
 
   void addModule(std::unique_ptr<ModuleContext>& module);
 
   void addFunction(const std::string& name, std::shared_ptr<meta::Function> fn);
+  void removeFunction(const std::string& name);
   std::shared_ptr<meta::Function> getMetaFunction(const std::string& name);
 
-  void setCurrentFunction(const std::string& name);
-  void clearCurrentFunction();
-  std::shared_ptr<meta::Function> getCurrentFunction();
+  /**
+   * Returns snapshot of all registered functions, sorted by name
+   */
+  std::vector<std::shared_ptr<meta::Function>> getMetaFunctions();
+
+  void addType(const std::string& name, std::shared_ptr<meta::Type> type);
 
+  /**
+   * Returns built-in or user-defined type by name, throws if there is no such type
+   */
+  std::shared_ptr<meta::Type> getType(const std::string& name);
+
+  /**
+   * Returns all user-defined types, sorted by name
+   */
+  std::vector<std::shared_ptr<meta::Type>> getTypes();
+
+  void addGlobal(const std::string& name, std::shared_ptr<meta::Type> type);
   bool hasGlobal(const std::string& name);
   llvm::GlobalVariable * getGlobal(ModuleContext& ctx, const std::string& name);
   std::shared_ptr<meta::Type> getGlobalType(const std::string& name);
 
+  /**
+   * Returns true if global (variable or string) is already defined in JIT
+   */
+  bool isGlobalCommitted(const std::string& name);
+
+  /**
+   * Adds globals, defined since last commit, to JIT (permanently) & starts new globalModule.
+   * If nothing was defined, globalModule is kept as is
+   */
+  void commitGlobals();
+
+  /**
+   * Evaluates REPL expression
+   *
+   * Straight-line expressions are compiled into bytecode & interpreted (if enabled by options), otherwise
+   * expression is lowered into its own module (in a pooled LLVMContext) as a uniquely named function,
+   * which is removed from JIT right after the call. Globals stay in JIT between expressions
+   */
   void runExpr(std::shared_ptr<ast::Node> expr);
 
+  /**
+   * Commits globals & calls function
+   */
   void runFunction(const std::string& name);
+
+  /**
+   * Looks up (materializes) & calls function, which must already be added to JIT
+   */
+  void callFunction(const std::string& name);
 };
 
 /**
@@ -91,7 +208,9 @@ public:
 
   /* Top-Level LLVM Contexts */
   struct {
-    std::unique_ptr<llvm::LLVMContext> ctx;
+    /* Owns ctx, may be shared with other (already compiled) modules, see ContextPool */
+    llvm::orc::ThreadSafeContext tsctx;
+    llvm::LLVMContext * ctx;
     std::unique_ptr<llvm::Module> module;
   } llvm;
 
@@ -101,6 +220,22 @@ public:
   /* Named values (variables/args) */
   std::map<std::string, std::shared_ptr<meta::TypedValue>> locals;
 
+  /* Name of the function, which body is currently being generated */
+  std::string current_function;
+
+  /* Module of an imported unit, which holds its globals & strings. If nullptr - globalModule is used */
+  ModuleContext * data_module = nullptr;
+
+  /* Source file of an imported unit (set on its data module), if empty - options.input */
+  std::string source_file;
+
+  /* Debug info (line tables, or only locations for remarks), compile unit is created with the first function */
+  struct {
+    std::unique_ptr<llvm::DIBuilder> builder;
+    llvm::DICompileUnit * unit = nullptr;
+    llvm::DISubprogram * scope = nullptr;
+  } debug;
+
 #if USE_OPTIMIZATION
   /* Optimization Contexts */
   struct {
@@ -115,12 +250,44 @@ public:
 #endif
 
 public:
-  explicit ModuleContext(GlobalContext& global, const std::string& name = DEFAULT_MODULE_NAME);
+  /**
+   * @param global Global Context
+   * @param name Module name
+   * @param tsctx Context to create module in, if empty - new one is created
+   */
+  explicit ModuleContext(GlobalContext& global, const std::string& name = DEFAULT_MODULE_NAME, llvm::orc::ThreadSafeContext tsctx = {});
 
-  static std::unique_ptr<ModuleContext> create(GlobalContext& global, const std::string& name = DEFAULT_MODULE_NAME);
+  static std::unique_ptr<ModuleContext> create(GlobalContext& global, const std::string& name = DEFAULT_MODULE_NAME, llvm::orc::ThreadSafeContext tsctx = {});
 
   llvm::Function * getFunction(const std::string& name);
 
+  /**
+   * Returns module, where globals & interned strings of this module are defined (guarded by global_module_mutex)
+   */
+  ModuleContext& getDataModule();
+
+  /**
+   * Attaches debug info (subprogram) to function, which body is about to be generated. No-op, if neither debug info nor remarks are enabled
+   *
+   * @param fn Function
+   * @param line Source line of function definition
+   */
+  void beginDebugFunction(llvm::Function * fn, size_t line);
+
+  /**
+   * Sets source line of instructions, generated next (within current debug function)
+   */
+  void setDebugLocation(size_t line);
+
+  /**
+   * Finalizes debug info of current function
+   */
+  void endDebugFunction();
+
+  void setCurrentFunction(const std::string& name);
+  void clearCurrentFunction();
+  std::shared_ptr<meta::Function> getCurrentFunction();
+
   bool hasLocal(const std::string& name);
   llvm::AllocaInst * getLocalValue(const std::string& name);
   std::shared_ptr<meta::Type> getLocalType(const std::string& name);
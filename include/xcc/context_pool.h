@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+namespace xcc::codegen {
+
+/**
+ * Pool of reusable LLVM contexts, used for short-lived modules (REPL expressions)
+ *
+ * Context is acquired for a single module & released once that module is compiled & removed from JIT,
+ * so at any time a context is used by one module only. Types & constants, interned in a context, are
+ * never freed, so context is retired (dropped) after `max_uses` acquisitions
+ */
+class ContextPool {
+public:
+  /**
+   * Acquired context
+   */
+  struct Lease {
+    llvm::orc::ThreadSafeContext ctx;
+    size_t uses = 0;
+  };
+
+private:
+  std::vector<Lease> available;
+  std::mutex mutex;
+
+  size_t max_uses;
+  size_t max_available;
+
+public:
+  ContextPool(size_t max_uses, size_t max_available);
+  ~ContextPool() = default;
+
+  static std::unique_ptr<ContextPool> create(size_t max_uses = 256, size_t max_available = 4);
+
+  /**
+   * Returns unused context, creates new one if pool is empty
+   */
+  Lease acquire();
+
+  /**
+   * Returns context to the pool. No module may use it anymore
+   */
+  void release(Lease lease);
+};
+
+} /* namespace xcc::codegen */
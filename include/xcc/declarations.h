@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+#include <llvm/ADT/StringRef.h>
+
+#include "xcc/meta/function.h"
+#include "xcc/meta/type.h"
+
+namespace xcc::codegen {
+
+class GlobalContext;
+
+/**
+ * Declarations source - struct types & function signatures, written back as xcc source, so they can be
+ * restored by the usual declaration phase (used by session snapshots & unit interfaces)
+ */
+
+/**
+ * Returns type name, as it is written in source (unlike Type::toString, which expands structs)
+ */
+std::string typeName(const std::shared_ptr<meta::Type>& type);
+
+/**
+ * Reverse of typeName(), structs are looked up in globalContext
+ */
+std::shared_ptr<meta::Type> typeFromName(GlobalContext& globalContext, llvm::StringRef name);
+
+/**
+ * Appends struct declaration, types of its members are declared first, unless they are in `declared`
+ */
+void declareStruct(std::string& out, const std::shared_ptr<meta::Type>& type, std::unordered_set<std::string>& declared);
+
+/**
+ * Appends extern declaration of a function (methods are declared as plain functions under their mangled names)
+ */
+void declareFunction(std::string& out, const meta::Function& fn);
+
+} /* namespace xcc::codegen */
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xcc/codegen.h"
+
+namespace xcc {
+
+/**
+ * Imports units - other source files, imported with `import "path";` (relative to importing file)
+ *
+ * Every unit is compiled separately: its declarations (struct types, function signatures & globals) form
+ * unit's interface, its code is compiled into objects. If cache directory is set (options.cache_dir), both
+ * are stored in unit's artifact, so unchanged units are neither parsed nor lowered again - only interface is
+ * declared & objects are added to JIT. Unit is rebuilt if its source changed, or if interface of any unit
+ * it (transitively) imports changed. Units are parsed, lowered & compiled in parallel (options.jobs)
+ *
+ * All units share one namespace, imports only define what is compiled & in which order. Code of units is
+ * added to JIT as plain objects (it isn't tiered, instrumented or replaceable)
+ */
+class Importer {
+public:
+  struct Unit;
+
+private:
+  std::unique_ptr<codegen::GlobalContext>& globalContext;
+
+  /* Units by canonical path */
+  std::unordered_map<std::string, std::unique_ptr<Unit>> units;
+
+  /* Units in dependency order (imported units go before units, that import them) */
+  std::vector<Unit *> order;
+
+  /* Salt of unit artifacts - describes compiler, target & codegen configuration */
+  std::string salt;
+
+public:
+  explicit Importer(std::unique_ptr<codegen::GlobalContext>& globalContext);
+  ~Importer();
+
+  static std::unique_ptr<Importer> create(std::unique_ptr<codegen::GlobalContext>& globalContext);
+
+  /**
+   * Imports units (and everything they import), which weren't imported into GlobalContext yet
+   *
+   * If code isn't run in JIT (ahead of time compilation, --check, --emit-ir-only), units are always lowered
+   * from source & nothing is added to JIT, lowered modules are available through getModules()
+   *
+   * @param importer Path of importing file, imports are resolved relative to it (if empty - to current directory)
+   * @param paths Imported paths, as written in source
+   */
+  void import(const std::string& importer, const std::vector<std::string>& paths);
+
+  /**
+   * Returns modules of units, lowered by import(), if code isn't run in JIT
+   */
+  std::vector<const llvm::Module *> getModules() const;
+
+private:
+  /**
+   * Reads unit's source & its artifact (if it's up to date), otherwise parses the source
+   */
+  void load(Unit& unit);
+
+  /**
+   * Orders units, so every unit goes after units it imports. Throws on import cycle
+   */
+  void sort(Unit& unit, std::vector<std::string>& stack);
+
+  /**
+   * Declares interface of unit from its artifact
+   */
+  void declare(Unit& unit);
+
+  /**
+   * Runs declaration phase of unit from source, generates its globals & collects its functions
+   */
+  void declareFromSource(Unit& unit, std::vector<std::shared_ptr<ast::Node>>& fn_nodes);
+
+  std::string getArtifactPath(const Unit& unit) const;
+  bool isCacheEnabled() const;
+};
+
+} /* namespace xcc */
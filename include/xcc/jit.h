@@ -1,45 +1,495 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
 
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ExecutionEngine/Orc/CompileUtils.h>
 #include <llvm/ExecutionEngine/Orc/Core.h>
 #include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
 #include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
 #include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
 #include <llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/JITLink/JITLinkMemoryManager.h>
 #include <llvm/IR/DataLayout.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/ThreadPool.h>
+
+#include "xcc/jit_memory.h"
+#include "xcc/object_cache.h"
+#include "xcc/options.h"
+#include "xcc/perf_map.h"
 
 namespace xcc::codegen {
 
+/**
+ * Part of JIT, that can be shared by many sessions (GlobalContexts) compiling & running concurrently in
+ * one process - ExecutionSession, object linking layer (with its memory manager), object cache & thread
+ * pool for background compilation. Every session gets its own JIT, with its own JITDylib, compile layer &
+ * tiering/hot swap state, so symbols of different sessions never clash
+ *
+ * Sessions sharing an engine must be created with compatible options (see isCompatible)
+ */
+class JITEngine {
+private:
+  /* Options, engine was created with */
+  Options options;
+
+  std::unique_ptr<llvm::orc::ExecutionSession> session;
+
+  /* Target of generated code (baseline tier in tiered mode) */
+  llvm::orc::JITTargetMachineBuilder jtmb;
+  llvm::DataLayout data_layout;
+
+  JitLinker linker;
+
+  /* Allocated vs used bytes of JIT'd code & data */
+  MemoryStats memory_stats;
+
+  /* Linked bytes of code tracked by JIT memory limits of sessions (options.jit_memory_limit) */
+  LinkedSizes linked_sizes;
+
+  /* Slab memory manager, used only by JITLink layer (if slab size is not 0) */
+  std::unique_ptr<llvm::jitlink::JITLinkMemoryManager> memory_manager;
+
+  /* Slab pool, shared by RuntimeDyld memory managers of all objects (if slab size is not 0) */
+  std::unique_ptr<MemoryPool> memory_pool;
+
+  /* Perf map of JIT'd functions (options.perf_map), nullptr if disabled */
+  std::unique_ptr<PerfMap> perf_map;
+
+  /* Writes objects, loaded by RuntimeDyld, into perf map */
+  std::unique_ptr<llvm::JITEventListener> perf_map_listener;
+
+  /* RTDyldObjectLinkingLayer or ObjectLinkingLayer (JITLink), depending on options */
+  std::unique_ptr<llvm::orc::ObjectLayer> object_layer;
+
+  /* Persistent object cache, nullptr if disabled */
+  std::unique_ptr<ObjectCache> object_cache;
+
+  /* Background compilation (tier up) of all sessions, options.jobs threads */
+  llvm::DefaultThreadPool pool;
+
+  /* JITDylibs of sessions are numbered, as their names must be unique within ExecutionSession */
+  std::atomic<size_t> dylib_counter = 0;
+
+  /* Executor process (options.out_of_process), -1 if code runs in this process */
+  pid_t executor_pid = -1;
+
+public:
+  JITEngine(std::unique_ptr<llvm::orc::ExecutionSession> session, llvm::orc::JITTargetMachineBuilder jtmb, llvm::DataLayout layout, const Options& options);
+  ~JITEngine();
+
+  static std::shared_ptr<JITEngine> create(const Options& options = {});
+
+  /**
+   * Returns true if JITs of sessions with `lhs` & `rhs` options can share an engine
+   */
+  static bool isCompatible(const Options& lhs, const Options& rhs);
+
+  const Options& getOptions() const;
+  llvm::orc::ExecutionSession& getSession();
+  const llvm::orc::JITTargetMachineBuilder& getTargetMachineBuilder() const;
+  const llvm::DataLayout& getDataLayout() const;
+  JitLinker getLinker() const;
+  llvm::orc::ObjectLayer& getObjectLayer();
+  ObjectCache * getObjectCache();
+  llvm::DefaultThreadPool& getThreadPool();
+  MemoryStats& getMemoryStats();
+  LinkedSizes& getLinkedSizes();
+
+  /**
+   * Returns true if code runs in a separate executor process
+   */
+  bool isRemote() const;
+
+  /**
+   * Creates JITDylib of a session (with generator, resolving host symbols), its name is made unique by a numeric suffix
+   */
+  llvm::orc::JITDylib& createJITDylib(const std::string& name);
+};
+
 /**
  * Just In Time compilation context
+ *
+ * In tiered mode (options.tiered) every function is first compiled by baseline tier (O0, FastISel)
+ * and called through an indirection stub. Baseline code counts calls & loop iterations, once counter
+ * crosses options.tier_threshold, function is recompiled at O3 on a background thread & the stub is
+ * repointed to optimized code
+ *
+ * In hot swap mode (options.hot_swap) every function is called through an indirection stub as well, so it
+ * can be redefined while JIT (and its state, e.g. globals) is alive - new body is compiled under its own
+ * resource tracker, stub is repointed & old body is removed once no call is in progress
+ *
+ * With memory limit (options.jit_memory_limit) functions are added the same way, as in hot swap mode & their
+ * objects are spilled to disk. Once resident code of this JIT's functions (linked bytes of their units) exceeds
+ * the limit, code of least recently called functions without frames on the stack is removed - when the outermost
+ * call returns, or at next function entry (safepoint) of a long running call. Their stubs point to reload
+ * trampolines (one per function, reused by every eviction), which relink the function from its spilled object
  */
 class JIT {
+public:
+  /**
+   * Marks a call into JIT'd code. Retired code of replaced functions is released only while no call is in progress,
+   * evicted - when the outermost call returns (or at safepoints, while only one call is in progress)
+   */
+  class CallScope {
+  private:
+    JIT& jit;
+
+  public:
+    explicit CallScope(JIT& jit);
+    ~CallScope();
+  };
+
+  /**
+   * Tier of a function in tiered mode
+   */
+  enum class Tier {
+    BASELINE,   /** Baseline (O0) code is used */
+    COMPILING,  /** Function is hot, optimized code is being compiled */
+    OPTIMIZED,  /** Optimized (O3) code is used */
+    FAILED,     /** Optimized compilation failed, baseline code is used */
+  };
+
+  /**
+   * Snapshot of function tier state, for diagnostics
+   */
+  struct TierState {
+    std::string name;
+    Tier tier;
+    uint64_t calls;
+    double compile_ms;
+  };
+
 private:
-  std::unique_ptr<llvm::orc::ExecutionSession> session;
+  /**
+   * Function, compiled in tiered mode
+   */
+  struct TieredFunction {
+    std::string name;
+    std::atomic<Tier> tier = Tier::BASELINE;
+
+    /* Call/loop counter, incremented by baseline code */
+    uint64_t * counter = nullptr;
+
+    /* Uninstrumented copy of the module, recompiled at O3 */
+    llvm::orc::ThreadSafeModule original;
+
+    /* Tracks optimized code */
+    llvm::orc::ResourceTrackerSP rt;
+
+    std::atomic<double> compile_ms = 0;
+  };
+
+  /**
+   * Code of a replaceable function (tracked by its own resource tracker), released once it is
+   * retired & not used by any other function
+   */
+  struct CodeUnit {
+    std::string module;
+
+    /* Tracks linked code, nullptr while the unit is evicted */
+    llvm::orc::ResourceTrackerSP rt;
+
+    /* File with compiled object, code is relinked from it after eviction (memory limit only) */
+    std::string spill;
+
+    /* Linked bytes of code & data, counted in JIT's resident bytes, while the unit is resident */
+    size_t size = 0;
+
+    /* Call epoch, stored by every function of the unit on entry (memory limit only) */
+    std::atomic<uint64_t> last_used = 0;
+
+    /* Frames of unit's functions on the stack (memory limit only) */
+    std::atomic<int64_t> active = 0;
+
+    /* True while linked code is counted in resident bytes */
+    bool resident = false;
+  };
+
+  /**
+   * Function, called through an indirection stub in hot swap mode
+   */
+  struct ReplaceableFunction {
+    /* Body, the stub points to */
+    std::string body;
+    std::shared_ptr<CodeUnit> unit;
+
+    /* Added body, the stub will point to after next lookup (empty if none) */
+    std::string next_body;
+    std::shared_ptr<CodeUnit> next_unit;
+
+    /* Reload trampoline, the stub points to while function is evicted (memory limit only, taken on first eviction) */
+    llvm::orc::ExecutorAddr trampoline;
+  };
+
+  /**
+   * Copy of a compiled object, kept for session snapshots
+   */
+  struct RecordedObject {
+    std::string module;
+    std::unique_ptr<llvm::MemoryBuffer> object;
+  };
+
+private:
+  /* Destroyed last - layers, JITDylib & code of this JIT live in engine's ExecutionSession */
+  std::shared_ptr<JITEngine> engine;
 
   llvm::orc::MangleAndInterner mangle;
-  llvm::DataLayout data_layout;
 
-  llvm::orc::RTDyldObjectLinkingLayer object_layer;
+  /* CPU of generated code (resolved host CPU by default) */
+  std::string target_cpu;
+
+  /* Compiles modules into objects outside of compile layer (see compileObject) */
+  std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler> object_compiler;
+
   llvm::orc::IRCompileLayer compile_layer;
 
   llvm::orc::JITDylib& main_jd;
 
+  /* Tiered compilation (only if enabled by options) */
+  size_t tier_threshold;
+  std::unique_ptr<llvm::orc::IRCompileLayer> optimized_layer;
+  std::unique_ptr<llvm::orc::IndirectStubsManager> stubs_manager;
+
+  /* Optimized compilations of this JIT, running on engine's thread pool */
+  std::unique_ptr<llvm::ThreadPoolTaskGroup> tier_tasks;
+
+  std::deque<TieredFunction> tiered_functions;
+  std::vector<size_t> pending_baselines;
+  std::mutex tiered_mutex;
+
+  /* Hot swap (only if enabled by options) */
+  std::unordered_map<std::string, ReplaceableFunction> replaceable_functions;
+  std::vector<std::shared_ptr<CodeUnit>> retired_units;
+  size_t replaceable_version = 0;
+  std::atomic<size_t> active_calls = 0;
+  std::mutex replaceable_mutex;
+
+  /* Eviction (only if memory limit is set by options) */
+  size_t memory_limit;
+  std::unique_ptr<llvm::orc::TrampolinePool> trampolines;
+
+  /* Function of every reload trampoline (by address), guarded by replaceable_mutex */
+  std::unordered_map<uint64_t, std::string> trampoline_functions;
+
+  /* Incremented on every call into JIT'd code & every safepoint, see CodeUnit::last_used */
+  std::atomic<uint64_t> epoch = 0;
+
+  /* Not 0, while resident code exceeds memory limit - functions call safepoint() on entry */
+  std::atomic<uint64_t> evict_requested = 0;
+
+  /* Objects of evictable units are spilled here (removed with JIT), files are numbered */
+  std::string spill_directory;
+  size_t spill_counter = 0;
+
+  /* Units of compiled modules, by module name, guarded by replaceable_mutex */
+  std::unordered_map<std::string, std::weak_ptr<CodeUnit>> units;
+
+  /* Units of added objects (e.g. from a snapshot) by version, until their functions are added, guarded by replaceable_mutex */
+  std::unordered_map<size_t, std::shared_ptr<CodeUnit>> restored_units;
+
+  /* Linked bytes of resident evictable units, compared to memory limit. Engine's memory stats can't be used, as
+     they include other sessions, globals & expressions, which are never evicted */
+  std::atomic<size_t> resident_bytes = 0;
+
+  std::atomic<size_t> evictions = 0;
+  std::atomic<size_t> reloads = 0;
+
+  /* Object recording (see setObjectRecording) */
+  std::atomic<bool> record_objects = false;
+  std::vector<RecordedObject> recorded_objects;
+  std::mutex recorded_mutex;
+
 public:
-  JIT(std::unique_ptr<llvm::orc::ExecutionSession> session, llvm::orc::JITTargetMachineBuilder jtmb, llvm::DataLayout layout);
+  JIT(std::shared_ptr<JITEngine> engine, const Options& options);
   ~JIT();
 
-  static std::unique_ptr<JIT> create();
+  /**
+   * Creates JIT with its own engine
+   */
+  static std::unique_ptr<JIT> create(const Options& options = {});
+
+  /**
+   * Creates JIT in a shared engine (options must be compatible with engine's ones)
+   */
+  static std::unique_ptr<JIT> create(std::shared_ptr<JITEngine> engine, const Options& options);
+
+  JITEngine& getEngine();
+
+  /**
+   * Returns true if code runs in a separate executor process
+   */
+  bool isRemote() const;
+
+  /**
+   * Calls function at `address` in executor process as `int main(int, char **)`
+   */
+  llvm::Expected<int32_t> runAsMain(llvm::orc::ExecutorAddr address);
 
   const llvm::DataLayout& getDataLayout() const;
   llvm::orc::JITDylib& getMainJitDylib();
+  JitLinker getLinker() const;
+  ObjectCache * getObjectCache();
   llvm::Error addModule(llvm::orc::ThreadSafeModule tsm, llvm::orc::ResourceTrackerSP rt = nullptr);
+
+  /**
+   * Adds module in tiered mode - every defined function gets an indirection stub (under its own name)
+   * pointing to instrumented baseline code. Stubs are resolved on next lookup()
+   */
+  llvm::Error addTieredModule(llvm::orc::ThreadSafeModule tsm);
+
+  /**
+   * Adds module in hot swap mode - every defined function gets an indirection stub (under its own name),
+   * body is renamed & tracked by its own resource tracker. If function is already defined, its stub is
+   * repointed to the new body on next lookup() & the old body is retired
+   */
+  llvm::Error addReplaceableModule(llvm::orc::ThreadSafeModule tsm);
+
+  /**
+   * Points stub of function `name` to already added `body` symbol (on next lookup), e.g. restored from a snapshot.
+   * Body belongs to the unit of an added object with the same version, if there is one
+   */
+  llvm::Error addReplaceableFunction(const std::string& name, const std::string& body);
+
+  /**
+   * Returns (name, body) pairs of all replaceable functions, which stubs point to their bodies
+   */
+  std::vector<std::pair<std::string, std::string>> getReplaceableFunctions();
+
+  /**
+   * Adds already compiled (relocatable) object, e.g. restored from a snapshot. Object is recorded,
+   * if recording is enabled, as if it was compiled by this JIT. Object of a unit, compiled with memory
+   * limit, becomes an evictable unit again (it can't be added without memory limit)
+   */
+  llvm::Error addObject(const std::string& module, std::unique_ptr<llvm::MemoryBuffer> object);
+
+  /**
+   * Compiles module into a relocatable object (same target & codegen options as JIT'd code), without adding it.
+   * Thread safe, goes through object cache, if enabled
+   */
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> compileObject(llvm::Module& module);
+
   llvm::Expected<llvm::orc::ExecutorSymbolDef> lookup(llvm::StringRef name);
 
+  /**
+   * Enables/disables keeping a copy of every object, compiled by (non-optimized) compile layer
+   */
+  void setObjectRecording(bool enabled);
+  bool isObjectRecording() const;
+
+  /**
+   * Returns recorded objects in compilation order, buffers are owned by JIT
+   */
+  std::vector<std::pair<std::string, llvm::MemoryBufferRef>> getRecordedObjects();
+
+  /**
+   * Drops recorded objects of module (e.g. removed from JIT)
+   */
+  void forgetRecordedObjects(const std::string& module);
+
+  /**
+   * Returns target triple & CPU name of generated code
+   */
+  std::string getTargetTriple() const;
+  std::string getTargetCPU() const;
+
+  /**
+   * Schedules optimized compilation of tiered function. Called by baseline code, once it gets hot
+   */
+  void tierUp(size_t id);
+
+  /**
+   * Evicts code over memory limit, that has no frames on the stack. Called by JIT'd code on function entry,
+   * once eviction is requested
+   */
+  void safepoint();
+
+  /**
+   * Returns tier states of all functions, compiled in tiered mode
+   */
+  std::vector<TierState> getTierStates();
+
+  static std::string tierToString(Tier tier);
+
   void dump();
+
+private:
+  void recordObject(const std::string& module, llvm::MemoryBufferRef object);
+
+  /**
+   * Creates indirection stub for function `name` (pointing nowhere) & defines it under function's name
+   */
+  llvm::Error createFunctionStub(const std::string& name);
+
+  llvm::Error defineReplaceable(const std::string& name, const std::string& body, std::shared_ptr<CodeUnit> unit);
+
+  /**
+   * Defines `<module>$used` & `<module>$active` slots of unit under unit's resource tracker
+   */
+  llvm::Error defineUnitSlots(CodeUnit& unit);
+
+  /**
+   * Points stubs of replaceable functions to their added bodies & retires previous ones
+   */
+  llvm::Error resolveReplacements();
+
+  /**
+   * Removes retired code from JIT, if no call is in progress
+   */
+  void releaseRetired();
+
+  /**
+   * Adds object of a unit, compiled with memory limit, under its own tracker & defines its slots
+   */
+  llvm::Error addEvictableObject(const std::string& module, std::unique_ptr<llvm::MemoryBuffer> object);
+
+  /**
+   * Counts linked bytes of unit in resident bytes & requests eviction, if they exceed memory limit. Called
+   * under replaceable_mutex, once a lookup linked the unit
+   */
+  void markResident(CodeUnit& unit);
+
+  /**
+   * Evicts code of least recently called functions (without frames on the stack), until resident code fits
+   * into memory limit. Called when no call is in progress or at a safepoint
+   */
+  void evict();
+
+  /**
+   * Removes code of unit & points stubs of its functions to reload trampolines
+   */
+  llvm::Error evictUnit(const std::shared_ptr<CodeUnit>& unit, const std::vector<std::pair<std::string, std::string>>& functions);
+
+  /**
+   * Adds spilled object of an evicted unit again (linked by following lookup), no-op if it's already added
+   */
+  llvm::Error relinkUnit(CodeUnit& unit);
+
+  /**
+   * Called by reload trampoline of an evicted function: relinks its current body, repoints the stub to it &
+   * reports its address, so the call proceeds
+   */
+  void reload(llvm::orc::ExecutorAddr trampoline, llvm::orc::TrampolinePool::NotifyLandingResolvedFunction on_resolved);
+
+  /**
+   * Resolves baseline code of pending tiered functions & points their stubs to it
+   */
+  llvm::Error resolveBaselines();
+
+  /**
+   * Recompiles tiered function at O3 & repoints its stub
+   */
+  llvm::Error recompile(TieredFunction& fn);
 };
 
 }
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ExecutionEngine/JITLink/JITLink.h>
+#include <llvm/ExecutionEngine/Orc/MemoryMapper.h>
+#include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/Object/ObjectFile.h>
+
+namespace xcc::codegen {
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/**
+ * Kind of JIT'd section, by its final memory protection
+ */
+enum class SectionKind {
+  CODE,
+  RODATA,
+  RWDATA,
+};
+
+constexpr size_t SECTION_KIND_COUNT = 3;
+
+const char * sectionKindName(SectionKind kind);
+
+/**
+ * Allocated (mapped pages) vs used (section contents) bytes of JIT memory per section kind
+ */
+class MemoryStats {
+private:
+  struct Counter {
+    std::atomic<size_t> current = 0;
+    std::atomic<size_t> peak = 0;
+
+    void add(size_t bytes);
+    void remove(size_t bytes);
+  };
+
+  std::array<Counter, SECTION_KIND_COUNT> allocated;
+  std::array<Counter, SECTION_KIND_COUNT> used;
+
+public:
+  void addAllocated(SectionKind kind, size_t bytes);
+  void removeAllocated(SectionKind kind, size_t bytes);
+  void addUsed(SectionKind kind, size_t bytes);
+  void removeUsed(SectionKind kind, size_t bytes);
+
+  size_t getAllocated(SectionKind kind) const;
+  size_t getUsed(SectionKind kind) const;
+
+  /**
+   * Returns used bytes of all kinds
+   */
+  size_t getTotalUsed() const;
+
+  /**
+   * Logs peak allocated & used bytes (and utilization) per section kind
+   */
+  void report() const;
+};
+
+/**
+ * Slab memory pool, which packs sections of many (small) objects into shared pages
+ *
+ * Every section kind has its own slabs. Code & read-only data slabs are mapped twice (memfd) - writable
+ * view, where RuntimeDyld writes & relocates sections, and final (executable or read-only) view, where
+ * they run, so pages never change protection & sections of later objects may be placed next to
+ * already running ones. Freed blocks are reused (first fit), slabs are unmapped only with the pool
+ *
+ * With huge pages slabs are backed by 2MB pages (hugetlbfs), if none are reserved in the system - by
+ * transparent huge pages (madvise)
+ *
+ * Linux only, see isSupported
+ */
+class MemoryPool {
+public:
+  /**
+   * Block of a section
+   */
+  struct Block {
+    /* Where section is written (by linker) */
+    uint8_t * working = nullptr;
+
+    /* Where section is executed/read from, equals `working` for RW data */
+    uint8_t * target = nullptr;
+
+    size_t size = 0;
+    SectionKind kind = SectionKind::CODE;
+  };
+
+private:
+  struct Slab {
+    uint8_t * working;
+    uint8_t * target;
+    size_t size;
+
+    /* Free ranges (offset -> size), adjacent ones are merged */
+    std::map<size_t, size_t> free;
+  };
+
+  size_t slab_size;
+  bool huge_pages;
+  MemoryStats& stats;
+
+  std::array<std::vector<Slab>, SECTION_KIND_COUNT> slabs;
+  std::mutex mutex;
+
+  /* Address, next slab's final view is placed at (if free), keeps sections of an object within 2GB (small code model) */
+  uint8_t * hint = nullptr;
+
+  /* Huge pages couldn't be allocated, transparent huge pages are used instead */
+  bool huge_fallback = false;
+
+public:
+  MemoryPool(size_t slab_size, bool huge_pages, MemoryStats& stats);
+  ~MemoryPool();
+
+  /**
+   * Returns true if pool can be used on this system
+   */
+  static bool isSupported();
+
+  Block allocate(SectionKind kind, size_t size, size_t alignment);
+  void release(const Block& block);
+
+private:
+  Slab& map(SectionKind kind, size_t size);
+  uint8_t * mapView(int fd, size_t size, int protection, uint8_t * address);
+  static std::optional<size_t> fit(Slab& slab, size_t size, size_t alignment);
+};
+
+/**
+ * RuntimeDyld memory manager of a single object, which allocates its sections from a shared MemoryPool
+ * (SectionMemoryManager maps separate pages for every section of every object)
+ */
+class PooledMemoryManager : public llvm::RTDyldMemoryManager {
+private:
+  MemoryPool& pool;
+
+  std::vector<MemoryPool::Block> blocks;
+
+  /* Registered EH frames (final addresses) */
+  std::vector<std::pair<uint8_t *, size_t>> eh_frames;
+
+public:
+  explicit PooledMemoryManager(MemoryPool& pool);
+  ~PooledMemoryManager() override;
+
+  uint8_t * allocateCodeSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name) override;
+  uint8_t * allocateDataSection(uintptr_t size, unsigned alignment, unsigned section_id, llvm::StringRef section_name, bool read_only) override;
+
+  /**
+   * Maps sections to their final view, so relocations & symbol addresses are resolved against it
+   */
+  void notifyObjectLoaded(llvm::RuntimeDyld& dyld, const llvm::object::ObjectFile& object) override;
+
+  void registerEHFrames(uint8_t * address, uint64_t load_address, size_t size) override;
+  void deregisterEHFrames() override;
+
+  bool finalizeMemory(std::string * error = nullptr) override;
+
+private:
+  uint8_t * allocate(SectionKind kind, uintptr_t size, unsigned alignment);
+};
+
+/**
+ * Memory mapper of JITLink slabs, which advises kernel to back them by transparent huge pages
+ */
+class HugePageMemoryMapper : public llvm::orc::InProcessMemoryMapper {
+public:
+  using InProcessMemoryMapper::InProcessMemoryMapper;
+
+  void reserve(size_t size, OnReservedFunction on_reserved) override;
+};
+
+/**
+ * Accounts memory of objects, linked by JITLink (section sizes vs page aligned segments), per resource
+ * key, so removed code is subtracted
+ */
+class MemoryStatsPlugin : public llvm::orc::ObjectLinkingLayer::Plugin {
+private:
+  MemoryStats& stats;
+  size_t page_size;
+
+  /* Accounted bytes of every resource key, [allocated, used] per section kind */
+  using Usage = std::array<std::pair<size_t, size_t>, SECTION_KIND_COUNT>;
+
+  std::unordered_map<llvm::orc::ResourceKey, Usage> resources;
+  std::mutex mutex;
+
+public:
+  MemoryStatsPlugin(MemoryStats& stats, size_t page_size);
+
+  void modifyPassConfig(llvm::orc::MaterializationResponsibility& mr, llvm::jitlink::LinkGraph& graph, llvm::jitlink::PassConfiguration& config) override;
+
+  llvm::Error notifyFailed(llvm::orc::MaterializationResponsibility& mr) override;
+  llvm::Error notifyRemovingResources(llvm::orc::JITDylib& jd, llvm::orc::ResourceKey key) override;
+  void notifyTransferringResources(llvm::orc::JITDylib& jd, llvm::orc::ResourceKey dst, llvm::orc::ResourceKey src) override;
+
+private:
+  void account(llvm::orc::ResourceKey key, const Usage& usage);
+};
+
+/**
+ * Linked bytes (contents of allocated sections) per resource key. Only tracked keys are accounted, so
+ * untracked code (and trackers, freed meanwhile) take no entries. Used by JIT memory limit, which compares
+ * linked code of its units (not whole objects with headers, symbol tables & relocations) to the limit
+ */
+class LinkedSizes {
+private:
+  std::unordered_map<llvm::orc::ResourceKey, size_t> sizes;
+  std::mutex mutex;
+
+public:
+  /**
+   * Starts accounting code, linked under key
+   */
+  void track(llvm::orc::ResourceKey key);
+
+  /**
+   * Stops accounting key (e.g. its tracker was removed)
+   */
+  void untrack(llvm::orc::ResourceKey key);
+
+  void add(llvm::orc::ResourceKey key, size_t bytes);
+  void transfer(llvm::orc::ResourceKey dst, llvm::orc::ResourceKey src);
+
+  /**
+   * Returns linked bytes of key, 0 if nothing is linked yet (or key isn't tracked)
+   */
+  size_t get(llvm::orc::ResourceKey key);
+
+  /**
+   * Accounts sections of an object, loaded by RuntimeDyld (see RTDyldObjectLinkingLayer::setNotifyLoaded)
+   */
+  void notifyLoaded(llvm::orc::MaterializationResponsibility& mr, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info);
+};
+
+/**
+ * Accounts sizes of graphs, linked by JITLink, in LinkedSizes
+ */
+class LinkedSizePlugin : public llvm::orc::ObjectLinkingLayer::Plugin {
+private:
+  LinkedSizes& sizes;
+
+public:
+  explicit LinkedSizePlugin(LinkedSizes& sizes);
+
+  void modifyPassConfig(llvm::orc::MaterializationResponsibility& mr, llvm::jitlink::LinkGraph& graph, llvm::jitlink::PassConfiguration& config) override;
+
+  llvm::Error notifyFailed(llvm::orc::MaterializationResponsibility& mr) override;
+  llvm::Error notifyRemovingResources(llvm::orc::JITDylib& jd, llvm::orc::ResourceKey key) override;
+  void notifyTransferringResources(llvm::orc::JITDylib& jd, llvm::orc::ResourceKey dst, llvm::orc::ResourceKey src) override;
+};
+
+}
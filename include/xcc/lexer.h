@@ -29,6 +29,7 @@ enum TokenType {
   TOKEN_RETURN,
   TOKEN_AS,
   TOKEN_SELF,
+  TOKEN_IMPORT,
 
   // Braces/Parenthesis
   TOKEN_LEFT_BRACE,
@@ -45,6 +46,7 @@ enum TokenType {
   TOKEN_COLON,
   TOKEN_SEMICOLON,
   TOKEN_RIGHT_ARROW,
+  TOKEN_ATTRIBUTE_START,
 
   // Assignment Operators
   TOKEN_EQUALS,
@@ -166,6 +168,11 @@ private:
    */
   bool check(char expected);
 
+  /**
+   * Checks if comment starts at current char
+   */
+  bool isComment();
+
   /**
    * Skip whitespace from current until next non-whitespace char
    */
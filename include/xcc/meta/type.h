@@ -57,9 +57,6 @@ private:
   std::string   name;
   StructMembers members;
 
-  /** Global static storage for all user-defined types */
-  static std::unordered_map<std::string, std::shared_ptr<Type>> customTypes;
-
 public:
   explicit Type(TypeTag tag);
   ~Type() = default;
@@ -97,6 +94,11 @@ public:
    */
   [[nodiscard]] std::shared_ptr<Type> getMemberType(const std::string& name) const;
 
+  /**
+   * If type is a struct - get all members in declaration order
+   */
+  [[nodiscard]] const StructMembers& getMembers() const;
+
   /**
    * Generate LLVM type from a valid meta type, needs ModuleContext
    */
@@ -138,6 +140,11 @@ public:
   }
 
   static std::shared_ptr<Type> create(TypeTag tag);
+
+  /**
+   * Returns built-in type by name, nullptr if name isn't a built-in type.
+   * User-defined types are stored per session, see GlobalContext::getType
+   */
   static std::shared_ptr<Type> fromTypeName(const std::string& name);
 
   static std::shared_ptr<Type> createVoid();
@@ -159,11 +166,6 @@ public:
 
   static std::shared_ptr<Type> inferFromNode(codegen::ModuleContext& ctx, std::shared_ptr<ast::Node> node);
 
-  /**
-   * Saves user-defined type to customTypes
-   */
-  static void registerCustomType(const std::string& name, std::shared_ptr<Type> type);
-
   /**
    * Compares tag of lhs & rhs and returns 'bigger' type to avoid implicit downcasts
    */
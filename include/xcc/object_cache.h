@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "xcc/options.h"
+
+namespace xcc::codegen {
+
+/**
+ * Persistent on-disk cache of compiled objects
+ *
+ * Plugged into ConcurrentIRCompiler, so on hit LLVM codegen is skipped entirely.
+ * Objects are keyed by SHA256 of module IR, salted with target triple, CPU,
+ * features & optimization level. Cache directory size is capped, least recently
+ * used objects are evicted first (file mtime is updated on every hit)
+ */
+class ObjectCache : public llvm::ObjectCache {
+public:
+  /**
+   * Cache statistics
+   */
+  struct Stats {
+    std::atomic<size_t> hits = 0;
+    std::atomic<size_t> misses = 0;
+    std::atomic<size_t> stores = 0;
+    std::atomic<size_t> evictions = 0;
+    std::atomic<size_t> bytes_loaded = 0;
+    std::atomic<size_t> bytes_stored = 0;
+  };
+
+private:
+  /** Directory where objects are stored */
+  std::string directory;
+
+  /** Maximal total size of objects in cache directory (bytes) */
+  size_t max_size;
+
+  /** Hash salt - describes target & codegen configuration */
+  std::string salt;
+
+  /** Report statistics on destruction */
+  bool report_stats;
+
+  /** Keys of modules, that missed the cache & are being compiled (module -> key) */
+  std::unordered_map<const llvm::Module *, std::string> pending;
+  std::mutex pending_mutex;
+
+  Stats stats;
+
+public:
+  ObjectCache(std::string directory, size_t max_size, std::string salt, bool report_stats);
+  ~ObjectCache() override;
+
+  /**
+   * Creates object cache if enabled by options (cache_dir is set), otherwise returns nullptr
+   *
+   * @param options Compiler options
+   * @param jtmb Target machine builder, from which hash salt is created
+   */
+  static std::unique_ptr<ObjectCache> create(const Options& options, const llvm::orc::JITTargetMachineBuilder& jtmb);
+
+  void notifyObjectCompiled(const llvm::Module * module, llvm::MemoryBufferRef object) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module * module) override;
+
+  /**
+   * Evicts least recently used objects until cache directory fits into max_size
+   */
+  void prune();
+
+  const Stats& getStats() const;
+
+  /**
+   * Prints statistics using logger
+   */
+  void reportStats() const;
+
+private:
+  std::string getKey(const llvm::Module * module) const;
+  std::string getObjectPath(const std::string& key) const;
+};
+
+} /* namespace xcc::codegen */
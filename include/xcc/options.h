@@ -0,0 +1,180 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace xcc {
+
+/**
+ * Object linking layer used by JIT
+ */
+enum class JitLinker {
+  RTDYLD,   /** RuntimeDyld (RTDyldObjectLinkingLayer + SectionMemoryManager per object) */
+  JITLINK,  /** JITLink (ObjectLinkingLayer + slab memory manager) */
+};
+
+/**
+ * Output kind. NONE - run in JIT, anything else - compile ahead of time
+ */
+enum class Emit {
+  NONE,         /** Run in JIT */
+  EXECUTABLE,   /** Object linked with runtime by system linker */
+  OBJECT,       /** Relocatable object file */
+  ASSEMBLY,     /** Target assembly */
+  LLVM_IR,      /** Textual LLVM IR (all modules linked into one) */
+  PRELUDE,      /** Precompiled prelude (declarations only, see codegen::Prelude) */
+  IR_ONLY,      /** Textual LLVM IR of every module as lowered, without target (front-end only) */
+};
+
+/**
+ * Compiler options, usually parsed from command line arguments
+ */
+struct Options {
+  /** Source file to run. If empty - REPL is started */
+  std::string input;
+
+  /** Output file (AOT). If empty - derived from input */
+  std::string output;
+
+  /** Output kind */
+  Emit emit = Emit::NONE;
+
+  /** Optimization level of ahead of time output (0 - as lowered, 1-3 - LLVM pipeline of that level) */
+  unsigned opt_level = 0;
+
+  /** Only check that input file compiles (lex, parse & lower), nothing is run or emitted */
+  bool check = false;
+
+  /** Target CPU (`native` - host CPU). If empty - host CPU for JIT, generic CPU for AOT */
+  std::string target_cpu;
+
+  /** Comma separated target features (e.g. `+avx2,-avx512f`), added to CPU features */
+  std::string target_features;
+
+  /** Amount of threads used to lower function bodies (0 - use all hardware threads) */
+  size_t jobs = 1;
+
+  /** Report time spent in each compilation phase */
+  bool timings = false;
+
+  /** Overlap parsing, lowering & codegen (see Pipeline), instead of running them one after another */
+  bool pipeline = false;
+
+  /** Object linking layer used by JIT */
+  JitLinker jit_linker = JitLinker::RTDYLD;
+
+  /** JIT memory slab size in bytes (sections of many objects are packed into slabs), 0 - allocate per object */
+  size_t jit_slab_size = 64 * 1024 * 1024;
+
+  /** Back JIT memory slabs by 2MB huge pages */
+  bool jit_huge_pages = false;
+
+  /** Report allocated vs used JIT memory per section kind at exit */
+  bool jit_memory_stats = false;
+
+  /** JIT'd code memory budget in bytes, least recently called functions are evicted over it, 0 - no limit */
+  size_t jit_memory_limit = 0;
+
+  /** Emit DWARF line tables & register JIT'd objects with GDB (JIT interface), so debuggers/profilers see xcc source lines */
+  bool debug_info = false;
+
+  /** Write `/tmp/perf-<pid>.map` with address, size & name of every JIT'd function (perf symbolization) */
+  bool perf_map = false;
+
+  /** Write jitdump file (`perf inject --jit`), with code & line info of JIT'd functions (implies debug_info) */
+  bool jitdump = false;
+
+  /** Regex of pass names, whose optimization remarks are reported (mapped to xcc functions & lines). If empty - disabled */
+  std::string remarks;
+
+  /** Write optimization remarks into this file (`.json` - JSON, otherwise YAML) */
+  std::string remarks_file;
+
+  /** Tiered compilation - baseline (O0) code first, hot functions are recompiled at O3 in background */
+  bool tiered = false;
+
+  /** Amount of calls/loop iterations, after which function is considered hot (tiered mode) */
+  size_t tier_threshold = 1000;
+
+  /** Instrument JIT'd code & write indexed PGO profile into this file at exit */
+  std::string profile_generate;
+
+  /** Optimize JIT'd code using PGO profile from this file */
+  std::string profile_use;
+
+  /** Directory of persistent object cache. If empty - cache is disabled */
+  std::string cache_dir;
+
+  /** Maximal size of object cache directory in bytes, least recently used objects are evicted */
+  size_t cache_size = 512 * 1024 * 1024;
+
+  /** Report object cache statistics on exit */
+  bool cache_stats = false;
+
+  /** Rerun input file on every change, recompiling only changed functions (implies hot_swap) */
+  bool watch = false;
+
+  /** Unix socket path. If set - compile server is started, requests are sent by xcc-client */
+  std::string server;
+
+  /** Run every input (batch_inputs) in one invocation, each in its own child, forked from initialized image */
+  bool batch = false;
+
+  /** Programs & @manifests (files, listing programs) of batch mode */
+  std::vector<std::string> batch_inputs;
+
+  /** If not 0 - input file is run in that many concurrent sessions (threads), sharing one JIT engine */
+  size_t sessions = 0;
+
+  /** Run JIT'd code in a separate executor process (ORC remote executor), code is still compiled here */
+  bool out_of_process = false;
+
+  /** Executor binary for out of process execution. If empty - bundled xcc-executor (or $XCC_EXECUTOR) */
+  std::string executor;
+
+  /** Call functions through indirection stubs, so they can be redefined in a running JIT (always on in REPL) */
+  bool hot_swap = false;
+
+  /** Keep compiled objects of REPL session, so it can be saved with /save */
+  bool snapshots = false;
+
+  /** Interpret straight-line REPL expressions (bytecode), instead of compiling them */
+  bool interpreter = true;
+
+  /** Shared libraries, loaded before JIT'd code runs, so their symbols can be called from it */
+  std::vector<std::string> libraries;
+
+  /** Precompiled preludes (built-in name or file), declared on GlobalContext creation */
+  std::vector<std::string> preludes;
+
+  /** Print usage and exit */
+  bool help = false;
+
+public:
+  /**
+   * Returns true if code is run in JIT (not checked, emitted or compiled ahead of time)
+   */
+  bool isExecuting() const {
+    return emit == Emit::NONE && !check;
+  }
+
+  /**
+   * Parses command line arguments into Options
+   *
+   * Throws std::runtime_error on invalid arguments
+   *
+   * @param argc Argument count (as passed to main)
+   * @param argv Argument values (as passed to main)
+   */
+  static Options parse(int argc, char ** argv);
+
+  /**
+   * Returns usage/help string
+   *
+   * @param program Executable name
+   */
+  static std::string usage(const std::string& program);
+};
+
+} /* namespace xcc */
@@ -27,6 +27,7 @@ private:
   const std::vector<Token>& tokens;     /** Token stream */
   size_t current_idx;                   /** Index into `tokens` */
   std::vector<std::string> structStack; /** Stack of currently parsing struct definitions */
+  std::vector<std::pair<size_t, size_t>> ranges; /** Token ranges of top-level nodes */
 
 private:
   /**
@@ -96,6 +97,7 @@ private:
   std::shared_ptr<ast::Identifier> parseIdentifier(const std::string& ex_msg);
   std::shared_ptr<ast::Type> parseType();
   std::shared_ptr<ast::TypedIdentifier> parseValueDecl();
+  std::vector<ast::FnAttribute> parseAttributes();
 
   // Statements
   std::shared_ptr<ast::Node> parseFunction(bool isMethod);
@@ -106,6 +108,7 @@ private:
   std::shared_ptr<ast::Node> parseFor();
   std::shared_ptr<ast::Node> parseWhile();
   std::shared_ptr<ast::Node> parseReturn();
+  std::shared_ptr<ast::Node> parseImport();
 
   // Generic
   std::shared_ptr<ast::Node> parseStmt();
@@ -135,6 +138,19 @@ public:
    * @param isRepl true if run in REPL mode
    */
   std::shared_ptr<ast::Block> parse(bool isRepl);
+
+  /**
+   * Parses next top-level node, returns nullptr once all tokens are consumed. Allows consuming
+   * top-level nodes while the rest of the stream is still being parsed (see Pipeline)
+   *
+   * @param isRepl true if run in REPL mode
+   */
+  std::shared_ptr<ast::Node> parseNext(bool isRepl);
+
+  /**
+   * Returns token index ranges [begin, end) of top-level nodes, produced by parse(), in the same order
+   */
+  const std::vector<std::pair<size_t, size_t>>& getTopLevelRanges() const;
 };
 
 
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/types.h>
+
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
+
+#include "xcc/options.h"
+
+namespace xcc::codegen {
+
+/**
+ * Perf map file (`/tmp/perf-<pid>.map`), perf reads names of JIT'd functions from it
+ *
+ * Every line is `<start> <size> <name>` (hex), lines are only appended - code of removed (replaced,
+ * evicted) functions keeps its entry, perf uses the latest one for an address
+ *
+ * File is opened on the first added function & reopened, once it's added from another process - engine
+ * may be created before fork (server, batch), while code of every request is linked in its child
+ */
+class PerfMap {
+private:
+  std::FILE * file = nullptr;
+
+  /* Process, file was opened by */
+  pid_t pid = -1;
+
+  std::mutex mutex;
+
+public:
+  PerfMap() = default;
+  ~PerfMap();
+
+  /**
+   * Creates perf map of this process, if enabled by options (nullptr otherwise)
+   */
+  static std::unique_ptr<PerfMap> create(const Options& options);
+
+  void add(uint64_t address, uint64_t size, const std::string& name);
+};
+
+/**
+ * Writes functions of objects, loaded by RuntimeDyld, into perf map
+ */
+class PerfMapListener : public llvm::JITEventListener {
+private:
+  PerfMap& map;
+
+public:
+  explicit PerfMapListener(PerfMap& map);
+
+  void notifyObjectLoaded(ObjectKey key, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info) override;
+};
+
+/**
+ * Writes functions of graphs, linked by JITLink, into perf map (after fixups, when final addresses are known)
+ */
+class PerfMapPlugin : public llvm::orc::ObjectLinkingLayer::Plugin {
+private:
+  PerfMap& map;
+
+public:
+  explicit PerfMapPlugin(PerfMap& map);
+
+  void modifyPassConfig(llvm::orc::MaterializationResponsibility& mr, llvm::jitlink::LinkGraph& graph, llvm::jitlink::PassConfiguration& config) override;
+
+  llvm::Error notifyFailed(llvm::orc::MaterializationResponsibility& mr) override;
+  llvm::Error notifyRemovingResources(llvm::orc::JITDylib& jd, llvm::orc::ResourceKey key) override;
+  void notifyTransferringResources(llvm::orc::JITDylib& jd, llvm::orc::ResourceKey dst, llvm::orc::ResourceKey src) override;
+};
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xcc/codegen.h"
+#include "xcc/lexer.h"
+
+namespace xcc {
+
+/**
+ * Pipelined driver (--pipeline) - overlaps parsing, lowering & codegen of a source file
+ *
+ * Top-level nodes stream out of the parser (on calling thread), their declarations are registered right
+ * away & function bodies are queued for lowering. Lowered modules are queued for codegen, which compiles
+ * them into objects. Lowering & codegen run on options.jobs threads each, so wall time approaches time of
+ * the slowest stage, rather than the sum of all of them
+ *
+ * Function, that uses a declaration, which isn't parsed yet (e.g. calls a function defined below it), fails
+ * to lower - it's deferred & lowered again once parsing is done. Objects are added to JIT in source order,
+ * once all of them are compiled. Imports must precede all other top-level nodes
+ *
+ * Code is compiled into plain objects, so tiered & hot swap modes (and REPL) use the phased driver
+ */
+class Pipeline {
+public:
+  /**
+   * Stage statistics, reported with options.timings
+   */
+  struct StageStats {
+    std::string name;
+    size_t workers = 0;
+    size_t items = 0;
+
+    /* Time spent processing items, summed over workers */
+    double busy_ms = 0;
+
+    /* Depth of stage's input queue, sampled on every push (parse stage has no input queue) */
+    size_t max_depth = 0;
+    double avg_depth = 0;
+  };
+
+private:
+  std::unique_ptr<codegen::GlobalContext>& globalContext;
+
+  std::vector<StageStats> stats;
+  double wall_ms = 0;
+
+public:
+  explicit Pipeline(std::unique_ptr<codegen::GlobalContext>& globalContext);
+  ~Pipeline() = default;
+
+  static std::unique_ptr<Pipeline> create(std::unique_ptr<codegen::GlobalContext>& globalContext);
+
+  /**
+   * Parses, lowers & compiles tokens, then runs `main` (or finishes with xcc::emit(), if code isn't run in JIT)
+   *
+   * @param tokens Tokens of the source file
+   * @param path Path of the source file, imports are resolved relative to it
+   */
+  void run(const std::vector<Token>& tokens, const std::string& path);
+
+  /**
+   * Returns statistics of parse, lower & codegen stages of the last run()
+   */
+  const std::vector<StageStats>& getStats() const;
+
+private:
+  void report() const;
+};
+
+} /* namespace xcc */
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xcc/codegen.h"
+
+namespace xcc::codegen {
+
+/* Name of the built-in prelude (libc declarations) */
+constexpr char BUILTIN_PRELUDE_NAME[] = "std";
+
+/**
+ * Precompiled prelude - struct types & extern function declarations in binary form
+ *
+ * Declarations of a prelude are registered directly into GlobalContext on its creation (options.preludes),
+ * so they don't have to be lexed, parsed & generated on every run. Preludes are built from source, that
+ * contains only structs (without methods) & extern functions (--emit-prelude), besides built-in `std`
+ */
+class Prelude {
+public:
+  /**
+   * Struct type, members are (name, type name) pairs in declaration order
+   */
+  struct Struct {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> members;
+  };
+
+  /**
+   * Extern function signature, args are (name, type name) pairs
+   */
+  struct Function {
+    std::string name;
+    std::string return_type;
+    std::vector<std::pair<std::string, std::string>> args;
+    bool variadic = false;
+  };
+
+private:
+  /* Every struct goes after structs, used by its members */
+  std::vector<Struct> structs;
+  std::vector<Function> functions;
+
+public:
+  Prelude() = default;
+  ~Prelude() = default;
+
+  /**
+   * Builds prelude from declarations source. Throws if source contains anything but structs & extern functions
+   */
+  static Prelude build(const std::string& source);
+
+  /**
+   * Returns built-in prelude (`std`) - common libc functions
+   */
+  static Prelude getBuiltin();
+
+  /**
+   * Returns built-in prelude, if `name` is its name, otherwise reads prelude from file
+   */
+  static Prelude load(const std::string& name);
+
+  /**
+   * Reads prelude from file
+   */
+  static Prelude read(const std::string& path);
+
+  /**
+   * Writes prelude to file
+   */
+  void write(const std::string& path) const;
+
+  /**
+   * Registers struct types & functions of prelude in GlobalContext
+   */
+  void declare(GlobalContext& globalContext) const;
+
+  size_t getStructCount() const;
+  size_t getFunctionCount() const;
+};
+
+} /* namespace xcc::codegen */
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+
+#include "xcc/jit.h"
+#include "xcc/options.h"
+
+namespace xcc::codegen {
+
+/**
+ * Profile guided optimization support
+ *
+ * Generate mode (--profile-generate): PGOInstrumentationGen inserts counters into every module,
+ * counters are lowered into plain per-function arrays (`<name>$prof`), which are read from JIT
+ * at exit & written as indexed profile (same format as `llvm-profdata merge` output).
+ *
+ * Use mode (--profile-use): PGOInstrumentationUse attaches branch weights & function entry counts
+ * from the profile, then O2 pipeline runs, so inlining & block layout follow the profile
+ */
+class Profiler {
+public:
+  enum class Mode {
+    GENERATE,
+    USE,
+  };
+
+private:
+  /**
+   * Counters of an instrumented function
+   */
+  struct Counters {
+    std::string name;
+    uint64_t hash;
+    size_t size;
+  };
+
+  Mode mode;
+  std::string path;
+
+  std::vector<Counters> functions;
+  std::mutex functions_mutex;
+
+public:
+  Profiler(Mode mode, std::string path);
+  ~Profiler() = default;
+
+  /**
+   * Creates profiler if enabled by options, otherwise returns nullptr
+   */
+  static std::unique_ptr<Profiler> create(const Options& options);
+
+  Mode getMode() const;
+
+  /**
+   * Instruments (generate mode) or annotates & optimizes (use mode) freshly lowered module
+   *
+   * Must be called before module is added to JIT
+   */
+  void apply(llvm::Module& module);
+
+  /**
+   * Reads counters of all instrumented functions from JIT & writes profile (generate mode)
+   */
+  void write(JIT& jit);
+
+private:
+  void instrument(llvm::Module& module);
+  void annotate(llvm::Module& module);
+};
+
+} /* namespace xcc::codegen */
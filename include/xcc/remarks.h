@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include "xcc/options.h"
+
+namespace xcc::codegen {
+
+/**
+ * Optimization remarks of LLVM passes (inliner, vectorizers, codegen), mapped back to xcc functions & source lines
+ *
+ * Every LLVMContext, xcc code is compiled in, gets a diagnostic handler, which collects remarks of passes
+ * matching the filter (regex). At exit remarks are printed sorted by location, followed by a summary of
+ * vectorized/not vectorized loops & inlined calls per function, and written into a file, if set (`.json` -
+ * JSON array, otherwise YAML remarks, as written by `-fsave-optimization-record`)
+ *
+ * Line numbers come from debug locations, so line tables are emitted while remarks are enabled
+ */
+class Remarks {
+public:
+  enum class Kind {
+    PASSED,
+    MISSED,
+    ANALYSIS,
+  };
+
+  struct Remark {
+    Kind kind;
+    std::string pass;
+    std::string name;
+
+    /* xcc function (JIT suffixes, e.g. `$v1` or `$tier2`, are stripped) */
+    std::string function;
+
+    /* Source file & line, 0 - unknown */
+    std::string file;
+    size_t line = 0;
+
+    std::string message;
+  };
+
+private:
+  std::regex filter;
+  std::string path;
+
+  std::vector<Remark> remarks;
+  std::mutex mutex;
+
+public:
+  Remarks(const std::string& filter, std::string path);
+
+  /**
+   * Creates remarks collector, if enabled by options (nullptr otherwise)
+   */
+  static std::unique_ptr<Remarks> create(const Options& options);
+
+  /**
+   * Returns true if remarks of `pass` match the filter
+   */
+  bool isEnabled(llvm::StringRef pass) const;
+
+  /**
+   * Sets diagnostic handler of `ctx`, which adds remarks into this collector
+   */
+  void install(llvm::LLVMContext& ctx);
+
+  void add(const llvm::DiagnosticInfoOptimizationBase& diagnostic);
+
+  /**
+   * Prints collected remarks & summary per function, writes remarks file
+   */
+  void report();
+
+private:
+  void write();
+};
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+#include "xcc/codegen.h"
+#include "xcc/options.h"
+
+namespace xcc {
+
+/**
+ * Compile server (--server) - runs requests of thin clients (xcc-client), sent over a Unix socket
+ *
+ * Server initializes LLVM & creates GlobalContext (image) once. Every request is run in a child,
+ * forked from the server, so it starts with an initialized, but untouched JIT & is isolated from
+ * other requests. Requests with options, that would create a different JIT, get a fresh GlobalContext
+ * in the child. Exit code of the child is sent back to the client
+ */
+class Server {
+private:
+  Options options;
+  std::string path;
+
+  /* Pre-created GlobalContext, inherited by children. Never runs any code itself */
+  std::unique_ptr<codegen::GlobalContext> image;
+
+  int listen_fd = -1;
+
+  /* Connections of running requests by child pid */
+  std::unordered_map<pid_t, int> requests;
+
+public:
+  explicit Server(Options options);
+  ~Server();
+
+  static std::unique_ptr<Server> create(Options options);
+
+  /**
+   * Listens on options.server socket & serves requests. Returns only on error
+   */
+  void run();
+
+private:
+  /**
+   * Runs request in a forked child, returns its exit code
+   */
+  int serve(int conn);
+
+  /**
+   * Reaps finished children & sends their exit codes to clients
+   */
+  void reap();
+};
+
+} /* namespace xcc */
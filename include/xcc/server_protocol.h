@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * Compile server protocol (xcc --server), shared by the server & thin client (client/xcc_client.c),
+ * so it must stay valid C
+ *
+ * Request (client -> server), sent right after connecting:
+ *   - 1 byte (XCC_SERVER_PROTOCOL_VERSION), carrying client's stdin, stdout & stderr (SCM_RIGHTS)
+ *   - uint32_t argc, then argc times: uint32_t length & argument bytes
+ *   - uint32_t length & client's working directory, relative options (--load, --prelude, ...) are resolved against it
+ *   - uint32_t length & absolute path of FILE, imports are resolved against it
+ *   - uint32_t length & source bytes
+ *
+ * Response (server -> client), once request is finished:
+ *   - int32_t exit code
+ *
+ * Output of a request is written directly into client's descriptors. Integers are in host byte order,
+ * as both sides run on the same machine
+ */
+
+#define XCC_SERVER_PROTOCOL_VERSION 2
+
+/* Descriptors, passed with the first byte of a request */
+#define XCC_SERVER_FD_COUNT 3
+
+/* Limits, checked by the server */
+#define XCC_SERVER_MAX_ARGS 256
+#define XCC_SERVER_MAX_ARG_SIZE 4096
+#define XCC_SERVER_MAX_PATH_SIZE 4096
+#define XCC_SERVER_MAX_SOURCE_SIZE (64 * 1024 * 1024)
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "xcc/codegen.h"
+
+namespace xcc::codegen {
+
+/**
+ * Snapshot of a compiler/REPL session
+ *
+ * Holds everything needed to continue a session in a fresh JIT without recompiling anything:
+ * struct types & function signatures (as declarations source), values of global variables and
+ * compiled objects of all functions & globals. Objects are only available if they were recorded
+ * by JIT (see JIT::setObjectRecording, enabled by --snapshots), so recording must be enabled before anything is compiled
+ *
+ * Objects are machine code for a specific target, so snapshot can only be restored by a JIT,
+ * targeting the same triple & CPU
+ */
+class Snapshot {
+public:
+  /**
+   * Global (variable or string) with its value at the moment of capture
+   */
+  struct Global {
+    std::string name;
+
+    /* Meta type name, empty for strings (which are constant, so their value is in the object) */
+    std::string type;
+
+    std::vector<uint8_t> value;
+  };
+
+  /**
+   * Compiled object of a module
+   */
+  struct Object {
+    std::string module;
+    std::string data;
+  };
+
+private:
+  std::string triple;
+  std::string cpu;
+
+  /* Struct types & function declarations, restored by the usual declaration phase */
+  std::string declarations;
+  size_t functions = 0;
+
+  std::vector<Global> globals;
+  std::vector<Object> objects;
+
+  /* (name, body) pairs of functions, called through stubs (hot swap mode) */
+  std::vector<std::pair<std::string, std::string>> stubs;
+
+public:
+  Snapshot() = default;
+  ~Snapshot() = default;
+
+  /**
+   * Captures state of a session. Commits globals & materializes every function & global first,
+   * as only materialized code is recorded by JIT
+   */
+  static Snapshot capture(GlobalContext& globalContext);
+
+  /**
+   * Reads snapshot from file
+   */
+  static Snapshot read(const std::string& path);
+
+  /**
+   * Writes snapshot to file
+   */
+  void write(const std::string& path) const;
+
+  /**
+   * Restores snapshot into a fresh session (no functions & globals may be defined yet)
+   */
+  void restore(GlobalContext& globalContext) const;
+
+  size_t getFunctionCount() const;
+  size_t getGlobalCount() const;
+  size_t getObjectCount() const;
+};
+
+} /* namespace xcc::codegen */
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ExecutionEngine/Orc/Core.h>
+
+namespace xcc::codegen {
+
+/**
+ * Process-wide registry of host symbols, available to JIT'd code
+ *
+ * Explicitly registered symbols (host functions) take precedence over symbols found by dlsym in
+ * the process & loaded libraries. Resolved addresses are cached, so every symbol is searched
+ * at most once per process, no matter how many modules or JIT instances reference it
+ */
+class SymbolRegistry {
+public:
+  struct Symbol {
+    void * address;
+    std::string signature;  /** Human readable signature, empty if unknown (e.g. found by dlsym) */
+    bool registered;        /** True if registered explicitly, false if found in loaded libraries */
+  };
+
+private:
+  std::unordered_map<std::string, Symbol> symbols;
+  std::shared_mutex mutex;
+
+public:
+  SymbolRegistry() = default;
+  ~SymbolRegistry() = default;
+
+  static SymbolRegistry& instance();
+
+  /**
+   * Registers host symbol (overrides previously registered/cached one)
+   *
+   * @param name Unmangled symbol name
+   * @param address Symbol address
+   * @param signature Human readable signature, for diagnostics (e.g. `fn xcc_putc(c: i32): i32`)
+   */
+  void add(const std::string& name, void * address, std::string signature = "");
+
+  /**
+   * Returns address of a symbol, searching loaded libraries if it's not registered/cached yet
+   *
+   * @param name Unmangled symbol name
+   * @return Symbol address, nullptr if symbol can't be found
+   */
+  void * resolve(const std::string& name);
+
+  /**
+   * Returns snapshot of all registered & cached symbols, sorted by name
+   */
+  std::vector<std::pair<std::string, Symbol>> list();
+
+  /**
+   * Loads shared library permanently, so its symbols can be resolved
+   *
+   * Throws CodegenException on failure
+   */
+  static void loadLibrary(const std::string& path);
+};
+
+/**
+ * JITDylib definition generator, backed by SymbolRegistry
+ *
+ * All symbols of a lookup, that registry can resolve, are defined as a single absoluteSymbols unit
+ */
+class SymbolRegistryGenerator : public llvm::orc::DefinitionGenerator {
+private:
+  SymbolRegistry& registry;
+  char global_prefix;
+
+public:
+  SymbolRegistryGenerator(SymbolRegistry& registry, char global_prefix);
+
+  static std::unique_ptr<SymbolRegistryGenerator> create(char global_prefix, SymbolRegistry& registry = SymbolRegistry::instance());
+
+  llvm::Error tryToGenerate(llvm::orc::LookupState& state, llvm::orc::LookupKind kind, llvm::orc::JITDylib& jd,
+                            llvm::orc::JITDylibLookupFlags flags, const llvm::orc::SymbolLookupSet& set) override;
+};
+
+} /* namespace xcc::codegen */
@@ -130,4 +130,10 @@ T call(llvm::orc::ExecutorSymbolDef& symbol) {
  */
 GenericValueContainer call(std::shared_ptr<xcc::meta::Type> type, llvm::orc::ExecutorSymbolDef symbol);
 
+/**
+ * Initializes native target (with its asm printer & parser) on first call, so modes, that don't
+ * generate machine code (e.g. --check), don't pay for it. Thread safe
+ */
+void initNativeTarget();
+
 }
\ No newline at end of file
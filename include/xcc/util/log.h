@@ -2,6 +2,7 @@
 
 #include <string>
 #include <format>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <cstdint>
@@ -131,7 +132,7 @@ private:
   std::string name;
 
   /** Is enabled */
-  bool enabled;
+  std::atomic<bool> enabled;
 
   /** Flags */
   uint32_t flags = Flag::NONE;
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace xcc::util {
+
+/**
+ * Runs `fn(idx)` for every index in [0, count) on up to `jobs` threads (0 - all hardware threads, 1 - on the calling thread)
+ *
+ * If any call throws - exception of the first (by index) failed call is rethrown, after all calls are finished
+ *
+ * @param count Number of calls
+ * @param jobs Maximum number of threads
+ * @param fn Function, called with index
+ */
+void parallelFor(size_t count, size_t jobs, const std::function<void(size_t)>& fn);
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace xcc::util {
+
+/**
+ * Unbounded multi-producer/multi-consumer queue, that can be closed
+ *
+ * Keeps depth statistics (maximal & average depth, sampled on every push), used to find out,
+ * which stage of a pipeline is the bottleneck (items pile up in front of it)
+ */
+template <typename T>
+class Queue {
+private:
+  std::deque<T> items;
+  bool closed = false;
+
+  size_t pushed = 0;
+  size_t max_depth = 0;
+  size_t depth_sum = 0;
+
+  mutable std::mutex mutex;
+  std::condition_variable cv;
+
+public:
+  Queue() = default;
+  ~Queue() = default;
+
+  void push(T item) {
+    {
+      std::lock_guard lock(mutex);
+
+      items.push_back(std::move(item));
+
+      ++pushed;
+      depth_sum += items.size();
+      max_depth = std::max(max_depth, items.size());
+    }
+
+    cv.notify_one();
+  }
+
+  /**
+   * Blocks until an item is available. Returns empty optional once queue is closed & drained
+   */
+  std::optional<T> pop() {
+    std::unique_lock lock(mutex);
+
+    cv.wait(lock, [this] { return !items.empty() || closed; });
+
+    if (items.empty()) {
+      return std::nullopt;
+    }
+
+    auto item = std::move(items.front());
+    items.pop_front();
+
+    return item;
+  }
+
+  /**
+   * No more items will be pushed, consumers finish once queue is drained
+   */
+  void close() {
+    {
+      std::lock_guard lock(mutex);
+      closed = true;
+    }
+
+    cv.notify_all();
+  }
+
+  [[nodiscard]] size_t getPushed() const {
+    std::lock_guard lock(mutex);
+    return pushed;
+  }
+
+  [[nodiscard]] size_t getMaxDepth() const {
+    std::lock_guard lock(mutex);
+    return max_depth;
+  }
+
+  [[nodiscard]] double getAverageDepth() const {
+    std::lock_guard lock(mutex);
+    return pushed ? (double) depth_sum / pushed : 0;
+  }
+};
+
+} /* namespace xcc::util */
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <llvm/Support/DataExtractor.h>
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xcc::util {
+
+/**
+ * (name, value) pairs, e.g. struct members or function arguments
+ */
+using StringPairs = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * Writes little endian binary format of xcc files (unit artifacts, snapshots, preludes): magic (including
+ * terminating zero) & u32 version, followed by integers, u64 length-prefixed strings & u32 counted lists
+ */
+class BinaryWriter {
+private:
+  llvm::raw_ostream& out;
+  llvm::support::endian::Writer writer;
+
+public:
+  BinaryWriter(llvm::raw_ostream& out, const char * magic, uint32_t version);
+  ~BinaryWriter() = default;
+
+  template<typename T>
+  void write(T value) {
+    writer.write<T>(value);
+  }
+
+  void writeString(llvm::StringRef str);
+  void writePairs(const StringPairs& pairs);
+};
+
+/**
+ * Reads binary format from a buffer. Read errors are accumulated, so a whole file can be read & checked once
+ * with takeError(), reads after an error return empty values
+ *
+ * Example:
+ * @code{.c}
+ *   util::BinaryReader reader(data, MAGIC);
+ *   assertThrow(reader.getVersion() == VERSION, ...);
+ *   auto count = reader.read<uint32_t>();
+ *
+ *   for (uint32_t i = 0; i < count && reader; ++i) {
+ *     names.push_back(reader.readString());
+ *   }
+ *
+ *   if (auto err = reader.takeError()) { ... }
+ * @encode
+ */
+class BinaryReader {
+private:
+  llvm::DataExtractor extractor;
+  llvm::DataExtractor::Cursor cursor;
+  std::optional<uint32_t> version;
+
+public:
+  BinaryReader(llvm::StringRef data, const char * magic);
+  ~BinaryReader();
+
+  /**
+   * Returns version of the file, std::nullopt if data doesn't start with magic
+   */
+  [[nodiscard]] std::optional<uint32_t> getVersion() const {
+    return version;
+  }
+
+  template<typename T>
+  T read() {
+    static_assert(std::is_same_v<T, uint8_t> || std::is_same_v<T, uint32_t> || std::is_same_v<T, uint64_t>);
+
+    if constexpr (std::is_same_v<T, uint8_t>) {
+      return extractor.getU8(cursor);
+    } else if constexpr (std::is_same_v<T, uint32_t>) {
+      return extractor.getU32(cursor);
+    } else {
+      return extractor.getU64(cursor);
+    }
+  }
+
+  std::string readString();
+  StringPairs readPairs();
+
+  /**
+   * Returns false after a read error
+   */
+  explicit operator bool() {
+    return bool(cursor);
+  }
+
+  llvm::Error takeError() {
+    return cursor.takeError();
+  }
+};
+
+} /* namespace xcc::util */
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+
+namespace xcc::util {
+
+/**
+ * Simple monotonic stopwatch, used to measure compilation phases
+ *
+ * Example:
+ * @code{.c}
+ *   util::Timer timer;
+ *   ...
+ *   logger.info("Took {:.3f}ms", timer.elapsedMs());
+ * @encode
+ */
+class Timer {
+private:
+  std::chrono::steady_clock::time_point start;
+
+public:
+  Timer() : start(std::chrono::steady_clock::now()) {}
+  ~Timer() = default;
+
+  /**
+   * Restarts the timer
+   */
+  void reset() {
+    start = std::chrono::steady_clock::now();
+  }
+
+  /**
+   * Returns time elapsed since construction or last reset() in milliseconds
+   */
+  [[nodiscard]] double elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+};
+
+} /* namespace xcc::util */
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "xcc/codegen.h"
+
+namespace xcc {
+
+/**
+ * Watch mode (--watch) - reruns `main` of the input file on every change
+ *
+ * GlobalContext (and JIT) is kept between runs. Every top-level definition is hashed by its tokens
+ * & interfaces (signatures, struct layouts, global types) of definitions it references, transitively,
+ * so only definitions with changed hashes are lowered & compiled again. Functions are replaced in
+ * place (hot swap), globals keep their values
+ */
+class Watcher {
+private:
+  std::unique_ptr<codegen::GlobalContext>& globalContext;
+  std::string path;
+
+  /* Hashes of top-level definitions, compiled by previous runs */
+  std::unordered_map<std::string, uint64_t> hashes;
+
+  std::chrono::milliseconds poll_interval;
+
+public:
+  Watcher(std::unique_ptr<codegen::GlobalContext>& globalContext, std::string path, std::chrono::milliseconds poll_interval);
+  ~Watcher() = default;
+
+  static std::unique_ptr<Watcher> create(
+    std::unique_ptr<codegen::GlobalContext>& globalContext,
+    std::string path,
+    std::chrono::milliseconds poll_interval = std::chrono::milliseconds(100)
+  );
+
+  /**
+   * Runs input file & reruns it on every change (checked by modification time). Never returns
+   */
+  [[noreturn]] void run();
+
+  /**
+   * Recompiles changed definitions of `src` & runs `main`
+   *
+   * @return Amount of recompiled definitions
+   */
+  size_t update(const std::string& src);
+};
+
+} /* namespace xcc */
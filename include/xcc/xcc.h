@@ -6,6 +6,7 @@
 #include "xcc/parser.h"
 #include "xcc/codegen.h"
 #include "xcc/exceptions.h"
+#include "xcc/options.h"
 #include "xcc/util/log.h"
 
 namespace xcc {
@@ -38,7 +39,45 @@ void cleanup();
  * @param globalContext GlobalContext
  * @param src String containing code
  * @param isRepl True if run in REPL mode
+ * @param path Path of the source file, imports are resolved relative to it (if empty - to current directory)
  */
-void run(std::unique_ptr<codegen::GlobalContext>& globalContext, const std::string& src, bool isRepl = false);
+void run(std::unique_ptr<codegen::GlobalContext>& globalContext, const std::string& src, bool isRepl = false, const std::string& path = "");
+
+/**
+ * Runs source in `sessions` concurrent sessions (one thread & GlobalContext each), sharing one JIT engine
+ * (ExecutionSession, object layer & thread pool), reports throughput
+ *
+ * @param options Compiler options of every session
+ * @param src String containing code
+ * @param sessions Amount of concurrent sessions
+ * @return Amount of failed sessions
+ */
+size_t runSessions(const Options& options, const std::string& src, size_t sessions);
+
+/**
+ * Finishes compilation, if code isn't run in JIT: nothing is left to do for --check, --emit-ir-only prints
+ * modules as they are, otherwise modules are linked & compiled ahead of time
+ *
+ * @param globalContext GlobalContext
+ * @param modules Lowered modules (global module first)
+ */
+void emit(std::unique_ptr<codegen::GlobalContext>& globalContext, const std::vector<const llvm::Module *>& modules);
+
+/**
+ * Lowers function nodes, each into its own ModuleContext
+ *
+ * All signatures must be registered beforehand (declaration phase), so bodies don't depend on each other
+ * and can be lowered concurrently. Resulting modules are stored by index, so output doesn't depend on
+ * scheduling. If lowering fails - exception of the first (in source order) failed function is rethrown
+ *
+ * @param globalContext GlobalContext
+ * @param fn_nodes Function definitions/declarations
+ * @param data_modules Data modules (see ModuleContext::data_module) by function index, if empty - globalModule is used
+ */
+std::vector<std::unique_ptr<codegen::ModuleContext>> lowerFunctions(
+  std::unique_ptr<codegen::GlobalContext>& globalContext,
+  const std::vector<std::shared_ptr<ast::Node>>& fn_nodes,
+  const std::vector<codegen::ModuleContext *>& data_modules = {}
+);
 
 }
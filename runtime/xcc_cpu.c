@@ -0,0 +1,39 @@
+/**
+ * CPU feature detection, used by resolvers of multiversioned (`#[target_clones(...)]`) functions
+ *
+ * Linked into both xcc (for JIT'd code) and xcc runtime library (for AOT compiled executables)
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define XCC_CPU_FEATURE(feature)              \
+  if (!strcmp(name, feature)) {               \
+    return __builtin_cpu_supports(feature) ? 1 : 0; \
+  }
+
+int32_t xcc_cpu_supports(int8_t * feature) {
+  const char * name = (const char *) feature;
+
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+
+  XCC_CPU_FEATURE("sse3")
+  XCC_CPU_FEATURE("ssse3")
+  XCC_CPU_FEATURE("sse4.1")
+  XCC_CPU_FEATURE("sse4.2")
+  XCC_CPU_FEATURE("popcnt")
+  XCC_CPU_FEATURE("avx")
+  XCC_CPU_FEATURE("avx2")
+  XCC_CPU_FEATURE("fma")
+  XCC_CPU_FEATURE("bmi")
+  XCC_CPU_FEATURE("bmi2")
+  XCC_CPU_FEATURE("avx512f")
+  XCC_CPU_FEATURE("avx512bw")
+  XCC_CPU_FEATURE("avx512dq")
+  XCC_CPU_FEATURE("avx512vl")
+#endif
+
+  /* Unknown feature (or non-x86 host) - default version is used */
+  return 0;
+}
@@ -0,0 +1,34 @@
+/**
+ * XCC runtime library
+ *
+ * Linked into ahead of time compiled executables, provides the same `xcc_*`
+ * helpers, that xcc binary exports to JIT compiled code
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+int32_t xcc_putc(int32_t c) {
+  fputc((char) c, stdout);
+  return 0;
+}
+
+int32_t xcc_putd(int32_t i) {
+  printf("%d", i);
+  return 0;
+}
+
+int32_t xcc_putud(uint32_t i) {
+  printf("%u", i);
+  return 0;
+}
+
+int32_t xcc_putux(uint32_t i) {
+  printf("%x", i);
+  return 0;
+}
+
+int32_t xcc_puts(int8_t * s) {
+  printf("%s", (char *) s);
+  return 0;
+}
@@ -0,0 +1,253 @@
+#include "xcc/aot.h"
+#include "xcc/exceptions.h"
+#include "xcc/util/log.h"
+#include "xcc/util/llvm.h"
+#include "xcc/util/timer.h"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FileUtilities.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/TargetParser/Host.h>
+
+#include <algorithm>
+#include <format>
+
+#ifndef XCC_RUNTIME_LIBRARY
+#define XCC_RUNTIME_LIBRARY "libxcc_runtime.a"
+#endif
+
+using namespace xcc::codegen;
+
+static auto logger = xcc::util::log::Logger("AOT");
+
+AOT::AOT(std::unique_ptr<llvm::TargetMachine> target_machine, Options options)
+  : options(std::move(options)), target_machine(std::move(target_machine)) {}
+
+std::unique_ptr<AOT> AOT::create(const Options& options) {
+  util::initNativeTarget();
+
+  auto triple = llvm::sys::getProcessTriple();
+
+  std::string error;
+  auto target = llvm::TargetRegistry::lookupTarget(triple, error);
+
+  if (!target) {
+    throw CodegenException(std::format("Can't find target '{}': {}", triple, error));
+  }
+
+  // Unlike JIT, generic CPU is used by default, so executables are portable
+  std::string cpu = options.target_cpu.empty() ? "generic" : options.target_cpu;
+  std::string features;
+
+  if (cpu == "native") {
+    auto host = llvm::orc::JITTargetMachineBuilder::detectHost();
+
+    if (!host) {
+      throw CodegenException(host.takeError());
+    }
+
+    cpu = host->getCPU();
+    features = host->getFeatures().getString();
+  }
+
+  if (!options.target_features.empty()) {
+    features = features.empty() ? options.target_features : features + "," + options.target_features;
+  }
+
+  // PIC, as system linker usually produces position independent executables
+  std::unique_ptr<llvm::TargetMachine> target_machine(target->createTargetMachine(
+    triple, cpu, features, llvm::TargetOptions(), llvm::Reloc::PIC_, std::nullopt, llvm::CodeGenOptLevel::Default));
+
+  if (!target_machine) {
+    throw CodegenException(std::format("Can't create target machine for '{}'", triple));
+  }
+
+  return std::make_unique<AOT>(std::move(target_machine), options);
+}
+
+void AOT::compile(const std::vector<const llvm::Module *>& modules, Remarks * remarks) {
+  util::Timer timer;
+
+  llvm::LLVMContext ctx;
+
+  if (remarks) {
+    remarks->install(ctx);
+  }
+
+  auto module = link(ctx, modules);
+
+  if (options.timings) {
+    logger.info("Phase '{}' took {:.3f}ms", "link-modules", timer.elapsedMs());
+  }
+
+  timer.reset();
+
+  if (options.opt_level) {
+    optimize(*module);
+
+    if (options.timings) {
+      logger.info("Phase '{}' took {:.3f}ms", "optimize", timer.elapsedMs());
+    }
+
+    timer.reset();
+  }
+
+  switch (options.emit) {
+    case Emit::LLVM_IR: {
+      std::error_code ec;
+      llvm::raw_fd_ostream out(options.output, ec, llvm::sys::fs::OF_Text);
+
+      if (ec) {
+        throw CodegenException(std::format("Can't open '{}': {}", options.output, ec.message()));
+      }
+
+      module->print(out, nullptr);
+      break;
+    }
+
+    case Emit::ASSEMBLY:
+      emitFile(*module, options.output, llvm::CodeGenFileType::AssemblyFile);
+      break;
+
+    case Emit::OBJECT:
+      emitFile(*module, options.output, llvm::CodeGenFileType::ObjectFile);
+      break;
+
+    case Emit::EXECUTABLE: {
+      llvm::SmallString<128> object;
+
+      if (auto ec = llvm::sys::fs::createTemporaryFile("xcc", "o", object)) {
+        throw CodegenException(std::format("Can't create temporary object file: {}", ec.message()));
+      }
+
+      llvm::FileRemover remover(object);
+
+      emitFile(*module, object.str().str(), llvm::CodeGenFileType::ObjectFile);
+
+      if (options.timings) {
+        logger.info("Phase '{}' took {:.3f}ms", "emit", timer.elapsedMs());
+      }
+
+      timer.reset();
+
+      linkExecutable(object.str().str(), options.output);
+
+      if (options.timings) {
+        logger.info("Phase '{}' took {:.3f}ms", "link", timer.elapsedMs());
+      }
+      return;
+    }
+
+    default:
+      throw CodegenException("AOT compilation requested without output kind");
+  }
+
+  if (options.timings) {
+    logger.info("Phase '{}' took {:.3f}ms", "emit", timer.elapsedMs());
+  }
+}
+
+std::unique_ptr<llvm::Module> AOT::link(llvm::LLVMContext& ctx, const std::vector<const llvm::Module *>& modules) {
+  auto result = std::make_unique<llvm::Module>(options.input, ctx);
+
+  result->setTargetTriple(target_machine->getTargetTriple().str());
+  result->setDataLayout(target_machine->createDataLayout());
+
+  llvm::Linker linker(*result);
+
+  for (auto module : modules) {
+    // Every module lives in its own LLVMContext, so it's copied (through bitcode) into ctx first
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream stream(buffer);
+    llvm::WriteBitcodeToFile(*module, stream);
+
+    auto copy = llvm::parseBitcodeFile(llvm::MemoryBufferRef(llvm::StringRef(buffer.data(), buffer.size()), module->getName()), ctx);
+
+    if (!copy) {
+      throw CodegenException(copy.takeError());
+    }
+
+    (*copy)->setTargetTriple(result->getTargetTriple());
+    (*copy)->setDataLayout(result->getDataLayout());
+
+    if (linker.linkInModule(std::move(*copy))) {
+      throw CodegenException(std::format("Failed to link module '{}'", module->getName().str()));
+    }
+  }
+
+  return result;
+}
+
+void AOT::optimize(llvm::Module& module) {
+  static const llvm::OptimizationLevel LEVELS[] = {
+    llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1, llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3,
+  };
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  // Target machine gives cost model to vectorizer & inliner
+  llvm::PassBuilder pass_builder(target_machine.get());
+
+  pass_builder.registerModuleAnalyses(mam);
+  pass_builder.registerCGSCCAnalyses(cgam);
+  pass_builder.registerFunctionAnalyses(fam);
+  pass_builder.registerLoopAnalyses(lam);
+  pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  pass_builder.buildPerModuleDefaultPipeline(LEVELS[std::min(options.opt_level, 3u)]).run(module, mam);
+}
+
+void AOT::emitFile(llvm::Module& module, const std::string& path, llvm::CodeGenFileType type) {
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+
+  if (ec) {
+    throw CodegenException(std::format("Can't open '{}': {}", path, ec.message()));
+  }
+
+  llvm::legacy::PassManager pass_manager;
+
+  if (target_machine->addPassesToEmitFile(pass_manager, out, nullptr, type)) {
+    throw CodegenException("Target machine can't emit file of this type");
+  }
+
+  pass_manager.run(module);
+  out.flush();
+}
+
+void AOT::linkExecutable(const std::string& object, const std::string& output) {
+  auto cc = llvm::sys::Process::GetEnv("CC").value_or("cc");
+
+  auto program = llvm::sys::findProgramByName(cc);
+
+  if (!program) {
+    throw CodegenException(std::format("Can't find system linker '{}': {}", cc, program.getError().message()));
+  }
+
+  auto runtime = getRuntimeLibrary();
+
+  llvm::SmallVector<llvm::StringRef> args = {*program, object, runtime, "-lm", "-o", output};
+
+  std::string error;
+  int status = llvm::sys::ExecuteAndWait(*program, args, std::nullopt, {}, 0, 0, &error);
+
+  if (status != 0) {
+    throw CodegenException(std::format("Linking '{}' failed (status {}){}", output, status, error.empty() ? "" : ": " + error));
+  }
+}
+
+std::string AOT::getRuntimeLibrary() {
+  return llvm::sys::Process::GetEnv("XCC_RUNTIME").value_or(XCC_RUNTIME_LIBRARY);
+}
@@ -141,7 +141,7 @@ static void printNode(Node* node, Node* parent, int indent) {
       for (auto& stmt : block->body) {
         printIndent(indent + 2);
         printNode(stmt.get(), block, indent + 2);
-        if (!stmt->isAnyOf(AST_BLOCK, AST_FUNCTION_DECL, AST_FUNCTION_DEF, AST_IF, AST_FOR, AST_WHILE, AST_STRUCT)) {
+        if (!stmt->isAnyOf(AST_BLOCK, AST_FUNCTION_DECL, AST_FUNCTION_DEF, AST_IF, AST_FOR, AST_WHILE, AST_STRUCT, AST_IMPORT)) {
           logger.print(";\n");
         }
       }
@@ -244,6 +244,11 @@ static void printNode(Node* node, Node* parent, int indent) {
       break;
     }
 
+    case AST_IMPORT: {
+      logger.print("import \"{}\";\n", node->as<Import>()->path);
+      break;
+    }
+
     case AST_WHILE: {
       auto while_stmt = node->as<While>();
       logger.print("while (");
@@ -14,6 +14,7 @@ llvm::Value * Block::generateValue(codegen::ModuleContext &ctx, PayloadList payl
   llvm::Value * val = nullptr;
 
   for (auto& node : body) {
+    ctx.setDebugLocation(node->line);
     val = node->generateValue(ctx, {});
   }
 
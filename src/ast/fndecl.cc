@@ -28,7 +28,17 @@ std::shared_ptr<FnDecl> FnDecl::create(
   return std::make_shared<FnDecl>(std::move(name), std::move(return_type), std::move(args), isExtern, isVariadic);
 }
 
-llvm::Function * FnDecl::generateFunction(codegen::ModuleContext& ctx, PayloadList payload) {
+const FnAttribute * FnDecl::getAttribute(const std::string& name) const {
+  for (auto& attribute : attributes) {
+    if (attribute.name == name) {
+      return &attribute;
+    }
+  }
+
+  return nullptr;
+}
+
+std::shared_ptr<meta::Function> FnDecl::generateMetaFunction(codegen::ModuleContext& ctx) {
   std::string fn_name = name->value;
 
   OrderedMap<std::string, std::shared_ptr<xcc::meta::Type>> arg_meta_types;
@@ -41,9 +51,20 @@ llvm::Function * FnDecl::generateFunction(codegen::ModuleContext& ctx, PayloadLi
     }
   }
 
-  auto return_meta_type = return_type->generateType(ctx, {});
+  return meta::Function::create(
+      fn_name,
+      return_type->generateType(ctx, {}),
+      arg_meta_types,
+      shared_from_this()
+  );
+}
+
+llvm::Function * FnDecl::generateFunction(codegen::ModuleContext& ctx, PayloadList payload) {
+  std::string fn_name = name->value;
+
+  auto fn = generateMetaFunction(ctx);
 
-  auto llvm_fn_type = llvm::FunctionType::get(return_meta_type->getLLVMType(ctx), meta::Function::typesFromMetaArgs(ctx, arg_meta_types), isVariadic);
+  auto llvm_fn_type = llvm::FunctionType::get(fn->getLLVMReturnType(ctx), fn->getLLVMArgTypes(ctx), isVariadic);
   // auto llvm_fn = llvm::Function::Create(llvm_fn_type, isExtern ? llvm::Function::ExternalLinkage : llvm::Function::CommonLinkage, fn_name, ctx.llvm.module.get());
   // TODO: LLVM Disallows CommonLinkage, maybe replace with Private?
   auto llvm_fn = llvm::Function::Create(llvm_fn_type, llvm::Function::ExternalLinkage, fn_name, ctx.llvm.module.get());
@@ -53,14 +74,13 @@ llvm::Function * FnDecl::generateFunction(codegen::ModuleContext& ctx, PayloadLi
     arg.setName(args[arg_idx++]->name->value);
   }
 
-  auto fn = meta::Function::create(
-      fn_name,
-      return_meta_type,
-      arg_meta_types,
-      shared_from_this()
-  );
+  // Declaration phase may have already registered this exact declaration,
+  // skip re-registering it to avoid contention while lowering in parallel
+  auto registered = ctx.globalContext.getMetaFunction(fn_name);
 
-  ctx.globalContext.addFunction(fn_name, fn);
+  if (!registered || registered->decl.get() != this) {
+    ctx.globalContext.addFunction(fn_name, fn);
+  }
 
   return llvm_fn;
 }
\ No newline at end of file
@@ -3,11 +3,139 @@
 #include "xcc/exceptions.h"
 #include "xcc/util/log.h"
 
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <algorithm>
+
 using namespace xcc;
 using namespace xcc::ast;
 
+constexpr char TARGET_CLONES_ATTRIBUTE[] = "target_clones";
+constexpr char TARGET_CLONES_DEFAULT[] = "default";
+
+/* Runtime helper (runtime/xcc_cpu.c), checks CPU feature using CPUID */
+constexpr char CPU_SUPPORTS_FN_NAME[] = "xcc_cpu_supports";
+
 static auto logger = xcc::util::log::Logger("FN", util::log::Flag::SPLIT_ON_NEWLINE);
 
+/**
+ * Multiversions function (`#[target_clones("avx2", "default")]`)
+ *
+ * Every non-default target gets a clone of the body, compiled with `+<target>` feature, original body becomes
+ * `<name>.default`. Function itself becomes a dispatcher, which on first call picks the first (in attribute order)
+ * version, that CPU supports, and caches it
+ */
+static llvm::Function * generateTargetClones(codegen::ModuleContext& ctx, llvm::Function * fn, const std::vector<std::string>& targets) {
+  auto name = fn->getName().str();
+
+  assertThrow(!fn->isVarArg(), CodegenException("Variadic function '" + name + "' can't have target clones"));
+  assertThrow(std::find(targets.begin(), targets.end(), TARGET_CLONES_DEFAULT) != targets.end(),
+              CodegenException("Function '" + name + "' target clones must include 'default'"));
+
+  auto& llvm_ctx = *ctx.llvm.ctx;
+  auto& module = *ctx.llvm.module;
+  auto ptr = llvm::PointerType::getUnqual(llvm_ctx);
+
+  std::vector<std::pair<std::string, llvm::Function *>> versions;
+
+  for (auto& target : targets) {
+    if (target == TARGET_CLONES_DEFAULT) {
+      continue;
+    }
+
+    auto clone = llvm::Function::Create(fn->getFunctionType(), llvm::GlobalValue::InternalLinkage, name + "." + target, module);
+
+    llvm::ValueToValueMapTy vmap;
+    auto clone_arg = clone->arg_begin();
+
+    for (auto& arg : fn->args()) {
+      clone_arg->setName(arg.getName());
+      vmap[&arg] = &*clone_arg++;
+    }
+
+    // Recursive calls stay within the same version
+    vmap[fn] = clone;
+
+    llvm::SmallVector<llvm::ReturnInst *, 4> returns;
+    llvm::CloneFunctionInto(clone, fn, vmap, llvm::CloneFunctionChangeType::LocalChangesOnly, returns);
+
+    clone->setLinkage(llvm::GlobalValue::InternalLinkage);
+    clone->addFnAttr("target-features", "+" + target);
+
+    versions.emplace_back(target, clone);
+  }
+
+  fn->setName(name + "." + TARGET_CLONES_DEFAULT);
+  fn->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+  llvm::IRBuilder<> builder(llvm_ctx);
+
+  // Resolver - returns the best version, supported by CPU
+  auto resolver = llvm::Function::Create(llvm::FunctionType::get(ptr, false), llvm::GlobalValue::InternalLinkage, name + ".resolver", module);
+  auto cpu_supports = module.getOrInsertFunction(CPU_SUPPORTS_FN_NAME, llvm::FunctionType::get(builder.getInt32Ty(), {ptr}, false));
+
+  builder.SetInsertPoint(llvm::BasicBlock::Create(llvm_ctx, "entry", resolver));
+
+  for (auto& [target, version] : versions) {
+    auto supported = builder.CreateCall(cpu_supports, {builder.CreateGlobalString(target)});
+    auto found = llvm::BasicBlock::Create(llvm_ctx, target, resolver);
+    auto next = llvm::BasicBlock::Create(llvm_ctx, "next", resolver);
+
+    builder.CreateCondBr(builder.CreateICmpNE(supported, builder.getInt32(0)), found, next);
+
+    builder.SetInsertPoint(found);
+    builder.CreateRet(version);
+
+    builder.SetInsertPoint(next);
+  }
+
+  builder.CreateRet(fn);
+
+  // Dispatcher - resolves version on first call, then calls it through cached pointer
+  auto resolved = new llvm::GlobalVariable(
+    module, ptr, false, llvm::GlobalValue::InternalLinkage, llvm::ConstantPointerNull::get(ptr), name + ".resolved");
+
+  auto dispatcher = llvm::Function::Create(fn->getFunctionType(), llvm::GlobalValue::ExternalLinkage, name, module);
+
+  auto entry = llvm::BasicBlock::Create(llvm_ctx, "entry", dispatcher);
+  auto resolve = llvm::BasicBlock::Create(llvm_ctx, "resolve", dispatcher);
+  auto dispatch = llvm::BasicBlock::Create(llvm_ctx, "dispatch", dispatcher);
+
+  builder.SetInsertPoint(entry);
+  auto cached = builder.CreateLoad(ptr, resolved);
+  cached->setAtomic(llvm::AtomicOrdering::Monotonic);
+  cached->setAlignment(llvm::Align(8));
+  builder.CreateCondBr(builder.CreateIsNull(cached), resolve, dispatch);
+
+  builder.SetInsertPoint(resolve);
+  auto result = builder.CreateCall(resolver);
+  auto store = builder.CreateStore(result, resolved);
+  store->setAtomic(llvm::AtomicOrdering::Monotonic);
+  store->setAlignment(llvm::Align(8));
+  builder.CreateBr(dispatch);
+
+  builder.SetInsertPoint(dispatch);
+  auto target = builder.CreatePHI(ptr, 2);
+  target->addIncoming(cached, entry);
+  target->addIncoming(result, resolve);
+
+  std::vector<llvm::Value *> args;
+  for (auto& arg : dispatcher->args()) {
+    args.push_back(&arg);
+  }
+
+  auto call = builder.CreateCall(fn->getFunctionType(), target, args);
+  call->setTailCall();
+
+  if (fn->getReturnType()->isVoidTy()) {
+    builder.CreateRetVoid();
+  } else {
+    builder.CreateRet(call);
+  }
+
+  return dispatcher;
+}
+
 FnDef::FnDef(std::shared_ptr<FnDecl> decl, std::shared_ptr<Block> body)
   : Node(AST_FUNCTION_DEF), decl(std::move(decl)), body(std::move(body)) {}
 
@@ -29,6 +157,7 @@ llvm::Function * FnDef::generateFunction(codegen::ModuleContext& ctx, PayloadLis
   auto basic_block = llvm::BasicBlock::Create(*ctx.llvm.ctx, "entry", fn);
 
   ctx.ir_builder->SetInsertPoint(basic_block);
+  ctx.beginDebugFunction(fn, line);
 
   ctx.locals.clear();
 
@@ -38,7 +167,7 @@ llvm::Function * FnDef::generateFunction(codegen::ModuleContext& ctx, PayloadLis
     ctx.ir_builder->CreateStore(&arg, ctx.locals[arg_name]->value);
   }
 
-  ctx.globalContext.setCurrentFunction(decl->name->value);
+  ctx.setCurrentFunction(decl->name->value);
 
   auto last_val = body->generateValue(ctx, {});
 
@@ -51,7 +180,8 @@ llvm::Function * FnDef::generateFunction(codegen::ModuleContext& ctx, PayloadLis
     }
   }
 
-  ctx.globalContext.clearCurrentFunction();
+  ctx.endDebugFunction();
+  ctx.clearCurrentFunction();
 
   util::RawStreamCollector collector;
   if (llvm::verifyFunction(*fn, collector.stream())) {
@@ -64,5 +194,9 @@ llvm::Function * FnDef::generateFunction(codegen::ModuleContext& ctx, PayloadLis
     throw CodegenException("Function '" + decl->name->value + "' didn't pass validation\n" + collector.string());
   }
 
+  if (auto target_clones = decl->getAttribute(TARGET_CLONES_ATTRIBUTE)) {
+    fn = generateTargetClones(ctx, fn, target_clones->args);
+  }
+
   return fn;
 }
\ No newline at end of file
@@ -0,0 +1,9 @@
+#include "xcc/ast/import.h"
+
+using namespace xcc::ast;
+
+Import::Import(std::string path) : Node(AST_IMPORT), path(std::move(path)) {}
+
+std::shared_ptr<Import> Import::create(std::string path) {
+  return std::make_shared<Import>(std::move(path));
+}
@@ -18,6 +18,7 @@ static const std::unordered_map<NodeType, std::string> s_type_map {
     {AST_FUNCTION_DECL,         "AST_FUNCTION_DECL"},
     {AST_FUNCTION_DEF,          "AST_FUNCTION_DEF"},
     {AST_FOR,                   "AST_FOR"},
+    {AST_IMPORT,                "AST_IMPORT"},
     {AST_EXPR_IDENTIFIER,       "AST_EXPR_IDENTIFIER"},
     {AST_IF,                    "AST_IF"},
     {AST_EXPR_MEMBER_ACCESS,    "AST_EXPR_MEMBER_ACCESS"},
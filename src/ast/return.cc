@@ -16,7 +16,7 @@ llvm::Value * Return::generateValue(codegen::ModuleContext& ctx, PayloadList pay
   if (value) {
     val = value->generateValue(ctx, {});
 
-    if (auto fn = ctx.globalContext.getCurrentFunction()) {
+    if (auto fn = ctx.getCurrentFunction()) {
       val = codegen::castIfNotSame(ctx, val, fn->getLLVMReturnType(ctx));
     }
 
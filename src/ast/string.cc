@@ -13,17 +13,30 @@ llvm::Value * String::generateValue(codegen::ModuleContext& ctx, PayloadList pay
   auto hash = std::hash<std::string>{}(value);
   auto name = ".str." + std::to_string(hash);
 
-  llvm::Constant * constant = llvm::ConstantDataArray::getString(*ctx.globalContext.globalModule->llvm.ctx, value, true);
-
-  if (!constant->isConstantUsed()) {
-    [[maybe_unused]] auto global = new llvm::GlobalVariable(
-        *ctx.globalContext.globalModule->llvm.module,
-        constant->getType(),
-        true,
-        llvm::GlobalValue::ExternalLinkage,
-        constant,
-        name
-    );
+  auto& data = ctx.getDataModule();
+
+  // Every imported unit defines strings it uses, so they are named after unit's data module
+  if (ctx.data_module) {
+    name += "." + data.llvm.module->getModuleIdentifier();
+  }
+
+  {
+    // Global module (and its LLVMContext) is shared between functions, which may be lowered concurrently
+    std::lock_guard lock(ctx.globalContext.global_module_mutex);
+
+    llvm::Constant * constant = llvm::ConstantDataArray::getString(*data.llvm.ctx, value, true);
+
+    // String may be already committed to JIT by previous REPL line (from another globalModule)
+    if (!constant->isConstantUsed() && !ctx.globalContext.isGlobalCommitted(name)) {
+      [[maybe_unused]] auto global = new llvm::GlobalVariable(
+          *data.llvm.module,
+          constant->getType(),
+          true,
+          llvm::GlobalValue::ExternalLinkage,
+          constant,
+          name
+      );
+    }
   }
 
   auto extern_global = llvm::cast<llvm::GlobalVariable>(
@@ -37,7 +50,7 @@ llvm::Value * String::generateValue(codegen::ModuleContext& ctx, PayloadList pay
 }
 
 llvm::Value * String::generateValueWithoutLoad(codegen::ModuleContext& ctx, PayloadList payload) {
-  return llvm::ConstantDataArray::getString(*ctx.globalContext.globalModule->llvm.ctx, value, true);
+  return llvm::ConstantDataArray::getString(*ctx.getDataModule().llvm.ctx, value, true);
 }
 
 std::shared_ptr<xcc::meta::Type> String::generateType(codegen::ModuleContext& ctx, PayloadList payload) {
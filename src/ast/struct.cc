@@ -34,7 +34,7 @@ std::shared_ptr<meta::Type> Struct::generateTypeForValueWithoutLoad(codegen::Mod
 
   auto type =  meta::Type::createStruct(name->value, members);
 
-  meta::Type::registerCustomType(name->value, type);
+  ctx.globalContext.addType(name->value, type);
 
   return type;
 }
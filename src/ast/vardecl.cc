@@ -32,16 +32,22 @@ llvm::Value * VarDecl::generateValue(codegen::ModuleContext& ctx, PayloadList pa
   auto meta_type = type ? type->generateType(ctx, {}) : meta::Type::inferFromNode(ctx, value);
 
   if (global) {
+    // Global module may be modified by functions, which are lowered while globals are still being declared (see Pipeline)
+    std::lock_guard lock(ctx.globalContext.global_module_mutex);
+
     // FIXME: Check if can convert to constant
 
     auto constant = (llvm::Constant *)(value
         ? value->generateValueWithoutLoad(ctx, {Number::Payload::create(meta_type->getNumberBitWidth())})
         : meta_type->getDefault(ctx));
 
-    ctx.globalContext.globals[name->value] = meta_type;
+    assertThrow(!ctx.globalContext.isGlobalCommitted(name->value),
+                CodegenException("Global variable '" + name->value + "' is already defined"));
+
+    ctx.globalContext.addGlobal(name->value, meta_type);
 
     [[maybe_unused]] auto global = new llvm::GlobalVariable(
-        *ctx.globalContext.globalModule->llvm.module,
+        *ctx.getDataModule().llvm.module,
         constant->getType(),
         false,
         llvm::GlobalValue::ExternalLinkage,
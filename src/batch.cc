@@ -0,0 +1,275 @@
+#include "xcc/batch.h"
+#include "xcc/util/timer.h"
+#include "xcc/xcc.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Threading.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace xcc;
+
+static auto logger = xcc::util::log::Logger("BATCH");
+
+/**
+ * Program, that is running in a child
+ */
+struct Running {
+  size_t idx;
+  int out_fd;
+  int err_fd;
+  std::string out_path;
+  std::string err_path;
+  util::Timer timer;
+};
+
+static int createCapture(std::string& path) {
+  int fd;
+  llvm::SmallString<128> result;
+
+  if (auto ec = llvm::sys::fs::createTemporaryFile("xcc-batch", "out", fd, result)) {
+    throw std::runtime_error(std::format("Can't create temporary file: {}", ec.message()));
+  }
+
+  path = result.str().str();
+
+  return fd;
+}
+
+/**
+ * Reads whole capture file (written by a child through the same descriptor) & removes it
+ */
+static std::string readCapture(int fd, const std::string& path) {
+  std::string result;
+  char buffer[4096];
+
+  lseek(fd, 0, SEEK_SET);
+
+  while (true) {
+    auto size = read(fd, buffer, sizeof(buffer));
+
+    if (size < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (size <= 0) {
+      break;
+    }
+
+    result.append(buffer, size);
+  }
+
+  close(fd);
+  llvm::sys::fs::remove(path);
+
+  return result;
+}
+
+Batch::Batch(Options options) : options(std::move(options)), programs(expand(this->options.batch_inputs)) {}
+
+std::unique_ptr<Batch> Batch::create(Options options) {
+  return std::make_unique<Batch>(std::move(options));
+}
+
+std::vector<std::string> Batch::expand(const std::vector<std::string>& inputs) {
+  std::vector<std::string> result;
+
+  for (auto& input : inputs) {
+    if (!input.starts_with("@")) {
+      result.push_back(input);
+      continue;
+    }
+
+    auto manifest = input.substr(1);
+    std::ifstream fs(manifest);
+
+    if (!fs.is_open()) {
+      throw std::runtime_error(std::format("Failed to open manifest '{}'", manifest));
+    }
+
+    auto base = std::filesystem::path(manifest).parent_path();
+    std::string line;
+
+    while (std::getline(fs, line)) {
+      auto begin = line.find_first_not_of(" \t\r");
+      auto end = line.find_last_not_of(" \t\r");
+
+      if (begin == std::string::npos || line[begin] == '#') {
+        continue;
+      }
+
+      std::filesystem::path path = line.substr(begin, end - begin + 1);
+      result.push_back(path.is_absolute() ? path.string() : (base / path).string());
+    }
+  }
+
+  return result;
+}
+
+int Batch::run() {
+  size_t jobs = llvm::hardware_concurrency(options.jobs).compute_thread_count();
+
+  // Everything, that is the same for all programs, is done before the first fork
+  image = codegen::GlobalContext::create(options);
+
+  // Executor connection can't be shared between forks, so each child spawns its own
+  if (options.isExecuting() && !options.out_of_process) {
+    image->getJIT();
+  }
+
+  util::Timer wall;
+
+  std::vector<std::optional<Result>> results(programs.size());
+  std::unordered_map<pid_t, Running> running;
+
+  size_t next = 0;
+  size_t reported = 0;
+  size_t failed = 0;
+
+  while (reported < programs.size()) {
+    while (next < programs.size() && running.size() < jobs) {
+      Running program;
+      program.idx = next;
+      program.out_fd = createCapture(program.out_path);
+      program.err_fd = createCapture(program.err_path);
+
+      std::cout.flush();
+      std::fflush(nullptr);
+
+      auto pid = fork();
+
+      if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        dup2(null_fd, STDIN_FILENO);
+        dup2(program.out_fd, STDOUT_FILENO);
+        dup2(program.err_fd, STDERR_FILENO);
+
+        auto code = runProgram(programs[next]);
+
+        std::cout.flush();
+        std::fflush(nullptr);
+
+        // Runner's atexit handlers & static destructors must not run in a child
+        _exit(code);
+      }
+
+      if (pid < 0) {
+        close(program.out_fd);
+        close(program.err_fd);
+        llvm::sys::fs::remove(program.out_path);
+        llvm::sys::fs::remove(program.err_path);
+        throw std::runtime_error(std::format("fork() failed: {}", std::strerror(errno)));
+      }
+
+      running.emplace(pid, std::move(program));
+      ++next;
+    }
+
+    int status;
+    auto pid = waitpid(-1, &status, 0);
+
+    if (pid < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::format("waitpid() failed: {}", std::strerror(errno)));
+    }
+
+    auto it = running.find(pid);
+
+    if (it == running.end()) {
+      continue;
+    }
+
+    auto& program = it->second;
+
+    Result result;
+    result.path = programs[program.idx];
+    result.code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    result.ms = program.timer.elapsedMs();
+    result.out = readCapture(program.out_fd, program.out_path);
+    result.err = readCapture(program.err_fd, program.err_path);
+
+    if (result.code != 0) {
+      ++failed;
+    }
+
+    results[program.idx] = std::move(result);
+    running.erase(it);
+
+    // Output is reported in input order, as soon as all preceding programs are done
+    while (reported < programs.size() && results[reported]) {
+      report(*results[reported]);
+      results[reported].reset();
+      ++reported;
+    }
+  }
+
+  if (options.timings) {
+    logger.info("Phase '{}' took {:.3f}ms", "batch", wall.elapsedMs());
+  }
+
+  logger.info("{} programs, {} succeeded, {} failed", programs.size(), programs.size() - failed, failed);
+
+  return failed ? 1 : 0;
+}
+
+int Batch::runProgram(const std::string& path) {
+  try {
+    std::ifstream fs(path);
+
+    if (!fs.is_open()) {
+      throw std::runtime_error(std::format("Failed to open file '{}'", path));
+    }
+
+    std::stringstream ss;
+    ss << fs.rdbuf();
+
+    auto globalContext = std::move(image);
+    globalContext->options.input = path;
+    globalContext->options.jobs = 1;
+
+    xcc::run(globalContext, ss.str(), false, path);
+  } catch (std::exception& e) {
+    logger.fatal("{}", e.what());
+    return 1;
+  }
+
+  return 0;
+}
+
+void Batch::report(const Result& result) const {
+  auto header = std::format("==> {} <== exit {} {:.3f}ms\n", result.path, result.code, result.ms);
+
+  std::cout << header << result.out;
+
+  if (!result.out.empty() && !result.out.ends_with('\n')) {
+    std::cout << '\n';
+  }
+
+  std::cout.flush();
+
+  if (!result.err.empty()) {
+    std::cerr << header << result.err;
+
+    if (!result.err.ends_with('\n')) {
+      std::cerr << '\n';
+    }
+
+    std::cerr.flush();
+  }
+}
@@ -0,0 +1,472 @@
+#include "xcc/bytecode.h"
+#include "xcc/codegen.h"
+#include "xcc/exceptions.h"
+#include "xcc/ast.h"
+
+#include <bit>
+#include <cmath>
+#include <format>
+#include <utility>
+
+using namespace xcc;
+using namespace xcc::bytecode;
+
+Compiler::Compiler(codegen::GlobalContext& globalContext) : globalContext(globalContext) {}
+
+std::optional<Chunk> Compiler::compile(codegen::GlobalContext& globalContext, std::shared_ptr<ast::Node> expr) {
+  Compiler compiler(globalContext);
+
+  try {
+    std::vector<ast::Node *> nodes;
+
+    if (expr->is(ast::AST_BLOCK)) {
+      for (auto& node : expr->as<ast::Block>()->body) {
+        nodes.push_back(node.get());
+      }
+    } else {
+      nodes.push_back(expr.get());
+    }
+
+    if (nodes.empty()) {
+      return std::nullopt;
+    }
+
+    Operand result {};
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      auto node = nodes[i];
+
+      if (node->is(ast::AST_RETURN)) {
+        // Return in the middle of a block is left to JIT (and its verifier)
+        if (i + 1 != nodes.size() || !node->as<ast::Return>()->value) {
+          throw Unsupported();
+        }
+        node = node->as<ast::Return>()->value.get();
+      }
+
+      result = compiler.compileNode(node);
+    }
+
+    compiler.chunk.type = result.type;
+
+    if (result.type->isVoid()) {
+      compiler.emit({OpCode::RET, 0, 0, 0, 0});
+    } else {
+      compiler.emit({OpCode::RET, 0, result.reg, 0, 1});
+    }
+  } catch (Unsupported&) {
+    return std::nullopt;
+  }
+
+  return std::move(compiler.chunk);
+}
+
+uint16_t Compiler::allocate() {
+  if (chunk.registers >= UINT16_MAX) {
+    throw Unsupported();
+  }
+
+  return chunk.registers++;
+}
+
+uint16_t Compiler::emit(Instruction instruction) {
+  chunk.code.push_back(instruction);
+  return instruction.dst;
+}
+
+Compiler::Operand Compiler::compileNode(ast::Node * node) {
+  switch (node->type) {
+    case ast::AST_EXPR_NUMBER:     return compileNumber(node);
+    case ast::AST_EXPR_IDENTIFIER: return compileIdentifier(node);
+    case ast::AST_EXPR_BINARY:     return compileBinary(node);
+    case ast::AST_EXPR_CAST:       return compileCast(node);
+    case ast::AST_EXPR_CALL:       return compileCall(node);
+    default:
+      throw Unsupported();
+  }
+}
+
+Compiler::Operand Compiler::compileNumber(ast::Node * node) {
+  auto number = node->as<ast::Number>();
+
+  // Without payload literals are 64 bit wide, same as in JIT'd code
+  if (number->tag == ast::Number::FLOATING) {
+    return {emit({OpCode::FLOAT, allocate(), 0, 0, std::bit_cast<int64_t>(number->value.floating)}), meta::Type::createF64()};
+  }
+
+  return {emit({OpCode::INT, allocate(), 0, 0, number->value.integer}), meta::Type::createI64()};
+}
+
+Compiler::Operand Compiler::compileIdentifier(ast::Node * node) {
+  auto& name = node->as<ast::Identifier>()->value;
+
+  if (!globalContext.hasGlobal(name)) {
+    throw Unsupported();
+  }
+
+  auto type = globalContext.getGlobalType(name);
+
+  if (!isScalar(type)) {
+    throw Unsupported();
+  }
+
+  chunk.globals.push_back(name);
+
+  return {emit({OpCode::LOAD, allocate(), 0, (uint16_t) type->getTag(), (int64_t) chunk.globals.size() - 1}), type};
+}
+
+Compiler::Operand Compiler::compileBinary(ast::Node * node) {
+  auto binary = node->as<ast::Binary>();
+
+  auto lhs = compileNode(binary->lhs.get());
+  auto rhs = compileNode(binary->rhs.get());
+
+  auto type = meta::Type::alignTypes(lhs.type, rhs.type);
+
+  lhs = convert(lhs, type);
+  rhs = convert(rhs, type);
+
+  OpCode op;
+  bool compare = false;
+
+  if (type->isFloat()) {
+    // Float comparisons produce i1, which converts to floats differently, left to JIT
+    switch (binary->operation.type) {
+      case TOKEN_PLUS:  op = OpCode::FADD; break;
+      case TOKEN_MINUS: op = OpCode::FSUB; break;
+      case TOKEN_STAR:  op = OpCode::FMUL; break;
+      case TOKEN_SLASH: op = OpCode::FDIV; break;
+      default:
+        throw Unsupported();
+    }
+  } else {
+    switch (binary->operation.type) {
+      case TOKEN_PLUS:           op = OpCode::ADD; break;
+      case TOKEN_MINUS:          op = OpCode::SUB; break;
+      case TOKEN_STAR:           op = OpCode::MUL; break;
+      case TOKEN_SLASH:          op = type->isSigned() ? OpCode::SDIV : OpCode::UDIV; break;
+      case TOKEN_AMP:            op = OpCode::AND; break;
+      case TOKEN_VERTICAL_LINE:  op = OpCode::OR; break;
+      case TOKEN_EQUALS_EQUALS:  op = OpCode::EQ;  compare = true; break;
+      case TOKEN_NOT_EQUALS:     op = OpCode::NE;  compare = true; break;
+      case TOKEN_GREATER_EQUALS: op = OpCode::UGE; compare = true; break;
+      case TOKEN_GREATER:        op = OpCode::UGT; compare = true; break;
+      case TOKEN_LESS_EQUALS:    op = OpCode::ULE; compare = true; break;
+      case TOKEN_LESS:           op = OpCode::ULT; compare = true; break;
+      default:
+        // Logical operators require i1 operands in JIT'd code, so they are left to JIT as well
+        throw Unsupported();
+    }
+  }
+
+  auto dst = emit({op, allocate(), lhs.reg, rhs.reg, 0});
+
+  if (compare) {
+    return {dst, type, true};
+  }
+
+  normalize(dst, type);
+
+  if (type->is(meta::TypeTag::F32)) {
+    emit({OpCode::FTRUNC, dst, dst, 0, 0});
+  }
+
+  return {dst, type};
+}
+
+Compiler::Operand Compiler::compileCast(ast::Node * node) {
+  auto cast = node->as<ast::Cast>();
+
+  if (cast->type->pointer || !cast->type->name->is(ast::AST_EXPR_IDENTIFIER)) {
+    throw Unsupported();
+  }
+
+  // User-defined types are never scalar, only built-in ones are looked up
+  auto type = meta::Type::fromTypeName(cast->type->name->as<ast::Identifier>()->value);
+
+  if (!type || !isScalar(type)) {
+    throw Unsupported();
+  }
+
+  return convert(compileNode(cast->expr.get()), type);
+}
+
+Compiler::Operand Compiler::compileCall(ast::Node * node) {
+  auto call = node->as<ast::Call>();
+
+  if (!call->callee->is(ast::AST_EXPR_IDENTIFIER)) {
+    throw Unsupported();
+  }
+
+  auto fn = globalContext.getMetaFunction(call->callee->as<ast::Identifier>()->value);
+
+  // Unknown functions & argument mismatches are reported by JIT path
+  if (!fn || !fn->decl || fn->decl->isVariadic || fn->args.size() != call->args.size() || call->args.size() > MAX_CALL_ARGS) {
+    throw Unsupported();
+  }
+
+  if (!fn->returnType->isVoid() && !isScalar(fn->returnType)) {
+    throw Unsupported();
+  }
+
+  CallSite site {fn, {}};
+
+  for (size_t i = 0; i < call->args.size(); ++i) {
+    auto& type = fn->args[i];
+
+    // Float arguments are passed in different registers, only integer ones are supported
+    if (!type->isInteger()) {
+      throw Unsupported();
+    }
+
+    site.args.push_back(convert(compileNode(call->args[i].get()), type).reg);
+  }
+
+  chunk.calls.push_back(std::move(site));
+
+  return {emit({OpCode::CALL, allocate(), 0, 0, (int64_t) chunk.calls.size() - 1}), fn->returnType};
+}
+
+Compiler::Operand Compiler::convert(const Operand& operand, const std::shared_ptr<meta::Type>& type) {
+  auto& from = operand.type;
+
+  if (from->getTag() == type->getTag()) {
+    return operand;
+  }
+
+  if (from->isVoid() || type->isVoid()) {
+    throw Unsupported();
+  }
+
+  // f32 -> f64 is exact
+  if (from->isFloat() && type->is(meta::TypeTag::F64)) {
+    return {operand.reg, type};
+  }
+
+  auto dst = allocate();
+
+  if (from->isInteger() && type->isFloat()) {
+    // i1 is converted by SIToFP, so `true` becomes -1.0
+    if (operand.boolean) {
+      throw Unsupported();
+    }
+
+    emit({OpCode::SEXT, dst, operand.reg, 0, from->getNumberBitWidth()});
+    emit({OpCode::ITOF, dst, dst, 0, 0});
+
+    if (type->is(meta::TypeTag::F32)) {
+      emit({OpCode::FTRUNC, dst, dst, 0, 0});
+    }
+  } else if (from->isFloat() && type->isInteger()) {
+    emit({OpCode::FTOI, dst, operand.reg, 0, 0});
+    normalize(dst, type);
+  } else if (from->isFloat() && type->isFloat()) {
+    emit({OpCode::FTRUNC, dst, operand.reg, 0, 0});
+  } else {
+    // Integers are widened by ZExt (regardless of signedness) & narrowed by Trunc
+    int from_bits = operand.boolean ? 1 : from->getNumberBitWidth();
+
+    emit({OpCode::ZEXT, dst, operand.reg, 0, from_bits < type->getNumberBitWidth() ? from_bits : 64});
+    normalize(dst, type);
+  }
+
+  return {dst, type};
+}
+
+void Compiler::normalize(uint16_t reg, const std::shared_ptr<meta::Type>& type) {
+  if (!type->isInteger() || type->getNumberBitWidth() >= 64) {
+    return;
+  }
+
+  emit({type->isSigned() ? OpCode::SEXT : OpCode::ZEXT, reg, reg, 0, type->getNumberBitWidth()});
+}
+
+bool Compiler::isScalar(const std::shared_ptr<meta::Type>& type) {
+  return type->isInteger() || type->isFloat();
+}
+
+Interpreter::Interpreter(codegen::GlobalContext& globalContext) : globalContext(globalContext) {}
+
+util::GenericValueContainer Interpreter::run(const Chunk& chunk) {
+  // Called functions may reference strings & globals of the current line
+  globalContext.commitGlobals();
+
+  std::vector<void *> globals;
+
+  for (auto& name : chunk.globals) {
+    globals.push_back(resolve(name));
+  }
+
+  // Calls run JIT'd code, which must not be released meanwhile
+  codegen::JIT::CallScope scope(globalContext.getJIT());
+
+  std::vector<Value> r(chunk.registers);
+
+  for (auto& inst : chunk.code) {
+    switch (inst.op) {
+      case OpCode::INT:   r[inst.dst].i = inst.imm; break;
+      case OpCode::FLOAT: r[inst.dst].f = std::bit_cast<double>(inst.imm); break;
+
+      case OpCode::ADD:   r[inst.dst].u = r[inst.a].u + r[inst.b].u; break;
+      case OpCode::SUB:   r[inst.dst].u = r[inst.a].u - r[inst.b].u; break;
+      case OpCode::MUL:   r[inst.dst].u = r[inst.a].u * r[inst.b].u; break;
+
+      case OpCode::SDIV:
+        if (r[inst.b].i == 0 || (r[inst.a].i == INT64_MIN && r[inst.b].i == -1)) {
+          throw CodegenException("Division by zero or overflow");
+        }
+        r[inst.dst].i = r[inst.a].i / r[inst.b].i;
+        break;
+
+      case OpCode::UDIV:
+        if (r[inst.b].u == 0) {
+          throw CodegenException("Division by zero");
+        }
+        r[inst.dst].u = r[inst.a].u / r[inst.b].u;
+        break;
+
+      case OpCode::FADD:  r[inst.dst].f = r[inst.a].f + r[inst.b].f; break;
+      case OpCode::FSUB:  r[inst.dst].f = r[inst.a].f - r[inst.b].f; break;
+      case OpCode::FMUL:  r[inst.dst].f = r[inst.a].f * r[inst.b].f; break;
+      case OpCode::FDIV:  r[inst.dst].f = r[inst.a].f / r[inst.b].f; break;
+
+      // Registers hold normalized values, so 64 bit unsigned comparison orders them as in JIT'd code
+      case OpCode::EQ:    r[inst.dst].u = r[inst.a].u == r[inst.b].u; break;
+      case OpCode::NE:    r[inst.dst].u = r[inst.a].u != r[inst.b].u; break;
+      case OpCode::UGE:   r[inst.dst].u = r[inst.a].u >= r[inst.b].u; break;
+      case OpCode::UGT:   r[inst.dst].u = r[inst.a].u >  r[inst.b].u; break;
+      case OpCode::ULE:   r[inst.dst].u = r[inst.a].u <= r[inst.b].u; break;
+      case OpCode::ULT:   r[inst.dst].u = r[inst.a].u <  r[inst.b].u; break;
+
+      case OpCode::AND:   r[inst.dst].u = r[inst.a].u & r[inst.b].u; break;
+      case OpCode::OR:    r[inst.dst].u = r[inst.a].u | r[inst.b].u; break;
+
+      case OpCode::SEXT: {
+        int shift = 64 - (int) inst.imm;
+        r[inst.dst].i = shift > 0 ? (int64_t) (r[inst.a].u << shift) >> shift : r[inst.a].i;
+        break;
+      }
+
+      case OpCode::ZEXT: {
+        int shift = 64 - (int) inst.imm;
+        r[inst.dst].u = shift > 0 ? (r[inst.a].u << shift) >> shift : r[inst.a].u;
+        break;
+      }
+
+      case OpCode::ITOF:   r[inst.dst].f = (double) r[inst.a].i; break;
+      case OpCode::FTOI:   r[inst.dst].i = (int64_t) r[inst.a].f; break;
+      case OpCode::FTRUNC: r[inst.dst].f = (double) (float) r[inst.a].f; break;
+
+      case OpCode::LOAD: {
+        auto address = globals[inst.imm];
+
+        switch ((meta::TypeTag) inst.b) {
+          case meta::TypeTag::U8:  r[inst.dst].u = *(uint8_t *) address; break;
+          case meta::TypeTag::I8:  r[inst.dst].i = *(int8_t *) address; break;
+          case meta::TypeTag::U16: r[inst.dst].u = *(uint16_t *) address; break;
+          case meta::TypeTag::I16: r[inst.dst].i = *(int16_t *) address; break;
+          case meta::TypeTag::U32: r[inst.dst].u = *(uint32_t *) address; break;
+          case meta::TypeTag::I32: r[inst.dst].i = *(int32_t *) address; break;
+          case meta::TypeTag::U64: r[inst.dst].u = *(uint64_t *) address; break;
+          case meta::TypeTag::I64: r[inst.dst].i = *(int64_t *) address; break;
+          case meta::TypeTag::F32: r[inst.dst].f = *(float *) address; break;
+          case meta::TypeTag::F64: r[inst.dst].f = *(double *) address; break;
+          default:
+            throw CodegenException("Invalid global type in bytecode");
+        }
+        break;
+      }
+
+      case OpCode::CALL:
+        r[inst.dst] = call(chunk.calls[inst.imm], r);
+        break;
+
+      case OpCode::RET: {
+        if (!inst.imm) {
+          return util::GenericValueContainer();
+        }
+
+        auto& value = r[inst.a];
+
+        if (chunk.type->isFloat()) {
+          return util::GenericValueContainer::floating(value.f);
+        }
+
+        return chunk.type->isSigned()
+            ? util::GenericValueContainer::signedInt(value.i)
+            : util::GenericValueContainer::unsignedInt(value.u);
+      }
+    }
+  }
+
+  throw CodegenException("Bytecode chunk doesn't return");
+}
+
+void * Interpreter::resolve(const std::string& name) {
+  auto symbol = globalContext.getJIT().lookup(name);
+
+  if (!symbol) {
+    throw CodegenException(symbol.takeError());
+  }
+
+  return symbol->getAddress().toPtr<void *>();
+}
+
+template <size_t>
+using Int64 = int64_t;
+
+/**
+ * Calls function with integer arguments, passed as 64 bit values
+ *
+ * Arguments are normalized (sign/zero extended) to their types, so callee, which expects narrower integers,
+ * receives correct values in the lower bits of the same registers (x86-64 & AArch64 calling conventions)
+ */
+template <typename R, size_t ...I>
+static R invokeWith(void * address, const int64_t * args, std::index_sequence<I...>) {
+  return ((R (*)(Int64<I>...)) address)(args[I]...);
+}
+
+template <typename R>
+static R invoke(void * address, const std::vector<int64_t>& args) {
+  switch (args.size()) {
+    case 0: return invokeWith<R>(address, args.data(), std::make_index_sequence<0>());
+    case 1: return invokeWith<R>(address, args.data(), std::make_index_sequence<1>());
+    case 2: return invokeWith<R>(address, args.data(), std::make_index_sequence<2>());
+    case 3: return invokeWith<R>(address, args.data(), std::make_index_sequence<3>());
+    case 4: return invokeWith<R>(address, args.data(), std::make_index_sequence<4>());
+    case 5: return invokeWith<R>(address, args.data(), std::make_index_sequence<5>());
+    case 6: return invokeWith<R>(address, args.data(), std::make_index_sequence<6>());
+    default:
+      throw CodegenException(std::format("Too many arguments for bytecode call ({})", args.size()));
+  }
+}
+
+Interpreter::Value Interpreter::call(const CallSite& call, const std::vector<Value>& registers) {
+  auto address = resolve(call.function->name);
+
+  std::vector<int64_t> args;
+
+  for (auto reg : call.args) {
+    args.push_back(registers[reg].i);
+  }
+
+  Value result {};
+
+  switch (call.function->returnType->getTag()) {
+    case meta::TypeTag::U8:  result.u = invoke<uint8_t>(address, args); break;
+    case meta::TypeTag::I8:  result.i = invoke<int8_t>(address, args); break;
+    case meta::TypeTag::U16: result.u = invoke<uint16_t>(address, args); break;
+    case meta::TypeTag::I16: result.i = invoke<int16_t>(address, args); break;
+    case meta::TypeTag::U32: result.u = invoke<uint32_t>(address, args); break;
+    case meta::TypeTag::I32: result.i = invoke<int32_t>(address, args); break;
+    case meta::TypeTag::U64: result.u = invoke<uint64_t>(address, args); break;
+    case meta::TypeTag::I64: result.i = invoke<int64_t>(address, args); break;
+    case meta::TypeTag::F32: result.f = invoke<float>(address, args); break;
+    case meta::TypeTag::F64: result.f = invoke<double>(address, args); break;
+    default:
+      invoke<void>(address, args);
+      break;
+  }
+
+  return result;
+}
@@ -1,24 +1,105 @@
 #include "xcc/codegen.h"
+#include "xcc/bytecode.h"
+#include "xcc/prelude.h"
 #include "xcc/exceptions.h"
 #include "xcc/util/log.h"
 #include "xcc/util/llvm.h"
+#include "xcc/util/timer.h"
 #include "xcc/ast.h"
 
+#include <llvm/ADT/ScopeExit.h>
+
+#include <algorithm>
+#include <filesystem>
+
 using namespace xcc;
 using namespace xcc::codegen;
 
-constexpr char ANONYMOUS_EXPR_FN_NAME[] = "__anonymous__";
-
 static auto logger = xcc::util::log::Logger("CODEGEN");
 
-GlobalContext::GlobalContext() {
-  jit = JIT::create();
+/**
+ * Reports result of an evaluated expression/function
+ */
+static void reportResult([[maybe_unused]] const util::GenericValueContainer& result) {
+#if USE_PRINT_EXPR_RESULT
+  switch (result.tag) {
+    case util::GenericValueContainer::SIGNED_INTEGER:
+      logger.debug("Result: {}", result.value.signed_integer);
+      break;
+
+    case util::GenericValueContainer::UNSIGNED_INTEGER:
+      logger.debug("Result: {}", result.value.unsigned_integer);
+      break;
+
+    case util::GenericValueContainer::FLOATING:
+      logger.debug("Result: {}", result.value.floating);
+      break;
+
+    default:
+      break;
+  }
+#endif
+}
+
+GlobalContext::GlobalContext(Options options, std::shared_ptr<JITEngine> engine) : engine(std::move(engine)), options(std::move(options)) {
+  profiler = Profiler::create(this->options);
+  remarks = Remarks::create(this->options);
+  contexts = ContextPool::create();
 
   globalModule = ModuleContext::create(*this, "<global>");
+
+  util::Timer timer;
+
+  // Preludes are already in binary form, declarations are registered without lexing & parsing
+  for (auto& prelude : this->options.preludes) {
+    Prelude::load(prelude).declare(*this);
+  }
+
+  if (this->options.timings && !this->options.preludes.empty()) {
+    logger.info("Phase '{}' took {:.3f}ms", "prelude", timer.elapsedMs());
+  }
+}
+
+GlobalContext::~GlobalContext() {
+  // Profile is written while JIT (and counters in JIT'd memory) is still alive
+  if (jit && profiler && profiler->getMode() == Profiler::Mode::GENERATE) {
+    try {
+      profiler->write(*jit);
+    } catch (std::exception& e) {
+      logger.error("Failed to write profile: {}", e.what());
+    }
+  }
+
+  if (remarks) {
+    // ~JIT waits for tier up compilations, still running, so their (O3) remarks are reported as well
+    jit.reset();
+
+    try {
+      remarks->report();
+    } catch (std::exception& e) {
+      logger.error("Failed to write remarks: {}", e.what());
+    }
+  }
+}
+
+std::unique_ptr<GlobalContext> GlobalContext::create(Options options, std::shared_ptr<JITEngine> engine) {
+  return std::make_unique<GlobalContext>(std::move(options), std::move(engine));
+}
+
+JIT& GlobalContext::getJIT() {
+  std::call_once(jit_once, [this] {
+    jit = engine ? JIT::create(engine, options) : JIT::create(options);
+  });
+
+  return *jit;
+}
+
+bool GlobalContext::hasJIT() const {
+  return jit != nullptr;
 }
 
-std::unique_ptr<GlobalContext> GlobalContext::create() {
-  return std::make_unique<GlobalContext>();
+Remarks * GlobalContext::getRemarks() {
+  return remarks.get();
 }
 
 std::unique_ptr<ModuleContext> GlobalContext::createModule(const std::string& name) {
@@ -26,34 +107,102 @@ std::unique_ptr<ModuleContext> GlobalContext::createModule(const std::string& na
 }
 
 void GlobalContext::addModule(std::unique_ptr<ModuleContext>& module) {
-  CodegenException::throwIfError(jit->addModule(llvm::orc::ThreadSafeModule(std::move(module->llvm.module), std::move(module->llvm.ctx))));
+  if (profiler) {
+    profiler->apply(*module->llvm.module);
+  }
+
+  auto tsm = llvm::orc::ThreadSafeModule(std::move(module->llvm.module), module->llvm.tsctx);
+
+  if (options.tiered) {
+    CodegenException::throwIfError(getJIT().addTieredModule(std::move(tsm)));
+  } else if (options.hot_swap || options.jit_memory_limit) {
+    // Functions are called through stubs, so they can be evicted
+    CodegenException::throwIfError(getJIT().addReplaceableModule(std::move(tsm)));
+  } else {
+    CodegenException::throwIfError(getJIT().addModule(std::move(tsm)));
+  }
 }
 
 void GlobalContext::addFunction(const std::string& name, std::shared_ptr<meta::Function> fn) {
+  std::unique_lock lock(functions_mutex);
   functions[name] = std::move(fn);
 }
 
+void GlobalContext::removeFunction(const std::string& name) {
+  std::unique_lock lock(functions_mutex);
+  functions.erase(name);
+}
+
 std::shared_ptr<meta::Function> GlobalContext::getMetaFunction(const std::string& name) {
-  if (functions.find(name) != functions.end()) {
-    return functions[name];
+  std::shared_lock lock(functions_mutex);
+
+  if (auto it = functions.find(name); it != functions.end()) {
+    return it->second;
   }
 
   return nullptr;
 }
 
-void GlobalContext::setCurrentFunction(const std::string& name) {
-  current_function = name;
+std::vector<std::shared_ptr<meta::Function>> GlobalContext::getMetaFunctions() {
+  std::vector<std::shared_ptr<meta::Function>> result;
+
+  {
+    std::shared_lock lock(functions_mutex);
+    for (auto& [name, fn] : functions) {
+      result.push_back(fn);
+    }
+  }
+
+  std::sort(result.begin(), result.end(), [](auto& lhs, auto& rhs) {
+    return lhs->name < rhs->name;
+  });
+
+  return result;
 }
 
-void GlobalContext::clearCurrentFunction() {
-  current_function = "";
+void GlobalContext::addType(const std::string& name, std::shared_ptr<meta::Type> type) {
+  std::unique_lock lock(types_mutex);
+  types[name] = std::move(type);
+}
+
+std::shared_ptr<meta::Type> GlobalContext::getType(const std::string& name) {
+  if (auto type = meta::Type::fromTypeName(name)) {
+    return type;
+  }
+
+  std::shared_lock lock(types_mutex);
+
+  if (auto it = types.find(name); it != types.end()) {
+    return it->second;
+  }
+
+  throw CodegenException("Unknown type '" + name + "'");
 }
 
-std::shared_ptr<meta::Function> GlobalContext::getCurrentFunction() {
-  return current_function.empty() ? nullptr : functions[current_function];
+std::vector<std::shared_ptr<meta::Type>> GlobalContext::getTypes() {
+  std::vector<std::shared_ptr<meta::Type>> result;
+
+  {
+    std::shared_lock lock(types_mutex);
+    for (auto& [name, type] : types) {
+      result.push_back(type);
+    }
+  }
+
+  std::sort(result.begin(), result.end(), [](auto& lhs, auto& rhs) {
+    return lhs->getName() < rhs->getName();
+  });
+
+  return result;
+}
+
+void GlobalContext::addGlobal(const std::string& name, std::shared_ptr<meta::Type> type) {
+  std::unique_lock lock(globals_mutex);
+  globals[name] = std::move(type);
 }
 
 bool GlobalContext::hasGlobal(const std::string& name) {
+  std::shared_lock lock(globals_mutex);
   return globals.find(name) != globals.end();
 }
 
@@ -63,17 +212,73 @@ llvm::GlobalVariable * GlobalContext::getGlobal(ModuleContext& ctx, const std::s
 }
 
 std::shared_ptr<meta::Type> GlobalContext::getGlobalType(const std::string& name) {
-  if (!hasGlobal(name)) {
-    throw CodegenException("Unknown global variable '" + name + "'");
+  std::shared_lock lock(globals_mutex);
+
+  if (auto it = globals.find(name); it != globals.end()) {
+    return it->second;
+  }
+
+  throw CodegenException("Unknown global variable '" + name + "'");
+}
+
+bool GlobalContext::isGlobalCommitted(const std::string& name) {
+  std::shared_lock lock(globals_mutex);
+  return committed_globals.contains(name);
+}
+
+void GlobalContext::commitGlobals() {
+  std::lock_guard lock(global_module_mutex);
+
+  auto& module = *globalModule->llvm.module;
+
+  if (module.global_empty()) {
+    return;
+  }
+
+  {
+    std::unique_lock globals_lock(globals_mutex);
+
+    for (auto& global : module.globals()) {
+      if (!global.isDeclaration()) {
+        committed_globals.insert(global.getName().str());
+      }
+    }
   }
-  return globals[name];
+
+  auto tsm = llvm::orc::ThreadSafeModule(std::move(globalModule->llvm.module), globalModule->llvm.tsctx);
+
+  globalModule = ModuleContext::create(*this, "<global>");
+
+  CodegenException::throwIfError(getJIT().addModule(std::move(tsm)));
 }
 
 void GlobalContext::runExpr(std::shared_ptr<ast::Node> expr) {
-  if (!globalModule->llvm.ctx || !globalModule->llvm.module) {
-    globalModule = ModuleContext::create(*this, "<global>");
+  // Straight-line code runs once, so it's cheaper to interpret it, than to compile
+  if (options.interpreter) {
+    if (auto chunk = bytecode::Compiler::compile(*this, expr)) {
+      util::Timer timer;
+
+      auto result = bytecode::Interpreter(*this).run(*chunk);
+
+      if (options.timings) {
+        logger.info("Phase '{}' took {:.3f}ms", "interpret", timer.elapsedMs());
+      }
+
+      reportResult(result);
+      return;
+    }
   }
 
+  // Unique name - previous expression's symbol may still be referenced by ORC, and cached objects don't clash
+  auto name = std::format("{}${}", ANONYMOUS_EXPR_FN_NAME, expr_counter++);
+
+  auto remove_function = llvm::make_scope_exit([&]() {
+    removeFunction(name);
+  });
+
+  auto lease = contexts->acquire();
+  auto module = ModuleContext::create(*this, name, lease.ctx);
+
   std::shared_ptr<ast::Block> body;
 
   if (expr->is(ast::AST_BLOCK)) {
@@ -88,7 +293,7 @@ void GlobalContext::runExpr(std::shared_ptr<ast::Node> expr) {
     });
   }
 
-  auto type = expr->generateType(*globalModule, {});
+  auto type = expr->generateType(*module, {});
 
   if (!type) {
     logger.warn("Warning: Can't infer {} return type, resorting to i32", ANONYMOUS_EXPR_FN_NAME);
@@ -96,79 +301,113 @@ void GlobalContext::runExpr(std::shared_ptr<ast::Node> expr) {
   }
 
   auto fndecl = ast::FnDecl::create(
-      ast::Identifier::create(ANONYMOUS_EXPR_FN_NAME),
+      ast::Identifier::create(name),
       ast::Type::create(ast::Identifier::create(type->toString())) // TODO: Fix
   );
 
   auto fndef = ast::FnDef::create(fndecl, body);
 
-  auto fn = fndef->generateFunction(*globalModule, {});
+  auto fn = fndef->generateFunction(*module, {});
 
 #if USE_PRINT_LLVM_IR
   util::RawStreamCollector collector;
   fn->print(*collector.stream());
-  for (auto &global : globalModule->llvm.module->globals()) {
-    global.print(*collector.stream());
-    *collector.stream() << "\n";
-  }
   logger.debug("IR:\n{}", collector.string());
 #endif
 
-  return runFunction(ANONYMOUS_EXPR_FN_NAME);
-}
+  // Strings used by expression are interned into globalModule
+  commitGlobals();
 
-void GlobalContext::runFunction(const std::string& name) {
-  auto fn = getMetaFunction(name);
+  auto rt = getJIT().getMainJitDylib().createResourceTracker();
+  auto tsm = llvm::orc::ThreadSafeModule(std::move(module->llvm.module), module->llvm.tsctx);
 
-  assertThrow(fn.get(), CodegenException(std::format("Can't find meta-function '{}'", name)));
+  CodegenException::throwIfError(getJIT().addModule(std::move(tsm), rt));
 
-  auto type = getMetaFunction(name)->returnType;
+  auto remove_module = llvm::make_scope_exit([&]() {
+    // Expression's object isn't needed after the call (snapshots skip expressions), so it isn't kept for the session
+    getJIT().forgetRecordedObjects(name);
 
-  auto rt = jit->getMainJitDylib().createResourceTracker();
-  auto tsm = llvm::orc::ThreadSafeModule(std::move(globalModule->llvm.module), std::move(globalModule->llvm.ctx));
+    if (auto err = rt->remove()) {
+      logger.error("Failed to remove expression '{}': {}", name, llvm::toString(std::move(err)));
+      return;
+    }
 
-  CodegenException::throwIfError(jit->addModule(std::move(tsm), rt));
+    // Module is compiled (or discarded) by now, so its context can be reused
+    contexts->release(std::move(lease));
+  });
 
 #if USE_DUMP_JIT
-  jit->dump();
+  getJIT().dump();
 #endif
 
-  auto symbol = jit->lookup(name);
+  callFunction(name);
+}
 
-  assertThrow(bool(symbol), CodegenException(std::format("Can't find symbol '{}'", name)));
+void GlobalContext::runFunction(const std::string& name) {
+  commitGlobals();
 
-  auto result = util::call(type, symbol.get());
+#if USE_DUMP_JIT
+  getJIT().dump();
+#endif
 
-#if USE_PRINT_EXPR_RESULT
-  switch (result.tag) {
-    case util::GenericValueContainer::SIGNED_INTEGER:
-      logger.debug("Result: {}", result.value.signed_integer);
-      break;
+  callFunction(name);
+}
 
-    case util::GenericValueContainer::UNSIGNED_INTEGER:
-      logger.debug("Result: {}", result.value.unsigned_integer);
-      break;
+void GlobalContext::callFunction(const std::string& name) {
+  auto fn = getMetaFunction(name);
 
-    case util::GenericValueContainer::FLOATING:
-      logger.debug("Result: {}", result.value.floating);
-      break;
+  assertThrow(fn.get(), CodegenException(std::format("Can't find meta-function '{}'", name)));
 
-    default:
-      break;
+  auto type = fn->returnType;
+
+  util::Timer timer;
+
+  // Lookup triggers materialization (compilation & linking) of everything reachable from `name`
+  auto symbol = getJIT().lookup(name);
+
+  if (options.timings) {
+    logger.info("Phase '{}' took {:.3f}ms", "materialize", timer.elapsedMs());
+  }
+
+  // In hot swap mode lookup also fails, if a redefined function doesn't link
+  if (!symbol) {
+    throw CodegenException(std::format("Can't find symbol '{}': {}", name, llvm::toString(symbol.takeError())));
   }
-#endif
 
-  CodegenException::throwIfError(rt->remove());
+  JIT::CallScope scope(getJIT());
+
+  // Function can't be called directly in executor process, it's called as main, result is an exit code
+  if (getJIT().isRemote()) {
+    auto result = getJIT().runAsMain(symbol->getAddress());
+
+    if (!result) {
+      throw CodegenException(std::format("Can't run '{}' in executor: {}", name, llvm::toString(result.takeError())));
+    }
+
+    reportResult(type->isVoid() ? util::GenericValueContainer() : util::GenericValueContainer::signedInt(*result));
+    return;
+  }
+
+  reportResult(util::call(type, symbol.get()));
 }
 
-ModuleContext::ModuleContext(GlobalContext& global, const std::string& name) : globalContext(global) {
-  llvm.ctx = std::make_unique<llvm::LLVMContext>();
+ModuleContext::ModuleContext(GlobalContext& global, const std::string& name, llvm::orc::ThreadSafeContext tsctx) : globalContext(global) {
+  llvm.tsctx = tsctx.getContext() ? std::move(tsctx) : llvm::orc::ThreadSafeContext(std::make_unique<llvm::LLVMContext>());
+  llvm.ctx = llvm.tsctx.getContext();
   llvm.module = std::make_unique<llvm::Module>(name, *llvm.ctx);
 
-  llvm.module->setDataLayout(global.jit->getDataLayout());
+  // Modules, that are never compiled by JIT, don't need its data layout (AOT sets its own on link)
+  if (global.options.isExecuting()) {
+    llvm.module->setDataLayout(global.getJIT().getDataLayout());
+  }
 
   ir_builder = std::make_unique<llvm::IRBuilder<>>(*llvm.ctx);
 
+  // Remarks of every pass, run on this context (optimization, tier up, codegen)
+  if (auto remarks = global.getRemarks()) {
+    remarks->install(*llvm.ctx);
+  }
+
 #if USE_OPTIMIZATION
   opt.fpm = std::make_unique<llvm::FunctionPassManager>();
   opt.lam = std::make_unique<llvm::LoopAnalysisManager>();
@@ -193,8 +432,8 @@ ModuleContext::ModuleContext(GlobalContext& global, const std::string& name) : g
 #endif
 }
 
-std::unique_ptr<ModuleContext> ModuleContext::create(GlobalContext& global, const std::string& name) {
-  return std::make_unique<ModuleContext>(global, name);
+std::unique_ptr<ModuleContext> ModuleContext::create(GlobalContext& global, const std::string& name, llvm::orc::ThreadSafeContext tsctx) {
+  return std::make_unique<ModuleContext>(global, name, std::move(tsctx));
 }
 
 llvm::Function * ModuleContext::getFunction(const std::string& name) {
@@ -202,13 +441,84 @@ llvm::Function * ModuleContext::getFunction(const std::string& name) {
     return fn;
   }
 
-  if (globalContext.functions.find(name) != globalContext.functions.end()) {
-    return globalContext.functions[name]->decl->generateFunction(*this, {});
+  if (auto fn = globalContext.getMetaFunction(name)) {
+    return fn->decl->generateFunction(*this, {});
   }
 
   return nullptr;
 }
 
+ModuleContext& ModuleContext::getDataModule() {
+  return data_module ? *data_module : *globalContext.globalModule;
+}
+
+void ModuleContext::beginDebugFunction(llvm::Function * fn, size_t line) {
+  auto& options = globalContext.options;
+
+  // Remarks need locations only, no DWARF is emitted for them
+  if (!options.debug_info && options.remarks.empty()) {
+    return;
+  }
+
+  if (!debug.builder) {
+    std::string path = data_module && !data_module->source_file.empty() ? data_module->source_file : options.input;
+
+    if (path.empty()) {
+      path = REPL_SOURCE_FILE;
+    }
+
+    debug.builder = std::make_unique<llvm::DIBuilder>(*llvm.module);
+
+    auto file = debug.builder->createFile(path, std::filesystem::current_path().string());
+    auto kind = options.debug_info ? llvm::DICompileUnit::LineTablesOnly : llvm::DICompileUnit::NoDebug;
+    debug.unit = debug.builder->createCompileUnit(llvm::dwarf::DW_LANG_C, file, "xcc", false, "", 0, "", kind);
+
+    llvm.module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    llvm.module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+  }
+
+  auto type = debug.builder->createSubroutineType(debug.builder->getOrCreateTypeArray({}));
+
+  debug.scope = debug.builder->createFunction(
+    debug.unit->getFile(), fn->getName(), fn->getName(), debug.unit->getFile(), line, type, line,
+    llvm::DINode::FlagPrototyped, llvm::DISubprogram::SPFlagDefinition);
+
+  fn->setSubprogram(debug.scope);
+
+  setDebugLocation(line);
+}
+
+void ModuleContext::setDebugLocation(size_t line) {
+  if (debug.scope && line) {
+    ir_builder->SetCurrentDebugLocation(llvm::DILocation::get(*llvm.ctx, line, 0, debug.scope));
+  }
+}
+
+void ModuleContext::endDebugFunction() {
+  if (!debug.scope) {
+    return;
+  }
+
+  // Module may be added to JIT right after its function, so debug info is finalized per function
+  debug.builder->finalize();
+  debug.scope = nullptr;
+
+  // Code, generated outside of functions (e.g. globals), has no location
+  ir_builder->SetCurrentDebugLocation(llvm::DebugLoc());
+}
+
+void ModuleContext::setCurrentFunction(const std::string& name) {
+  current_function = name;
+}
+
+void ModuleContext::clearCurrentFunction() {
+  current_function = "";
+}
+
+std::shared_ptr<meta::Function> ModuleContext::getCurrentFunction() {
+  return current_function.empty() ? nullptr : globalContext.getMetaFunction(current_function);
+}
+
 bool ModuleContext::hasLocal(const std::string& name) {
   return locals.find(name) != locals.end();
 }
@@ -0,0 +1,34 @@
+#include "xcc/context_pool.h"
+
+using namespace xcc::codegen;
+
+ContextPool::ContextPool(size_t max_uses, size_t max_available) : max_uses(max_uses), max_available(max_available) {}
+
+std::unique_ptr<ContextPool> ContextPool::create(size_t max_uses, size_t max_available) {
+  return std::make_unique<ContextPool>(max_uses, max_available);
+}
+
+ContextPool::Lease ContextPool::acquire() {
+  std::lock_guard lock(mutex);
+
+  if (available.empty()) {
+    return {llvm::orc::ThreadSafeContext(std::make_unique<llvm::LLVMContext>()), 1};
+  }
+
+  auto lease = std::move(available.back());
+  available.pop_back();
+
+  ++lease.uses;
+
+  return lease;
+}
+
+void ContextPool::release(Lease lease) {
+  std::lock_guard lock(mutex);
+
+  if (lease.uses >= max_uses || available.size() >= max_available) {
+    return;
+  }
+
+  available.push_back(std::move(lease));
+}
@@ -0,0 +1,58 @@
+#include "xcc/declarations.h"
+#include "xcc/ast/fndecl.h"
+#include "xcc/codegen.h"
+
+using namespace xcc;
+
+std::string xcc::codegen::typeName(const std::shared_ptr<meta::Type>& type) {
+  if (type->isPointer()) {
+    return typeName(type->getPointedType()) + "*";
+  }
+
+  return type->getName();
+}
+
+std::shared_ptr<meta::Type> xcc::codegen::typeFromName(GlobalContext& globalContext, llvm::StringRef name) {
+  if (name.ends_with("*")) {
+    return meta::Type::createPointer(typeFromName(globalContext, name.drop_back()));
+  }
+
+  return globalContext.getType(name.str());
+}
+
+void xcc::codegen::declareStruct(std::string& out, const std::shared_ptr<meta::Type>& type, std::unordered_set<std::string>& declared) {
+  if (!declared.insert(type->getName()).second) {
+    return;
+  }
+
+  for (auto& [name, member] : type->getMembers()) {
+    if (auto base = member->getBaseType(); base->isStruct()) {
+      declareStruct(out, base, declared);
+    }
+  }
+
+  out += "struct " + type->getName() + " {\n";
+
+  for (auto& [name, member] : type->getMembers()) {
+    out += "  " + name + ": " + typeName(member) + ";\n";
+  }
+
+  out += "}\n";
+}
+
+void xcc::codegen::declareFunction(std::string& out, const meta::Function& fn) {
+  out += "extern fn " + fn.name + "(";
+
+  for (auto& arg : fn.args) {
+    if (arg != fn.args.front()) {
+      out += ", ";
+    }
+    out += arg + ": " + typeName(fn.args[arg]);
+  }
+
+  if (fn.decl && fn.decl->isVariadic) {
+    out += fn.args.empty() ? "..." : ", ...";
+  }
+
+  out += "): " + typeName(fn.returnType) + ";\n";
+}
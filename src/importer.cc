@@ -0,0 +1,558 @@
+#include "xcc/importer.h"
+#include "xcc/ast.h"
+#include "xcc/declarations.h"
+#include "xcc/xcc.h"
+#include "xcc/util/parallel.h"
+#include "xcc/util/serialize.h"
+#include "xcc/util/timer.h"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <set>
+#include <unordered_set>
+
+using namespace xcc;
+
+static auto logger = xcc::util::log::Logger("IMPORT");
+
+/* Artifact starts with magic (including terminating zero) & version */
+constexpr char ARTIFACT_MAGIC[] = "XCCUNIT";
+constexpr uint32_t ARTIFACT_VERSION = 1;
+
+constexpr char ARTIFACT_EXTENSION[] = ".xcu";
+constexpr char ARTIFACT_DIRECTORY[] = "units";
+
+/**
+ * Interface & compiled code of a unit, stored in cache directory
+ */
+struct Artifact {
+  std::string salt;
+  uint64_t source_hash = 0;
+
+  /* Canonical paths of imported units, so graph of cached units is known without parsing them */
+  std::vector<std::string> imports;
+
+  /* Interface hashes of (transitively) imported units, unit was compiled against */
+  std::vector<std::pair<std::string, uint64_t>> dependencies;
+
+  /* Struct types & function declarations source */
+  std::string interface;
+
+  /* (name, type name) pairs of defined globals */
+  std::vector<std::pair<std::string, std::string>> globals;
+
+  /* (module, object) pairs */
+  std::vector<std::pair<std::string, std::string>> objects;
+};
+
+struct Importer::Unit {
+  std::string path;
+  std::string source;
+  uint64_t source_hash = 0;
+
+  std::vector<std::string> imports;
+
+  /* Up to date artifact, if it was found in cache */
+  std::optional<Artifact> artifact;
+
+  /* Parsed source, nullptr if unit wasn't parsed (e.g. it is loaded from artifact) */
+  std::shared_ptr<ast::Block> tree;
+
+  /* Everything, that goes into artifact */
+  std::vector<std::pair<std::string, uint64_t>> dependencies;
+  std::string interface;
+  std::vector<std::pair<std::string, std::string>> globals;
+  std::vector<std::pair<std::string, std::string>> objects;
+  uint64_t interface_hash = 0;
+
+  bool rebuilt = false;
+
+  /* Globals & strings of unit (module name is used as unit's name in JIT) */
+  std::unique_ptr<codegen::ModuleContext> data;
+  std::vector<std::unique_ptr<codegen::ModuleContext>> modules;
+};
+
+static uint64_t hashString(llvm::StringRef str) {
+  return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(str));
+}
+
+static uint64_t hashInterface(const std::string& interface, const std::vector<std::pair<std::string, std::string>>& globals) {
+  auto buffer = interface;
+
+  for (auto& [name, type] : globals) {
+    buffer += std::format(";{}:{}", name, type);
+  }
+
+  return hashString(buffer);
+}
+
+/**
+ * Resolves imported path relative to directory of importing file
+ */
+static std::string resolvePath(const std::string& importer, const std::string& path) {
+  std::filesystem::path result(path);
+
+  if (result.is_relative()) {
+    auto base = importer.empty() ? std::filesystem::current_path() : std::filesystem::absolute(importer).parent_path();
+    result = base / result;
+  }
+
+  return std::filesystem::weakly_canonical(result).string();
+}
+
+static std::optional<Artifact> readArtifact(const std::string& path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+
+  if (!buffer) {
+    return std::nullopt;
+  }
+
+  util::BinaryReader reader((*buffer)->getBuffer(), ARTIFACT_MAGIC);
+
+  if (reader.getVersion() != ARTIFACT_VERSION) {
+    return std::nullopt;
+  }
+
+  Artifact artifact;
+  artifact.salt = reader.readString();
+  artifact.source_hash = reader.read<uint64_t>();
+
+  auto imports = reader.read<uint32_t>();
+
+  for (uint32_t i = 0; i < imports && reader; ++i) {
+    artifact.imports.push_back(reader.readString());
+  }
+
+  auto dependencies = reader.read<uint32_t>();
+
+  for (uint32_t i = 0; i < dependencies && reader; ++i) {
+    auto dependency = reader.readString();
+    artifact.dependencies.emplace_back(std::move(dependency), reader.read<uint64_t>());
+  }
+
+  artifact.interface = reader.readString();
+  artifact.globals = reader.readPairs();
+  artifact.objects = reader.readPairs();
+
+  // Malformed artifact is treated as missing, unit is just rebuilt
+  if (auto err = reader.takeError()) {
+    logger.warn("Malformed unit artifact '{}': {}", path, llvm::toString(std::move(err)));
+    return std::nullopt;
+  }
+
+  return artifact;
+}
+
+static void writeArtifact(const std::string& path, const Artifact& artifact) {
+  // Written into unique temporary file & renamed, so concurrent builds never see partially written artifact
+  int fd;
+  llvm::SmallString<128> tmp_path;
+  llvm::SmallString<128> tmp_model(llvm::sys::path::parent_path(path));
+  llvm::sys::path::append(tmp_model, "%%%%%%%%%%%%.tmp");
+
+  if (auto ec = llvm::sys::fs::createUniqueFile(tmp_model, fd, tmp_path)) {
+    logger.warn("Can't create temporary file for '{}': {}", path, ec.message());
+    return;
+  }
+
+  {
+    llvm::raw_fd_ostream out(fd, true);
+    util::BinaryWriter writer(out, ARTIFACT_MAGIC, ARTIFACT_VERSION);
+
+    writer.writeString(artifact.salt);
+    writer.write<uint64_t>(artifact.source_hash);
+
+    writer.write<uint32_t>(artifact.imports.size());
+
+    for (auto& import : artifact.imports) {
+      writer.writeString(import);
+    }
+
+    writer.write<uint32_t>(artifact.dependencies.size());
+
+    for (auto& [dependency, hash] : artifact.dependencies) {
+      writer.writeString(dependency);
+      writer.write<uint64_t>(hash);
+    }
+
+    writer.writeString(artifact.interface);
+    writer.writePairs(artifact.globals);
+    writer.writePairs(artifact.objects);
+  }
+
+  if (auto ec = llvm::sys::fs::rename(tmp_path, path)) {
+    logger.warn("Can't store unit artifact '{}': {}", path, ec.message());
+    llvm::sys::fs::remove(tmp_path);
+  }
+}
+
+Importer::Importer(std::unique_ptr<codegen::GlobalContext>& globalContext) : globalContext(globalContext) {
+  // Artifacts are only used, when code is run in JIT, otherwise JIT isn't even created
+  if (!globalContext->options.isExecuting()) {
+    return;
+  }
+
+  auto& jit = globalContext->getJIT();
+
+  salt = std::format(
+    "xcc={};triple={};cpu={};features={};tiered={};debug-info={};ir-opt={}",
+    getVersion(),
+    jit.getTargetTriple(),
+    jit.getTargetCPU(),
+    globalContext->options.target_features,
+    globalContext->options.tiered,
+    globalContext->options.debug_info,
+    USE_OPTIMIZATION
+  );
+}
+
+Importer::~Importer() = default;
+
+std::unique_ptr<Importer> Importer::create(std::unique_ptr<codegen::GlobalContext>& globalContext) {
+  return std::make_unique<Importer>(globalContext);
+}
+
+void Importer::import(const std::string& importer, const std::vector<std::string>& paths) {
+  auto& options = globalContext->options;
+  bool aot = !options.isExecuting();
+
+  util::Timer timer;
+
+  std::vector<std::string> roots;
+
+  for (auto& path : paths) {
+    roots.push_back(resolvePath(importer, path));
+  }
+
+  // Discovery - every wave loads units, first imported by previous wave
+  std::vector<std::string> pending = roots;
+
+  while (!pending.empty()) {
+    std::vector<Unit *> wave;
+
+    for (auto& path : pending) {
+      if (units.contains(path) || globalContext->imported_units.contains(path)) {
+        continue;
+      }
+
+      auto unit = std::make_unique<Unit>();
+      unit->path = path;
+
+      wave.push_back(unit.get());
+      units[path] = std::move(unit);
+    }
+
+    util::parallelFor(wave.size(), options.jobs, [&](size_t idx) {
+      load(*wave[idx]);
+    });
+
+    pending.clear();
+
+    for (auto unit : wave) {
+      pending.insert(pending.end(), unit->imports.begin(), unit->imports.end());
+    }
+  }
+
+  std::vector<std::string> stack;
+
+  for (auto& path : roots) {
+    if (auto it = units.find(path); it != units.end()) {
+      sort(*it->second, stack);
+    }
+  }
+
+  // Declaration phase, in dependency order - interface of a unit is known before its importers are checked
+  std::unordered_map<std::string, std::set<std::string>> dependencies;
+  std::vector<std::shared_ptr<ast::Node>> fn_nodes;
+  std::vector<codegen::ModuleContext *> data_modules;
+  std::vector<Unit *> fn_units;
+
+  for (auto unit : order) {
+    auto& deps = dependencies[unit->path];
+
+    for (auto& import : unit->imports) {
+      deps.insert(import);
+      deps.insert(dependencies[import].begin(), dependencies[import].end());
+    }
+
+    for (auto& dep : deps) {
+      auto it = units.find(dep);
+      auto hash = it != units.end() ? it->second->interface_hash : globalContext->imported_units[dep];
+      unit->dependencies.emplace_back(dep, hash);
+    }
+
+    if (unit->artifact && unit->artifact->dependencies == unit->dependencies) {
+      declare(*unit);
+      continue;
+    }
+
+    // Source or interface of an imported unit changed, so unit has to be lowered from source
+    if (!unit->tree) {
+      unit->tree = Parser(Lexer(unit->source).tokenize()).parse(false);
+    }
+
+    unit->rebuilt = true;
+
+    size_t first = fn_nodes.size();
+    declareFromSource(*unit, fn_nodes);
+
+    for (size_t i = first; i < fn_nodes.size(); ++i) {
+      data_modules.push_back(unit->data.get());
+      fn_units.push_back(unit);
+    }
+  }
+
+  auto modules = lowerFunctions(globalContext, fn_nodes, data_modules);
+
+  for (size_t i = 0; i < modules.size(); ++i) {
+    auto unit = fn_units[i];
+    modules[i]->llvm.module->setModuleIdentifier(std::format("{}.{}", unit->data->llvm.module->getModuleIdentifier(), unit->modules.size()));
+    unit->modules.push_back(std::move(modules[i]));
+  }
+
+  size_t rebuilt = std::count_if(order.begin(), order.end(), [](auto unit) { return unit->rebuilt; });
+
+  if (aot) {
+    logger.debug("Lowered {} units", rebuilt);
+    return;
+  }
+
+  // Objects of all rebuilt units are compiled concurrently
+  std::vector<std::pair<Unit *, codegen::ModuleContext *>> compile;
+
+  for (auto unit : order) {
+    if (!unit->rebuilt) {
+      continue;
+    }
+
+    compile.emplace_back(unit, unit->data.get());
+
+    for (auto& module : unit->modules) {
+      compile.emplace_back(unit, module.get());
+    }
+  }
+
+  std::vector<std::string> objects(compile.size());
+
+  util::parallelFor(compile.size(), options.jobs, [&](size_t idx) {
+    auto& module = *compile[idx].second->llvm.module;
+    auto object = globalContext->getJIT().compileObject(module);
+
+    if (!object) {
+      throw CodegenException(std::format("Can't compile '{}': {}", compile[idx].first->path, llvm::toString(object.takeError())));
+    }
+
+    objects[idx] = (*object)->getBuffer().str();
+  });
+
+  for (size_t i = 0; i < compile.size(); ++i) {
+    compile[i].first->objects.emplace_back(compile[i].second->llvm.module->getModuleIdentifier(), std::move(objects[i]));
+  }
+
+  if (isCacheEnabled()) {
+    auto directory = std::filesystem::path(options.cache_dir) / ARTIFACT_DIRECTORY;
+
+    if (auto ec = llvm::sys::fs::create_directories(directory.string())) {
+      logger.warn("Can't create unit cache directory '{}': {}", directory.string(), ec.message());
+    } else {
+      for (auto unit : order) {
+        if (unit->rebuilt) {
+          writeArtifact(getArtifactPath(*unit), {salt, unit->source_hash, unit->imports, unit->dependencies, unit->interface, unit->globals, unit->objects});
+        }
+      }
+    }
+  }
+
+  for (auto unit : order) {
+    for (auto& [module, object] : unit->objects) {
+      CodegenException::throwIfError(globalContext->getJIT().addObject(module, llvm::MemoryBuffer::getMemBufferCopy(object, module)));
+    }
+
+    {
+      std::unique_lock lock(globalContext->globals_mutex);
+
+      for (auto& [name, type] : unit->globals) {
+        globalContext->committed_globals.insert(name);
+      }
+    }
+
+    globalContext->imported_units[unit->path] = unit->interface_hash;
+  }
+
+  logger.debug("Imported {} units ({} rebuilt) in {:.3f}ms", order.size(), rebuilt, timer.elapsedMs());
+}
+
+std::vector<const llvm::Module *> Importer::getModules() const {
+  std::vector<const llvm::Module *> result;
+
+  for (auto unit : order) {
+    if (unit->data) {
+      result.push_back(unit->data->llvm.module.get());
+    }
+
+    for (auto& module : unit->modules) {
+      result.push_back(module->llvm.module.get());
+    }
+  }
+
+  return result;
+}
+
+void Importer::load(Unit& unit) {
+  auto buffer = llvm::MemoryBuffer::getFile(unit.path);
+
+  if (!buffer) {
+    throw CodegenException(std::format("Can't open imported file '{}': {}", unit.path, buffer.getError().message()));
+  }
+
+  unit.source = (*buffer)->getBuffer().str();
+  unit.source_hash = hashString(unit.source);
+
+  if (isCacheEnabled()) {
+    auto artifact = readArtifact(getArtifactPath(unit));
+
+    if (artifact && artifact->salt == salt && artifact->source_hash == unit.source_hash) {
+      unit.imports = artifact->imports;
+      unit.artifact = std::move(artifact);
+      return;
+    }
+  }
+
+  unit.tree = Parser(Lexer(unit.source).tokenize()).parse(false);
+
+  for (auto& node : unit.tree->body) {
+    if (node->is(ast::AST_IMPORT)) {
+      unit.imports.push_back(resolvePath(unit.path, node->as<ast::Import>()->path));
+    }
+  }
+}
+
+void Importer::sort(Unit& unit, std::vector<std::string>& stack) {
+  if (std::find(order.begin(), order.end(), &unit) != order.end()) {
+    return;
+  }
+
+  if (auto it = std::find(stack.begin(), stack.end(), unit.path); it != stack.end()) {
+    std::string cycle;
+
+    for (; it != stack.end(); ++it) {
+      cycle += *it + " -> ";
+    }
+
+    throw CodegenException("Import cycle: " + cycle + unit.path);
+  }
+
+  stack.push_back(unit.path);
+
+  for (auto& import : unit.imports) {
+    if (auto it = units.find(import); it != units.end()) {
+      sort(*it->second, stack);
+    }
+  }
+
+  stack.pop_back();
+
+  order.push_back(&unit);
+}
+
+void Importer::declare(Unit& unit) {
+  auto& artifact = *unit.artifact;
+
+  auto tree = Parser(Lexer(artifact.interface).tokenize()).parse(false);
+
+  for (auto& node : tree->body) {
+    if (node->is(ast::AST_STRUCT)) {
+      node->generateType(*globalContext->globalModule, {});
+    } else if (node->is(ast::AST_FUNCTION_DECL)) {
+      auto decl = ast::Node::cast<ast::FnDecl>(node);
+      globalContext->addFunction(decl->name->value, decl->generateMetaFunction(*globalContext->globalModule));
+    }
+  }
+
+  for (auto& [name, type] : artifact.globals) {
+    globalContext->addGlobal(name, codegen::typeFromName(*globalContext, type));
+  }
+
+  unit.interface = artifact.interface;
+  unit.globals = artifact.globals;
+  unit.objects = artifact.objects;
+  unit.interface_hash = hashInterface(unit.interface, unit.globals);
+}
+
+void Importer::declareFromSource(Unit& unit, std::vector<std::shared_ptr<ast::Node>>& fn_nodes) {
+  // Unit's globals & strings are defined in its own data module, named after unit's path
+  unit.data = globalContext->createModule(std::format("unit.{:016x}", hashString(unit.path)));
+  unit.data->data_module = unit.data.get();
+  unit.data->source_file = unit.path;
+
+  std::vector<std::shared_ptr<meta::Type>> structs;
+  std::vector<std::shared_ptr<ast::Node>> own_fn_nodes;
+  std::vector<std::string> globals;
+
+  for (auto& node : unit.tree->body) {
+    if (node->is(ast::AST_IMPORT)) {
+      continue;
+    } else if (node->isAnyOf(ast::AST_FUNCTION_DEF, ast::AST_FUNCTION_DECL)) {
+      own_fn_nodes.push_back(node);
+    } else if (node->is(ast::AST_VAR_DECL)) {
+      node->generateValue(*unit.data, {});
+      globals.push_back(node->as<ast::VarDecl>()->name->value);
+    } else if (node->is(ast::AST_STRUCT)) {
+      structs.push_back(node->generateType(*unit.data, {}));
+      for (auto& method : node->as<ast::Struct>()->methods) {
+        own_fn_nodes.push_back(method);
+      }
+    } else {
+      throw CodegenException(std::format("Unexpected node at top-level scope of '{}': {}", unit.path, ast::Node::typeToString(node->type)));
+    }
+  }
+
+  // Interface - own structs (types of other units are declared by their own interfaces) & signatures
+  std::unordered_set<std::string> declared;
+
+  for (auto& type : globalContext->getTypes()) {
+    if (std::find(structs.begin(), structs.end(), type) == structs.end()) {
+      declared.insert(type->getName());
+    }
+  }
+
+  for (auto& type : structs) {
+    codegen::declareStruct(unit.interface, type, declared);
+  }
+
+  for (auto& node : own_fn_nodes) {
+    auto decl = node->is(ast::AST_FUNCTION_DEF)
+        ? node->as<ast::FnDef>()->decl
+        : ast::Node::cast<ast::FnDecl>(node);
+
+    auto fn = decl->generateMetaFunction(*globalContext->globalModule);
+    globalContext->addFunction(decl->name->value, fn);
+    codegen::declareFunction(unit.interface, *fn);
+  }
+
+  for (auto& name : globals) {
+    unit.globals.emplace_back(name, codegen::typeName(globalContext->getGlobalType(name)));
+  }
+
+  unit.interface_hash = hashInterface(unit.interface, unit.globals);
+
+  fn_nodes.insert(fn_nodes.end(), own_fn_nodes.begin(), own_fn_nodes.end());
+}
+
+std::string Importer::getArtifactPath(const Unit& unit) const {
+  auto name = std::format("{:016x}{}", hashString(unit.path), ARTIFACT_EXTENSION);
+  return (std::filesystem::path(globalContext->options.cache_dir) / ARTIFACT_DIRECTORY / name).string();
+}
+
+bool Importer::isCacheEnabled() const {
+  return !globalContext->options.cache_dir.empty() && globalContext->options.isExecuting();
+}
@@ -1,89 +1,699 @@
 #include "xcc/jit.h"
+#include "xcc/symbols.h"
 #include "xcc/util/log.h"
 #include "xcc/util/llvm.h"
 #include "xcc/exceptions.h"
+#include "xcc/util/timer.h"
+#include "xcc/jit_memory.h"
+#include "xcc/perf_map.h"
 
+#include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/ExecutionEngine/Orc/AbsoluteSymbols.h>
+#include <llvm/ExecutionEngine/Orc/Debugging/DebugObjectManagerPlugin.h>
+#include <llvm/ExecutionEngine/Orc/Debugging/PerfSupportPlugin.h>
+#include <llvm/ExecutionEngine/Orc/EPCDebugObjectRegistrar.h>
+#include <llvm/ExecutionEngine/Orc/EPCDynamicLibrarySearchGenerator.h>
+#include <llvm/ExecutionEngine/Orc/MapperJITLinkMemoryManager.h>
+#include <llvm/ExecutionEngine/Orc/MemoryMapper.h>
+#include <llvm/ExecutionEngine/Orc/OrcABISupport.h>
+#include <llvm/ExecutionEngine/Orc/Shared/SimpleRemoteEPCUtils.h>
+#include <llvm/ExecutionEngine/Orc/SimpleRemoteEPC.h>
+#include <llvm/ExecutionEngine/Orc/TargetProcess/JITLoaderGDB.h>
+#include <llvm/ExecutionEngine/Orc/TargetProcess/JITLoaderPerf.h>
+#include <llvm/ExecutionEngine/Orc/TaskDispatch.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* EH frame registration plugin got its own header (and factory) in newer LLVM versions */
+#if __has_include(<llvm/ExecutionEngine/Orc/EHFrameRegistrationPlugin.h>)
+#include <llvm/ExecutionEngine/Orc/EHFrameRegistrationPlugin.h>
+#define XCC_EH_FRAME_PLUGIN_FACTORY 1
+#else
+#include <llvm/ExecutionEngine/Orc/EPCEHFrameRegistrar.h>
+#define XCC_EH_FRAME_PLUGIN_FACTORY 0
+#endif
+
+#ifndef XCC_EXECUTOR
+#define XCC_EXECUTOR "xcc-executor"
+#endif
 
 using namespace xcc::codegen;
 
+/* Baseline code calls TIER_UP_SYMBOL(&TIER_CONTEXT_SYMBOL, id), address of context symbol is the JIT itself */
+constexpr char TIER_UP_SYMBOL[] = "__xcc_tier_up";
+constexpr char TIER_CONTEXT_SYMBOL[] = "__xcc_tier_context";
+
+constexpr char TIER_BASELINE_SUFFIX[] = "$tier0";
+constexpr char TIER_OPTIMIZED_SUFFIX[] = "$tier2";
+constexpr char TIER_COUNTER_SUFFIX[] = "$calls";
+
+/* Bodies of replaceable functions are named `<name>$v<version>` */
+constexpr char REPLACEABLE_BODY_SUFFIX[] = "$v";
+
+/* With memory limit every function stores EPOCH_SYMBOL into `<module>$used` & counts its frame in `<module>$active`
+   of its unit, once EVICT_REQUESTED_SYMBOL is set - calls SAFEPOINT_SYMBOL(&SAFEPOINT_CONTEXT_SYMBOL) on entry */
+constexpr char EPOCH_SYMBOL[] = "__xcc_epoch";
+constexpr char EVICT_REQUESTED_SYMBOL[] = "__xcc_evict_requested";
+constexpr char SAFEPOINT_SYMBOL[] = "__xcc_safepoint";
+constexpr char SAFEPOINT_CONTEXT_SYMBOL[] = "__xcc_safepoint_context";
+constexpr char LAST_USED_SUFFIX[] = "$used";
+constexpr char ACTIVE_SUFFIX[] = "$active";
+
 static auto logger = xcc::util::log::Logger("JIT",
   xcc::util::log::Flag::SPLIT_ON_NEWLINE);
 
-class SymbolResolverGenerator : public llvm::orc::DefinitionGenerator {
+/**
+ * Creates slab memory manager for JITLink layer
+ *
+ * Reserves address space in chunks of `jit_slab_size` and packs sections of many
+ * (small) objects into it, instead of mapping separate pages for every object
+ */
+static std::unique_ptr<llvm::jitlink::JITLinkMemoryManager> createMemoryManager(const xcc::Options& options) {
+  // Slab is mapped in compiler's memory, executor process allocates its own
+  if (options.jit_linker != xcc::JitLinker::JITLINK || !options.jit_slab_size || options.out_of_process) {
+    return nullptr;
+  }
+
+  if (options.jit_huge_pages) {
+    auto slab_size = (options.jit_slab_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    auto mapper = std::make_unique<HugePageMemoryMapper>(llvm::sys::Process::getPageSizeEstimate());
+
+    return std::make_unique<llvm::orc::MapperJITLinkMemoryManager>(slab_size, std::move(mapper));
+  }
+
+  auto memory_manager = llvm::orc::MapperJITLinkMemoryManager::CreateWithMapper<llvm::orc::InProcessMemoryMapper>(options.jit_slab_size);
+
+  if (!memory_manager) {
+    throw xcc::CodegenException(memory_manager.takeError());
+  }
+
+  return std::move(*memory_manager);
+}
+
+/**
+ * Creates slab pool for RuntimeDyld layer
+ *
+ * Unlike JITLink, RuntimeDyld allocates every section of every object separately (SectionMemoryManager
+ * maps separate pages for each), the pool packs them into shared pages
+ */
+static std::unique_ptr<MemoryPool> createMemoryPool(const xcc::Options& options, MemoryStats& stats) {
+  if (options.jit_linker != xcc::JitLinker::RTDYLD || !options.jit_slab_size || options.out_of_process) {
+    return nullptr;
+  }
+
+  if (!MemoryPool::isSupported()) {
+    logger.debug("Pooled JIT memory isn't supported, allocating pages per object");
+    return nullptr;
+  }
+
+  return std::make_unique<MemoryPool>(options.jit_slab_size, options.jit_huge_pages, stats);
+}
+
+/**
+ * Creates jitdump plugin, it writes code & line tables of linked graphs through perf runtime functions of this process
+ */
+static std::unique_ptr<llvm::orc::ObjectLinkingLayer::Plugin> createPerfSupportPlugin(llvm::orc::ExecutionSession& session) {
+  auto& runtime_jd = session.createBareJITDylib("<perf>");
+
+  llvm::orc::SymbolMap symbols;
+  symbols[session.intern("llvm_orc_registerJITLoaderPerfStart")] = {llvm::orc::ExecutorAddr::fromPtr(&llvm_orc_registerJITLoaderPerfStart), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable};
+  symbols[session.intern("llvm_orc_registerJITLoaderPerfEnd")] = {llvm::orc::ExecutorAddr::fromPtr(&llvm_orc_registerJITLoaderPerfEnd), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable};
+  symbols[session.intern("llvm_orc_registerJITLoaderPerfImpl")] = {llvm::orc::ExecutorAddr::fromPtr(&llvm_orc_registerJITLoaderPerfImpl), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable};
+
+  llvm::cantFail(runtime_jd.define(llvm::orc::absoluteSymbols(std::move(symbols))));
+
+  auto plugin = llvm::orc::PerfSupportPlugin::Create(session.getExecutorProcessControl(), runtime_jd, true, true);
+
+  if (!plugin) {
+    throw xcc::CodegenException(plugin.takeError());
+  }
+
+  return std::move(*plugin);
+}
+
+/**
+ * Creates object linking layer selected by options
+ *
+ * With debug info objects are registered with GDB JIT interface (GDB & perf read line tables from them),
+ * with perf map/jitdump - JIT'd functions are reported to perf, with memory limit - linked bytes are accounted per tracker
+ */
+static std::unique_ptr<llvm::orc::ObjectLayer> createObjectLayer(
+  llvm::orc::ExecutionSession& session,
+  const xcc::Options& options,
+  llvm::jitlink::JITLinkMemoryManager * memory_manager,
+  MemoryPool * memory_pool,
+  MemoryStats& memory_stats,
+  LinkedSizes * linked_sizes,
+  PerfMap * perf_map,
+  llvm::JITEventListener * perf_map_listener
+) {
+  if (options.jit_linker == xcc::JitLinker::JITLINK) {
+    auto layer = memory_manager
+        ? std::make_unique<llvm::orc::ObjectLinkingLayer>(session, *memory_manager)
+        : std::make_unique<llvm::orc::ObjectLinkingLayer>(session);
+
+#if XCC_EH_FRAME_PLUGIN_FACTORY
+    auto eh_frame_plugin = llvm::orc::EHFrameRegistrationPlugin::Create(session);
+
+    if (!eh_frame_plugin) {
+      throw xcc::CodegenException(eh_frame_plugin.takeError());
+    }
+
+    layer->addPlugin(std::move(*eh_frame_plugin));
+#else
+    auto eh_frame_registrar = llvm::orc::EPCEHFrameRegistrar::Create(session);
+
+    if (!eh_frame_registrar) {
+      throw xcc::CodegenException(eh_frame_registrar.takeError());
+    }
+
+    layer->addPlugin(std::make_unique<llvm::orc::EHFrameRegistrationPlugin>(session, std::move(*eh_frame_registrar)));
+#endif
+
+    if (options.jit_memory_stats) {
+      layer->addPlugin(std::make_unique<MemoryStatsPlugin>(memory_stats, llvm::sys::Process::getPageSizeEstimate()));
+    }
+
+    if (linked_sizes) {
+      layer->addPlugin(std::make_unique<LinkedSizePlugin>(*linked_sizes));
+    }
+
+    if (options.debug_info) {
+      auto registrar = std::make_unique<llvm::orc::EPCDebugObjectRegistrar>(session, llvm::orc::ExecutorAddr::fromPtr(&llvm_orc_registerJITLoaderGDBWrapper));
+      layer->addPlugin(std::make_unique<llvm::orc::DebugObjectManagerPlugin>(session, std::move(registrar)));
+    }
+
+    if (options.jitdump) {
+      layer->addPlugin(createPerfSupportPlugin(session));
+    }
+
+    if (perf_map) {
+      layer->addPlugin(std::make_unique<PerfMapPlugin>(*perf_map));
+    }
+
+    return layer;
+  }
+
+  auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(session, [memory_pool]() -> std::unique_ptr<llvm::RuntimeDyld::MemoryManager> {
+    if (memory_pool) {
+      return std::make_unique<PooledMemoryManager>(*memory_pool);
+    }
+
+    return std::make_unique<llvm::SectionMemoryManager>();
+  });
+
+  if (linked_sizes) {
+    layer->setNotifyLoaded([linked_sizes](llvm::orc::MaterializationResponsibility& mr, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info) {
+      linked_sizes->notifyLoaded(mr, object, info);
+    });
+  }
+
+  if (options.debug_info) {
+    // Debug sections are dropped by RuntimeDyld otherwise
+    layer->setProcessAllSections(true);
+    layer->registerJITEventListener(*llvm::JITEventListener::createGDBRegistrationListener());
+  }
+
+  if (options.jitdump) {
+    if (auto * listener = llvm::JITEventListener::createPerfJITEventListener()) {
+      layer->registerJITEventListener(*listener);
+    } else {
+      logger.warn("LLVM is built without perf support (LLVM_USE_PERF), jitdump isn't written with RuntimeDyld, use '--jit-linker jitlink'");
+    }
+  }
+
+  if (perf_map_listener) {
+    layer->registerJITEventListener(*perf_map_listener);
+  }
+
+  return layer;
+}
+
+/**
+ * Spawns executor process & connects to it over a pair of pipes (ORC remote executor protocol)
+ */
+static std::unique_ptr<llvm::orc::ExecutorProcessControl> createRemoteExecutor(const xcc::Options& options, pid_t& pid) {
+  auto path = !options.executor.empty()
+      ? options.executor
+      : llvm::sys::Process::GetEnv("XCC_EXECUTOR").value_or(XCC_EXECUTOR);
+
+  int to_executor[2];
+  int from_executor[2];
+
+  if (pipe(to_executor) != 0) {
+    throw xcc::CodegenException(std::format("Can't create pipe: {}", std::strerror(errno)));
+  }
+
+  if (pipe(from_executor) != 0) {
+    close(to_executor[0]);
+    close(to_executor[1]);
+    throw xcc::CodegenException(std::format("Can't create pipe: {}", std::strerror(errno)));
+  }
+
+  // Executors, spawned later (e.g. by other sessions), must not keep compiler's ends open
+  fcntl(to_executor[1], F_SETFD, FD_CLOEXEC);
+  fcntl(from_executor[0], F_SETFD, FD_CLOEXEC);
+
+  std::fflush(nullptr);
+
+  pid = fork();
+
+  if (pid == 0) {
+    auto in_fd = std::to_string(to_executor[0]);
+    auto out_fd = std::to_string(from_executor[1]);
+
+    execl(path.c_str(), path.c_str(), in_fd.c_str(), out_fd.c_str(), nullptr);
+
+    std::fprintf(stderr, "Can't execute executor '%s': %s\n", path.c_str(), std::strerror(errno));
+    _exit(127);
+  }
+
+  close(to_executor[0]);
+  close(from_executor[1]);
+
+  if (pid < 0) {
+    close(to_executor[1]);
+    close(from_executor[0]);
+    throw xcc::CodegenException(std::format("fork() failed: {}", std::strerror(errno)));
+  }
+
+  auto epc = llvm::orc::SimpleRemoteEPC::Create<llvm::orc::FDSimpleRemoteEPCTransport>(
+    std::make_unique<llvm::orc::DynamicThreadPoolTaskDispatcher>(std::nullopt),
+    llvm::orc::SimpleRemoteEPC::Setup(),
+    from_executor[0], to_executor[1]
+  );
+
+  if (!epc) {
+    throw xcc::CodegenException(std::format("Can't connect to executor '{}': {}", path, llvm::toString(epc.takeError())));
+  }
+
+  logger.debug("Executor '{}' started (pid {})", path, pid);
+
+  return std::move(*epc);
+}
+
+/**
+ * Creates target machine builder for CPU & features selected by options
+ *
+ * By default (or with `native` CPU) host CPU & all its features are used, as JIT'd code runs on the same machine
+ */
+static llvm::orc::JITTargetMachineBuilder createTargetMachineBuilder(const llvm::Triple& triple, const xcc::Options& options) {
+  std::optional<llvm::orc::JITTargetMachineBuilder> jtmb;
+
+  if (options.target_cpu.empty() || options.target_cpu == "native") {
+    auto host = llvm::orc::JITTargetMachineBuilder::detectHost();
+
+    if (!host) {
+      throw xcc::CodegenException(host.takeError());
+    }
+
+    jtmb = std::move(*host);
+  } else {
+    jtmb.emplace(triple);
+    jtmb->setCPU(options.target_cpu);
+  }
+
+  if (!options.target_features.empty()) {
+    llvm::SmallVector<llvm::StringRef> features;
+    llvm::StringRef(options.target_features).split(features, ',', -1, false);
+
+    std::vector<std::string> result;
+    for (auto feature : features) {
+      result.push_back(feature.trim().str());
+    }
+
+    jtmb->addFeatures(result);
+  }
+
+  return std::move(*jtmb);
+}
+
+/**
+ * Wraps IR compiler & passes every compiled object (along with its module name) to a callback
+ *
+ * Objects are recorded here and not in an object layer, as only here module name is known - objects,
+ * loaded from object cache, are named after cache files
+ */
+class RecordingCompiler : public llvm::orc::IRCompileLayer::IRCompiler {
 public:
-  llvm::orc::MangleAndInterner& mangle;
+  using Callback = std::function<void(const std::string&, llvm::MemoryBufferRef)>;
+
+private:
+  std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler> compiler;
+  Callback callback;
 
 public:
-  explicit SymbolResolverGenerator(llvm::orc::MangleAndInterner& mangle) : mangle(mangle) {}
+  RecordingCompiler(std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler> compiler, Callback callback)
+    : IRCompiler(compiler->getManglingOptions()), compiler(std::move(compiler)), callback(std::move(callback)) {}
 
-  static std::unique_ptr<SymbolResolverGenerator> create(llvm::orc::MangleAndInterner& mangle) {
-    return std::make_unique<SymbolResolverGenerator>(mangle);
+  static std::unique_ptr<RecordingCompiler> create(std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler> compiler, Callback callback) {
+    return std::make_unique<RecordingCompiler>(std::move(compiler), std::move(callback));
   }
 
-  llvm::Error tryToGenerate(llvm::orc::LookupState &state, llvm::orc::LookupKind kind, llvm::orc::JITDylib &jd,
-                            llvm::orc::JITDylibLookupFlags flags, const llvm::orc::SymbolLookupSet& set) override {
-    for (auto& [sym_name, sym_flags] : set) {
-      auto name = llvm::orc::SymbolStringPoolEntryUnsafe::from(sym_name).rawPtr()->first().str();
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> operator()(llvm::Module& module) override {
+    auto object = (*compiler)(module);
 
-      auto sym = jd.getExecutionSession().lookup({&jd}, mangle(name));
+    if (object) {
+      callback(module.getModuleIdentifier(), (*object)->getMemBufferRef());
+    }
 
-      if (sym) {
-#if USE_REPORT_SYMBOL_RESOLVER_SUCCESS
-        logger.info("Found symbol '{}' (mangled '{}')", name,
-               llvm::orc::SymbolStringPoolEntryUnsafe::from(mangle(name)).rawPtr()->first().str());
-#endif
+    return object;
+  }
+};
 
-        llvm::orc::SymbolMap symbols;
+/**
+ * Entry point of TIER_UP_SYMBOL
+ */
+static void tierUpCallback(void * jit, uint64_t id) {
+  static_cast<JIT *>(jit)->tierUp(id);
+}
 
-        symbols[jd.getExecutionSession().getSymbolStringPool()->intern(name)] = sym.get();
+/**
+ * Instruments baseline version of a function: counter is incremented on entry & on every loop back edge,
+ * if on entry counter is over threshold - tier up callback is called
+ */
+static void instrumentBaseline(llvm::Module& module, llvm::Function& fn, const std::string& name, size_t id, size_t threshold) {
+  auto& ctx = module.getContext();
+  auto i64 = llvm::Type::getInt64Ty(ctx);
+  auto ptr = llvm::PointerType::getUnqual(ctx);
 
-        llvm::cantFail(jd.define(llvm::orc::absoluteSymbols(std::move(symbols))));
+  auto counter = new llvm::GlobalVariable(
+    module, i64, false, llvm::GlobalValue::ExternalLinkage, llvm::ConstantInt::get(i64, 0), name + TIER_COUNTER_SUFFIX);
 
-        continue;
+  auto tier_up = module.getOrInsertFunction(TIER_UP_SYMBOL, llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), {ptr, i64}, false));
+  auto tier_context = module.getOrInsertGlobal(TIER_CONTEXT_SYMBOL, llvm::Type::getInt8Ty(ctx));
+
+  // Back edges are collected before entry block is split
+  llvm::DominatorTree dt(fn);
+  std::vector<llvm::BasicBlock *> latches;
+
+  for (auto& block : fn) {
+    for (auto successor : llvm::successors(&block)) {
+      if (dt.dominates(successor, &block)) {
+        latches.push_back(&block);
+        break;
       }
+    }
+  }
+
+  for (auto latch : latches) {
+    llvm::IRBuilder<> builder(latch->getTerminator());
+    builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter, builder.getInt64(1), llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+  }
+
+  // Skip allocas, so they stay in entry block
+  auto& entry = fn.getEntryBlock();
+  auto it = entry.getFirstInsertionPt();
+  while (llvm::isa<llvm::AllocaInst>(*it)) {
+    ++it;
+  }
+
+  llvm::IRBuilder<> builder(&entry, it);
+  auto calls = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter, builder.getInt64(1), llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+  auto hot = llvm::cast<llvm::Instruction>(builder.CreateICmpUGE(calls, builder.getInt64(threshold)));
+
+  auto then = llvm::SplitBlockAndInsertIfThen(hot, hot->getNextNode(), false, llvm::MDBuilder(ctx).createUnlikelyBranchWeights());
+
+  builder.SetInsertPoint(then);
+  builder.CreateCall(tier_up, {tier_context, builder.getInt64(id)});
+}
+
+/**
+ * Entry point of SAFEPOINT_SYMBOL
+ */
+static void safepointCallback(void * jit) {
+  static_cast<JIT *>(jit)->safepoint();
+}
+
+/**
+ * Instruments function of an evictable unit: on entry its frame is counted in `<unit>$active` (uncounted on
+ * every return), current call epoch is stored into `<unit>$used` & safepoint callback is called, if eviction
+ * is requested
+ */
+static void instrumentEvictable(llvm::Module& module, llvm::Function& fn, const std::string& unit) {
+  auto& ctx = module.getContext();
+  auto i64 = llvm::Type::getInt64Ty(ctx);
+  auto ptr = llvm::PointerType::getUnqual(ctx);
+
+  auto epoch = module.getOrInsertGlobal(EPOCH_SYMBOL, i64);
+  auto requested = module.getOrInsertGlobal(EVICT_REQUESTED_SYMBOL, i64);
+  auto last_used = module.getOrInsertGlobal(unit + LAST_USED_SUFFIX, i64);
+  auto active = module.getOrInsertGlobal(unit + ACTIVE_SUFFIX, i64);
 
-      return llvm::createStringError("Unable to resolve symbol %s", name.c_str());
+  auto safepoint = module.getOrInsertFunction(SAFEPOINT_SYMBOL, llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), {ptr}, false));
+  auto safepoint_context = module.getOrInsertGlobal(SAFEPOINT_CONTEXT_SYMBOL, llvm::Type::getInt8Ty(ctx));
+
+  // Returns are collected before entry block is split
+  std::vector<llvm::ReturnInst *> returns;
+
+  for (auto& block : fn) {
+    if (auto ret = llvm::dyn_cast_or_null<llvm::ReturnInst>(block.getTerminator())) {
+      returns.push_back(ret);
     }
+  }
 
-    return llvm::Error::success();
+  for (auto ret : returns) {
+    llvm::IRBuilder<> builder(ret);
+    builder.CreateAtomicRMW(llvm::AtomicRMWInst::Sub, active, builder.getInt64(1), llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
   }
-};
 
-JIT::JIT(std::unique_ptr<llvm::orc::ExecutionSession> session, llvm::orc::JITTargetMachineBuilder jtmb, llvm::DataLayout layout)
-  : session(std::move(session)), data_layout(layout), mangle(*this->session, this->data_layout),
-    object_layer(*this->session, []() { return std::make_unique<llvm::SectionMemoryManager>(); }),
-    compile_layer(*this->session, this->object_layer, std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(jtmb))),
-    main_jd(this->session->createBareJITDylib("<main>")) {
+  // Skip allocas, so they stay in entry block
+  auto& entry = fn.getEntryBlock();
+  auto it = entry.getFirstInsertionPt();
+  while (llvm::isa<llvm::AllocaInst>(*it)) {
+    ++it;
+  }
+
+  llvm::IRBuilder<> builder(&entry, it);
+
+  // Frame is counted before safepoint, so its own unit is never evicted under it
+  builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, active, builder.getInt64(1), llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
 
-  llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+  auto load = builder.CreateAlignedLoad(i64, epoch, llvm::MaybeAlign(8));
+  load->setAtomic(llvm::AtomicOrdering::Monotonic);
 
-  main_jd.addGenerator(llvm::cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(data_layout.getGlobalPrefix())));
-  main_jd.addGenerator(SymbolResolverGenerator::create(mangle));
+  auto store = builder.CreateAlignedStore(load, last_used, llvm::MaybeAlign(8));
+  store->setAtomic(llvm::AtomicOrdering::Monotonic);
 
-  if (jtmb.getTargetTriple().isOSBinFormatCOFF()) {
-    object_layer.setOverrideObjectFlagsWithResponsibilityFlags(true);
-    object_layer.setAutoClaimResponsibilityForObjectSymbols(true);
+  auto flag = builder.CreateAlignedLoad(i64, requested, llvm::MaybeAlign(8));
+  flag->setAtomic(llvm::AtomicOrdering::Monotonic);
+
+  auto evict = llvm::cast<llvm::Instruction>(builder.CreateICmpNE(flag, builder.getInt64(0)));
+
+  auto then = llvm::SplitBlockAndInsertIfThen(evict, evict->getNextNode(), false, llvm::MDBuilder(ctx).createUnlikelyBranchWeights());
+
+  builder.SetInsertPoint(then);
+  builder.CreateCall(safepoint, {safepoint_context});
+}
+
+/**
+ * Returns version of a replaceable body or of its module (`<name>$v<version>`), 0 if name isn't versioned
+ */
+static size_t bodyVersion(llvm::StringRef name) {
+  auto pos = name.rfind(REPLACEABLE_BODY_SUFFIX);
+  size_t version = 0;
+
+  if (pos == llvm::StringRef::npos || name.substr(pos + std::strlen(REPLACEABLE_BODY_SUFFIX)).getAsInteger(10, version)) {
+    return 0;
   }
+
+  return version;
 }
 
-JIT::~JIT() {
+/**
+ * Returns true if object references symbol (e.g. slot of its unit, so it was compiled with memory limit)
+ */
+static bool referencesSymbol(llvm::MemoryBufferRef object, llvm::StringRef symbol) {
+  auto file = llvm::object::ObjectFile::createObjectFile(object);
+
+  if (!file) {
+    llvm::consumeError(file.takeError());
+    return false;
+  }
+
+  for (auto entry : (*file)->symbols()) {
+    auto name = entry.getName();
+
+    if (!name) {
+      llvm::consumeError(name.takeError());
+      continue;
+    }
+
+    if (*name == symbol) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Writes object into file (evicted code is relinked from it)
+ */
+static llvm::Error writeObject(const std::string& path, llvm::MemoryBufferRef object) {
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+
+  if (ec) {
+    return llvm::createFileError(path, ec);
+  }
+
+  out << object.getBuffer();
+  out.close();
+
+  if (out.has_error()) {
+    return llvm::createFileError(path, out.error());
+  }
+
+  return llvm::Error::success();
+}
+
+/**
+ * Called by reload trampoline of an evicted function, if its code can't be relinked
+ */
+static void callThroughError() {
+  logger.fatal("Can't relink evicted function");
+  std::abort();
+}
+
+/**
+ * Creates pool of reload trampolines of evicted functions, in this process (same ABIs, as local lazy call-through managers)
+ */
+static llvm::Expected<std::unique_ptr<llvm::orc::TrampolinePool>> createTrampolinePool(const llvm::Triple& triple, llvm::orc::TrampolinePool::ResolveLandingFunction resolve) {
+  switch (triple.getArch()) {
+    case llvm::Triple::x86_64:
+      if (triple.isOSWindows()) {
+        return llvm::orc::LocalTrampolinePool<llvm::orc::OrcX86_64_Win32>::Create(std::move(resolve));
+      }
+      return llvm::orc::LocalTrampolinePool<llvm::orc::OrcX86_64_SysV>::Create(std::move(resolve));
+
+    case llvm::Triple::aarch64:
+      return llvm::orc::LocalTrampolinePool<llvm::orc::OrcAArch64>::Create(std::move(resolve));
+
+    default:
+      return llvm::createStringError(llvm::inconvertibleErrorCode(), "Reload trampolines aren't supported on %s", triple.str().c_str());
+  }
+}
+
+/**
+ * Runs O3 pipeline on module
+ */
+static void optimizeModule(llvm::Module& module) {
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PassBuilder pass_builder;
+
+  pass_builder.registerModuleAnalyses(mam);
+  pass_builder.registerCGSCCAnalyses(cgam);
+  pass_builder.registerFunctionAnalyses(fam);
+  pass_builder.registerLoopAnalyses(lam);
+  pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  pass_builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3).run(module, mam);
+}
+
+JITEngine::JITEngine(std::unique_ptr<llvm::orc::ExecutionSession> session, llvm::orc::JITTargetMachineBuilder jtmb, llvm::DataLayout layout, const Options& options)
+  : options(options), session(std::move(session)), jtmb(std::move(jtmb)), data_layout(std::move(layout)),
+    linker(options.jit_linker),
+    memory_manager(createMemoryManager(options)),
+    memory_pool(createMemoryPool(options, memory_stats)),
+    perf_map(PerfMap::create(options)),
+    perf_map_listener(perf_map && linker == JitLinker::RTDYLD ? std::make_unique<PerfMapListener>(*perf_map) : nullptr),
+    object_layer(createObjectLayer(*this->session, options, memory_manager.get(), memory_pool.get(), memory_stats,
+      options.jit_memory_limit ? &linked_sizes : nullptr, perf_map.get(), perf_map_listener.get())),
+    object_cache(ObjectCache::create(options, this->jtmb)),
+    pool(llvm::hardware_concurrency(options.jobs)) {
+
+  // Libraries of executor process are loaded by it, when JITDylibs are created
+  if (!options.out_of_process) {
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+    for (auto& library : options.libraries) {
+      SymbolRegistry::loadLibrary(library);
+    }
+  }
+
+  if (linker == JitLinker::RTDYLD && this->jtmb.getTargetTriple().isOSBinFormatCOFF()) {
+    auto& rtdyld_layer = static_cast<llvm::orc::RTDyldObjectLinkingLayer&>(*object_layer);
+    rtdyld_layer.setOverrideObjectFlagsWithResponsibilityFlags(true);
+    rtdyld_layer.setAutoClaimResponsibilityForObjectSymbols(true);
+  }
+}
+
+JITEngine::~JITEngine() {
+  // Background compilations of JITs are already waited for, by their destructors
+  pool.wait();
+
   if (auto err = session->endSession()) {
     session->reportError(std::move(err));
   }
+
+  // Executor exits, once session is disconnected
+  if (executor_pid > 0) {
+    int status;
+    while (waitpid(executor_pid, &status, 0) < 0 && errno == EINTR) {}
+  }
+
+  if (options.jit_memory_stats) {
+    memory_stats.report();
+  }
 }
 
-std::unique_ptr<JIT> JIT::create() {
-  auto epc = llvm::orc::SelfExecutorProcessControl::Create();
+std::shared_ptr<JITEngine> JITEngine::create(const Options& options) {
+  util::initNativeTarget();
 
-  if (!epc) {
-    throw CodegenException(epc.takeError());
+  pid_t executor_pid = -1;
+  std::unique_ptr<llvm::orc::ExecutorProcessControl> epc;
+
+  if (options.out_of_process) {
+    epc = createRemoteExecutor(options, executor_pid);
+  } else {
+    auto self = llvm::orc::SelfExecutorProcessControl::Create();
+
+    if (!self) {
+      throw CodegenException(self.takeError());
+    }
+
+    epc = std::move(*self);
   }
 
-  auto session = std::make_unique<llvm::orc::ExecutionSession>(std::move(*epc));
+  auto session = std::make_unique<llvm::orc::ExecutionSession>(std::move(epc));
 
-  llvm::orc::JITTargetMachineBuilder jtmb(session->getExecutorProcessControl().getTargetTriple());
+  auto jtmb = createTargetMachineBuilder(session->getExecutorProcessControl().getTargetTriple(), options);
+
+  if (options.tiered) {
+    // Baseline tier - fast instruction selection, no codegen optimizations
+    jtmb.setCodeGenOptLevel(llvm::CodeGenOptLevel::None);
+    jtmb.getOptions().EnableFastISel = true;
+  }
 
   auto data_layout = jtmb.getDefaultDataLayoutForTarget();
 
@@ -91,31 +701,1109 @@ std::unique_ptr<JIT> JIT::create() {
     throw CodegenException(data_layout.takeError());
   }
 
-  return std::make_unique<JIT>(std::move(session), std::move(jtmb), std::move(*data_layout));
+  auto engine = std::make_shared<JITEngine>(std::move(session), std::move(jtmb), std::move(*data_layout), options);
+  engine->executor_pid = executor_pid;
+
+  return engine;
 }
 
-const llvm::DataLayout& JIT::getDataLayout() const {
+bool JITEngine::isCompatible(const Options& lhs, const Options& rhs) {
+  return lhs.target_cpu == rhs.target_cpu
+      && lhs.target_features == rhs.target_features
+      && lhs.jit_linker == rhs.jit_linker
+      && lhs.jit_slab_size == rhs.jit_slab_size
+      && lhs.jit_huge_pages == rhs.jit_huge_pages
+      && lhs.jit_memory_stats == rhs.jit_memory_stats
+      && lhs.jit_memory_limit == rhs.jit_memory_limit
+      && lhs.debug_info == rhs.debug_info
+      && lhs.perf_map == rhs.perf_map
+      && lhs.jitdump == rhs.jitdump
+      && lhs.tiered == rhs.tiered
+      && lhs.cache_dir == rhs.cache_dir
+      && lhs.cache_size == rhs.cache_size
+      && lhs.libraries == rhs.libraries
+      && lhs.out_of_process == rhs.out_of_process
+      && lhs.executor == rhs.executor;
+}
+
+const Options& JITEngine::getOptions() const {
+  return options;
+}
+
+llvm::orc::ExecutionSession& JITEngine::getSession() {
+  return *session;
+}
+
+const llvm::orc::JITTargetMachineBuilder& JITEngine::getTargetMachineBuilder() const {
+  return jtmb;
+}
+
+const llvm::DataLayout& JITEngine::getDataLayout() const {
   return data_layout;
 }
 
-llvm::orc::JITDylib& JIT::getMainJitDylib() {
-  return main_jd;
+JitLinker JITEngine::getLinker() const {
+  return linker;
 }
 
-llvm::Error JIT::addModule(llvm::orc::ThreadSafeModule tsm, llvm::orc::ResourceTrackerSP rt) {
-  if (!rt) {
-    rt = main_jd.getDefaultResourceTracker();
+llvm::orc::ObjectLayer& JITEngine::getObjectLayer() {
+  return *object_layer;
+}
+
+ObjectCache * JITEngine::getObjectCache() {
+  return object_cache.get();
+}
+
+llvm::DefaultThreadPool& JITEngine::getThreadPool() {
+  return pool;
+}
+
+MemoryStats& JITEngine::getMemoryStats() {
+  return memory_stats;
+}
+
+LinkedSizes& JITEngine::getLinkedSizes() {
+  return linked_sizes;
+}
+
+bool JITEngine::isRemote() const {
+  return executor_pid > 0;
+}
+
+llvm::orc::JITDylib& JITEngine::createJITDylib(const std::string& name) {
+  auto& jd = session->createBareJITDylib(std::format("{}#{}", name, dylib_counter++));
+
+  if (!isRemote()) {
+    // Replaces DynamicLibrarySearchGenerator: addresses are cached across modules & all symbols of a lookup are defined at once
+    jd.addGenerator(SymbolRegistryGenerator::create(data_layout.getGlobalPrefix()));
+    return jd;
   }
 
-  return compile_layer.add(rt, std::move(tsm));
+  // Symbols of executor process (libc, xcc runtime) & libraries, loaded into it
+  auto process = llvm::orc::EPCDynamicLibrarySearchGenerator::GetForTargetProcess(*session);
+
+  if (!process) {
+    throw CodegenException(process.takeError());
+  }
+
+  jd.addGenerator(std::move(*process));
+
+  for (auto& library : options.libraries) {
+    auto generator = llvm::orc::EPCDynamicLibrarySearchGenerator::Load(*session, library.c_str());
+
+    if (!generator) {
+      throw CodegenException(std::format("Can't load '{}' into executor: {}", library, llvm::toString(generator.takeError())));
+    }
+
+    jd.addGenerator(std::move(*generator));
+  }
+
+  return jd;
 }
 
-llvm::Expected<llvm::orc::ExecutorSymbolDef> JIT::lookup(llvm::StringRef name) {
-  return session->lookup({&main_jd}, name);
+JIT::JIT(std::shared_ptr<JITEngine> engine, const Options& options)
+  : engine(std::move(engine)),
+    mangle(this->engine->getSession(), this->engine->getDataLayout()),
+    target_cpu(this->engine->getTargetMachineBuilder().getCPU()),
+    object_compiler(std::make_unique<llvm::orc::ConcurrentIRCompiler>(this->engine->getTargetMachineBuilder(), this->engine->getObjectCache())),
+    compile_layer(this->engine->getSession(), this->engine->getObjectLayer(), RecordingCompiler::create(
+      std::make_unique<llvm::orc::ConcurrentIRCompiler>(this->engine->getTargetMachineBuilder(), this->engine->getObjectCache()),
+      [this](const std::string& module, llvm::MemoryBufferRef object) {
+        recordObject(module, object);
+      })),
+    main_jd(this->engine->createJITDylib("<main>")),
+    tier_threshold(options.tier_threshold),
+    memory_limit(options.jit_memory_limit) {
+
+  auto& triple = this->engine->getSession().getExecutorProcessControl().getTargetTriple();
+
+  if (options.tiered || options.hot_swap || memory_limit) {
+    auto stubs_manager_builder = llvm::orc::createLocalIndirectStubsManagerBuilder(triple);
+
+    if (!stubs_manager_builder) {
+      throw CodegenException(std::format("{} isn't supported on {}",
+        options.tiered ? "Tiered compilation" : options.hot_swap ? "Hot swap" : "JIT memory limit", triple.str()));
+    }
+
+    stubs_manager = stubs_manager_builder();
+  }
+
+  if (memory_limit) {
+    auto pool = createTrampolinePool(triple, [this](llvm::orc::ExecutorAddr trampoline, llvm::orc::TrampolinePool::NotifyLandingResolvedFunction on_resolved) {
+      reload(trampoline, std::move(on_resolved));
+    });
+
+    if (!pool) {
+      throw CodegenException(pool.takeError());
+    }
+
+    trampolines = std::move(*pool);
+
+    // Objects of evictable units are kept on disk, not in memory
+    llvm::SmallString<128> prefix;
+    llvm::sys::path::system_temp_directory(true, prefix);
+    llvm::sys::path::append(prefix, "xcc-evicted");
+
+    llvm::SmallString<128> directory;
+
+    if (auto ec = llvm::sys::fs::createUniqueDirectory(prefix, directory)) {
+      throw CodegenException(std::format("Can't create directory for evicted code: {}", ec.message()));
+    }
+
+    spill_directory = directory.str().str();
+
+    llvm::orc::SymbolMap symbols;
+    symbols[mangle(EPOCH_SYMBOL)] = {llvm::orc::ExecutorAddr::fromPtr(&epoch), llvm::JITSymbolFlags::Exported};
+    symbols[mangle(EVICT_REQUESTED_SYMBOL)] = {llvm::orc::ExecutorAddr::fromPtr(&evict_requested), llvm::JITSymbolFlags::Exported};
+    symbols[mangle(SAFEPOINT_SYMBOL)] = {llvm::orc::ExecutorAddr::fromPtr(&safepointCallback), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable};
+    symbols[mangle(SAFEPOINT_CONTEXT_SYMBOL)] = {llvm::orc::ExecutorAddr::fromPtr(this), llvm::JITSymbolFlags::Exported};
+
+    llvm::cantFail(main_jd.define(llvm::orc::absoluteSymbols(std::move(symbols))));
+  }
+
+  if (options.tiered) {
+    auto optimized_jtmb = createTargetMachineBuilder(triple, options);
+    optimized_jtmb.setCodeGenOptLevel(llvm::CodeGenOptLevel::Aggressive);
+
+    optimized_layer = std::make_unique<llvm::orc::IRCompileLayer>(
+      this->engine->getSession(), this->engine->getObjectLayer(), std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(optimized_jtmb)));
+
+    tier_tasks = std::make_unique<llvm::ThreadPoolTaskGroup>(this->engine->getThreadPool());
+
+    llvm::orc::SymbolMap symbols;
+    symbols[mangle(TIER_UP_SYMBOL)] = {llvm::orc::ExecutorAddr::fromPtr(&tierUpCallback), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable};
+    symbols[mangle(TIER_CONTEXT_SYMBOL)] = {llvm::orc::ExecutorAddr::fromPtr(this), llvm::JITSymbolFlags::Exported};
+
+    llvm::cantFail(main_jd.define(llvm::orc::absoluteSymbols(std::move(symbols))));
+  }
+}
+
+JIT::~JIT() {
+  // Optimized compilation may still be in flight
+  if (tier_tasks) {
+    tier_tasks->wait();
+  }
+
+  if (memory_limit && engine->getOptions().jit_memory_stats) {
+    logger.info("JIT memory limit {} bytes: {} evictions, {} reloads", memory_limit, evictions.load(), reloads.load());
+  }
+
+  // Code & data of this JIT are freed, engine (and other sessions in it) stays alive
+  if (auto err = engine->getSession().removeJITDylib(main_jd)) {
+    engine->getSession().reportError(std::move(err));
+  }
+
+  if (!spill_directory.empty()) {
+    llvm::sys::fs::remove_directories(spill_directory);
+  }
+}
+
+std::unique_ptr<JIT> JIT::create(const Options& options) {
+  return create(JITEngine::create(options), options);
+}
+
+std::unique_ptr<JIT> JIT::create(std::shared_ptr<JITEngine> engine, const Options& options) {
+  assertThrow(JITEngine::isCompatible(engine->getOptions(), options), CodegenException("Options aren't compatible with shared JIT engine"));
+
+  return std::make_unique<JIT>(std::move(engine), options);
+}
+
+JITEngine& JIT::getEngine() {
+  return *engine;
+}
+
+bool JIT::isRemote() const {
+  return engine->isRemote();
+}
+
+llvm::Expected<int32_t> JIT::runAsMain(llvm::orc::ExecutorAddr address) {
+  return engine->getSession().getExecutorProcessControl().runAsMain(address, {});
+}
+
+const llvm::DataLayout& JIT::getDataLayout() const {
+  return engine->getDataLayout();
+}
+
+llvm::orc::JITDylib& JIT::getMainJitDylib() {
+  return main_jd;
+}
+
+JitLinker JIT::getLinker() const {
+  return engine->getLinker();
+}
+
+ObjectCache * JIT::getObjectCache() {
+  return engine->getObjectCache();
+}
+
+llvm::Error JIT::addModule(llvm::orc::ThreadSafeModule tsm, llvm::orc::ResourceTrackerSP rt) {
+  if (!rt) {
+    rt = main_jd.getDefaultResourceTracker();
+  }
+
+  return compile_layer.add(rt, std::move(tsm));
+}
+
+llvm::Error JIT::createFunctionStub(const std::string& name) {
+  // Callers (from any module) call the stub, which is defined under function's own name
+  if (auto err = stubs_manager->createStub(name, llvm::orc::ExecutorAddr(), llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable)) {
+    return err;
+  }
+
+  llvm::orc::SymbolMap symbols;
+  symbols[mangle(name)] = stubs_manager->findStub(name, true);
+
+  return main_jd.define(llvm::orc::absoluteSymbols(std::move(symbols)));
+}
+
+llvm::Error JIT::addReplaceableModule(llvm::orc::ThreadSafeModule tsm) {
+  auto unit = std::make_shared<CodeUnit>();
+  unit->rt = main_jd.createResourceTracker();
+
+  std::vector<std::pair<std::string, std::string>> bodies;
+
+  tsm.withModuleDo([&](llvm::Module& module) {
+    size_t version;
+
+    {
+      std::lock_guard lock(replaceable_mutex);
+      version = ++replaceable_version;
+    }
+
+    // Local functions (e.g. target clones) are only called from within module, so they don't need stubs
+    for (auto& fn : module) {
+      if (!fn.isDeclaration() && !fn.hasLocalLinkage()) {
+        auto name = fn.getName().str();
+        auto body = std::format("{}{}{}", name, REPLACEABLE_BODY_SUFFIX, version);
+
+        fn.setName(body);
+        bodies.emplace_back(name, body);
+      }
+    }
+
+    // Every version gets its own module name, so recorded object of retired code can be told apart
+    if (!bodies.empty()) {
+      module.setModuleIdentifier(bodies.front().second);
+    }
+
+    unit->module = module.getModuleIdentifier();
+
+    if (memory_limit) {
+      for (auto& [name, body] : bodies) {
+        instrumentEvictable(module, *module.getFunction(body), unit->module);
+      }
+    }
+  });
+
+  if (memory_limit && !bodies.empty()) {
+    // New code counts as just used, so it isn't evicted before its first call
+    unit->last_used = epoch.load();
+
+    engine->getLinkedSizes().track(unit->rt->getKeyUnsafe());
+
+    if (auto err = defineUnitSlots(*unit)) {
+      return err;
+    }
+
+    std::lock_guard lock(replaceable_mutex);
+    units[unit->module] = unit;
+  }
+
+  if (auto err = compile_layer.add(unit->rt, std::move(tsm))) {
+    return err;
+  }
+
+  for (auto& [name, body] : bodies) {
+    if (auto err = defineReplaceable(name, body, unit)) {
+      return err;
+    }
+  }
+
+  return llvm::Error::success();
+}
+
+llvm::Error JIT::defineUnitSlots(CodeUnit& unit) {
+  llvm::orc::SymbolMap symbols;
+  symbols[mangle(unit.module + LAST_USED_SUFFIX)] = {llvm::orc::ExecutorAddr::fromPtr(&unit.last_used), llvm::JITSymbolFlags::Exported};
+  symbols[mangle(unit.module + ACTIVE_SUFFIX)] = {llvm::orc::ExecutorAddr::fromPtr(&unit.active), llvm::JITSymbolFlags::Exported};
+
+  // Tracked by unit's tracker, so slots are removed with its code & never outlive the unit
+  return main_jd.define(llvm::orc::absoluteSymbols(std::move(symbols)), unit.rt);
+}
+
+llvm::Error JIT::addReplaceableFunction(const std::string& name, const std::string& body) {
+  std::shared_ptr<CodeUnit> unit;
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    // Later definitions must not reuse names of added bodies
+    auto version = bodyVersion(body);
+    replaceable_version = std::max(replaceable_version, version);
+
+    // Bodies of a module share its version
+    if (auto it = restored_units.find(version); it != restored_units.end()) {
+      unit = it->second;
+    }
+  }
+
+  return defineReplaceable(name, body, std::move(unit));
+}
+
+llvm::Error JIT::defineReplaceable(const std::string& name, const std::string& body, std::shared_ptr<CodeUnit> unit) {
+  std::lock_guard lock(replaceable_mutex);
+
+  auto [it, inserted] = replaceable_functions.try_emplace(name);
+
+  if (inserted) {
+    if (auto err = createFunctionStub(name)) {
+      replaceable_functions.erase(it);
+      return err;
+    }
+  }
+
+  auto& fn = it->second;
+
+  // Body, that was never called, is superseded right away
+  if (fn.next_unit) {
+    retired_units.push_back(std::move(fn.next_unit));
+  }
+
+  fn.next_body = body;
+  fn.next_unit = std::move(unit);
+
+  return llvm::Error::success();
+}
+
+std::vector<std::pair<std::string, std::string>> JIT::getReplaceableFunctions() {
+  std::vector<std::pair<std::string, std::string>> result;
+
+  std::lock_guard lock(replaceable_mutex);
+
+  for (auto& [name, fn] : replaceable_functions) {
+    if (!fn.body.empty()) {
+      result.emplace_back(name, fn.body);
+    }
+  }
+
+  std::sort(result.begin(), result.end());
+
+  return result;
+}
+
+llvm::Error JIT::resolveReplacements() {
+  std::vector<std::pair<std::string, std::string>> pending;
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    for (auto& [name, fn] : replaceable_functions) {
+      if (!fn.next_body.empty()) {
+        pending.emplace_back(name, fn.next_body);
+      }
+    }
+  }
+
+  if (pending.empty()) {
+    return llvm::Error::success();
+  }
+
+  llvm::orc::SymbolLookupSet lookup_set;
+
+  for (auto& [name, body] : pending) {
+    lookup_set.add(mangle(body));
+  }
+
+  // Single lookup - all new bodies are materialized at once
+  auto symbols = engine->getSession().lookup(llvm::orc::makeJITDylibSearchOrder({&main_jd}), std::move(lookup_set));
+
+  if (!symbols) {
+    // Broken body would fail every following lookup, so it's dropped & the old one is kept
+    std::lock_guard lock(replaceable_mutex);
+
+    for (auto& [name, body] : pending) {
+      auto& fn = replaceable_functions[name];
+
+      if (fn.next_body == body) {
+        fn.next_body.clear();
+
+        if (fn.next_unit) {
+          retired_units.push_back(std::move(fn.next_unit));
+        }
+      }
+    }
+
+    return symbols.takeError();
+  }
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    for (auto& [name, body] : pending) {
+      auto& fn = replaceable_functions[name];
+
+      // Redefined again since lookup started - stays pending
+      if (fn.next_body != body) {
+        continue;
+      }
+
+      // Pointer store is atomic, so concurrent callers get either old or new body
+      if (auto err = stubs_manager->updatePointer(name, (*symbols)[mangle(body)].getAddress())) {
+        return err;
+      }
+
+      if (fn.unit) {
+        retired_units.push_back(std::move(fn.unit));
+      }
+
+      fn.body = std::move(fn.next_body);
+      fn.unit = std::move(fn.next_unit);
+      fn.next_body.clear();
+
+      // Lookup linked the whole unit
+      if (memory_limit && fn.unit) {
+        markResident(*fn.unit);
+      }
+
+      logger.debug("Function '{}' now points to '{}'", name, fn.body);
+    }
+
+    // Restored units are owned by their functions by now
+    restored_units.clear();
+  }
+
+  releaseRetired();
+
+  return llvm::Error::success();
+}
+
+void JIT::releaseRetired() {
+  // Retired code may still be on the stack of a running call
+  if (active_calls) {
+    return;
+  }
+
+  std::vector<std::shared_ptr<CodeUnit>> released;
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    for (auto& unit : retired_units) {
+      // Other functions of the same module may still use it
+      if (unit.use_count() == 1) {
+        released.push_back(std::move(unit));
+      }
+    }
+
+    retired_units.clear();
+  }
+
+  for (auto& unit : released) {
+    // Evicted code is already removed
+    if (unit->rt) {
+      auto key = unit->rt->getKeyUnsafe();
+
+      if (auto err = unit->rt->remove()) {
+        logger.error("Failed to remove retired code of '{}': {}", unit->module, llvm::toString(std::move(err)));
+        continue;
+      }
+
+      engine->getLinkedSizes().untrack(key);
+    }
+
+    forgetRecordedObjects(unit->module);
+
+    if (!unit->spill.empty()) {
+      llvm::sys::fs::remove(unit->spill);
+    }
+
+    std::lock_guard lock(replaceable_mutex);
+    units.erase(unit->module);
+
+    if (unit->resident) {
+      resident_bytes -= unit->size;
+    }
+  }
+}
+
+void JIT::markResident(CodeUnit& unit) {
+  if (unit.resident || !unit.rt) {
+    return;
+  }
+
+  unit.size = engine->getLinkedSizes().get(unit.rt->getKeyUnsafe());
+  unit.resident = true;
+  resident_bytes += unit.size;
+
+  // Code, that runs for long (e.g. main of a program), evicts at next function entry
+  if (resident_bytes > memory_limit) {
+    evict_requested = 1;
+  }
+}
+
+void JIT::safepoint() {
+  // Other calls (on other threads) may be entering code, which frames aren't counted yet
+  if (active_calls > 1) {
+    return;
+  }
+
+  ++epoch;
+  evict();
+}
+
+void JIT::evict() {
+  if (!memory_limit) {
+    return;
+  }
+
+  // Requested again by next linked code, if it doesn't fit
+  evict_requested = 0;
+
+  if (resident_bytes <= memory_limit) {
+    return;
+  }
+
+  struct Candidate {
+    std::shared_ptr<CodeUnit> unit;
+    uint64_t last_used;
+    std::vector<std::pair<std::string, std::string>> functions;
+  };
+
+  std::vector<Candidate> candidates;
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    std::unordered_map<CodeUnit *, size_t> index;
+    std::unordered_set<CodeUnit *> pinned;
+
+    for (auto& [name, fn] : replaceable_functions) {
+      if (!fn.unit) {
+        continue;
+      }
+
+      // Stub of a redefined function is repointed on next lookup, old body stays, until it succeeds.
+      // Code with frames on the stack is still running
+      if (!fn.next_body.empty() || fn.unit->active) {
+        pinned.insert(fn.unit.get());
+        continue;
+      }
+
+      // Code, that was never linked (or is already evicted), takes no memory, code without spilled object can't be relinked
+      if (!fn.unit->resident || fn.unit->spill.empty()) {
+        continue;
+      }
+
+      auto [it, inserted] = index.try_emplace(fn.unit.get(), candidates.size());
+
+      if (inserted) {
+        candidates.push_back({fn.unit, fn.unit->last_used.load(), {}});
+      }
+
+      candidates[it->second].functions.emplace_back(name, fn.body);
+    }
+
+    std::erase_if(candidates, [&](auto& candidate) {
+      return pinned.contains(candidate.unit.get());
+    });
+  }
+
+  // Least recently called first
+  std::sort(candidates.begin(), candidates.end(), [](auto& lhs, auto& rhs) {
+    return lhs.last_used < rhs.last_used;
+  });
+
+  for (auto& candidate : candidates) {
+    if (resident_bytes <= memory_limit) {
+      break;
+    }
+
+    if (auto err = evictUnit(candidate.unit, candidate.functions)) {
+      logger.error("Failed to evict '{}': {}", candidate.unit->module, llvm::toString(std::move(err)));
+      break;
+    }
+
+    logger.debug("Evicted '{}' (last used at {}, epoch {}), {} bytes resident", candidate.unit->module, candidate.last_used, epoch.load(), resident_bytes.load());
+  }
+}
+
+llvm::Error JIT::evictUnit(const std::shared_ptr<CodeUnit>& unit, const std::vector<std::pair<std::string, std::string>>& functions) {
+  // Stubs are repointed before code is removed, unit has no frames on the stack, so nothing runs removed code
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    for (auto& [name, body] : functions) {
+      auto& fn = replaceable_functions[name];
+
+      // Trampoline resolves function by name, so it's reused by every eviction (even of later bodies)
+      if (!fn.trampoline) {
+        auto trampoline = trampolines->getTrampoline();
+
+        if (!trampoline) {
+          return trampoline.takeError();
+        }
+
+        fn.trampoline = *trampoline;
+        trampoline_functions[trampoline->getValue()] = name;
+      }
+
+      if (auto err = stubs_manager->updatePointer(name, fn.trampoline)) {
+        return err;
+      }
+    }
+  }
+
+  auto key = unit->rt->getKeyUnsafe();
+
+  if (auto err = unit->rt->remove()) {
+    return err;
+  }
+
+  engine->getLinkedSizes().untrack(key);
+
+  // Object is added again by a trampoline (see relinkUnit), until then nothing of the unit is kept in memory
+  {
+    std::lock_guard lock(replaceable_mutex);
+    unit->rt = nullptr;
+    unit->resident = false;
+    resident_bytes -= unit->size;
+    unit->size = 0;
+  }
+
+  ++evictions;
+
+  return llvm::Error::success();
+}
+
+llvm::Error JIT::relinkUnit(CodeUnit& unit) {
+  std::lock_guard lock(replaceable_mutex);
+
+  // Other function of the unit was called since eviction
+  if (unit.rt) {
+    return llvm::Error::success();
+  }
+
+  auto object = llvm::MemoryBuffer::getFile(unit.spill, false, false);
+
+  if (!object) {
+    return llvm::createFileError(unit.spill, object.getError());
+  }
+
+  unit.rt = main_jd.createResourceTracker();
+  engine->getLinkedSizes().track(unit.rt->getKeyUnsafe());
+
+  // Slots were removed together with the old tracker
+  auto err = defineUnitSlots(unit);
+
+  if (!err) {
+    err = engine->getObjectLayer().add(unit.rt, std::move(*object));
+  }
+
+  // Unit stays evicted, so next call tries again
+  if (err) {
+    engine->getLinkedSizes().untrack(unit.rt->getKeyUnsafe());
+    llvm::consumeError(unit.rt->remove());
+    unit.rt = nullptr;
+    return err;
+  }
+
+  ++reloads;
+
+  return llvm::Error::success();
+}
+
+void JIT::reload(llvm::orc::ExecutorAddr trampoline, llvm::orc::TrampolinePool::NotifyLandingResolvedFunction on_resolved) {
+  std::string name;
+  std::string body;
+  std::shared_ptr<CodeUnit> unit;
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    auto it = trampoline_functions.find(trampoline.getValue());
+
+    if (it != trampoline_functions.end()) {
+      name = it->second;
+      body = replaceable_functions[name].body;
+      unit = replaceable_functions[name].unit;
+    }
+  }
+
+  if (body.empty()) {
+    on_resolved(llvm::orc::ExecutorAddr::fromPtr(&callThroughError));
+    return;
+  }
+
+  if (unit) {
+    if (auto err = relinkUnit(*unit)) {
+      logger.error("Can't relink '{}': {}", name, llvm::toString(std::move(err)));
+      on_resolved(llvm::orc::ExecutorAddr::fromPtr(&callThroughError));
+      return;
+    }
+  }
+
+  // Lookup links unit's object again (it was re-added from its spilled copy)
+  auto symbol = engine->getSession().lookup({&main_jd}, mangle(body));
+
+  if (!symbol) {
+    logger.error("Can't relink '{}': {}", name, llvm::toString(symbol.takeError()));
+    on_resolved(llvm::orc::ExecutorAddr::fromPtr(&callThroughError));
+    return;
+  }
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+
+    auto& fn = replaceable_functions[name];
+
+    // Otherwise function was redefined meanwhile & its stub already points to the new body
+    if (fn.body == body) {
+      if (auto err = stubs_manager->updatePointer(name, symbol->getAddress())) {
+        logger.error("Can't repoint stub of '{}': {}", name, llvm::toString(std::move(err)));
+      }
+
+      if (fn.unit) {
+        fn.unit->last_used = epoch.load();
+        markResident(*fn.unit);
+      }
+    }
+  }
+
+  on_resolved(symbol->getAddress());
+}
+
+JIT::CallScope::CallScope(JIT& jit) : jit(jit) {
+  ++jit.active_calls;
+  ++jit.epoch;
+}
+
+JIT::CallScope::~CallScope() {
+  if (--jit.active_calls == 0) {
+    jit.releaseRetired();
+    jit.evict();
+  }
+}
+
+llvm::Error JIT::addObject(const std::string& module, std::unique_ptr<llvm::MemoryBuffer> object) {
+  // Functions of units, compiled with memory limit, store into slots of their unit
+  if (referencesSymbol(object->getMemBufferRef(), *mangle(module + LAST_USED_SUFFIX))) {
+    if (!memory_limit) {
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+        std::format("Object '{}' was compiled with JIT memory limit & can only be added with it", module));
+    }
+
+    return addEvictableObject(module, std::move(object));
+  }
+
+  recordObject(module, object->getMemBufferRef());
+
+  return engine->getObjectLayer().add(main_jd, std::move(object));
+}
+
+llvm::Error JIT::addEvictableObject(const std::string& module, std::unique_ptr<llvm::MemoryBuffer> object) {
+  auto unit = std::make_shared<CodeUnit>();
+  unit->module = module;
+  unit->rt = main_jd.createResourceTracker();
+  unit->last_used = epoch.load();
+
+  engine->getLinkedSizes().track(unit->rt->getKeyUnsafe());
+
+  if (auto err = defineUnitSlots(*unit)) {
+    return err;
+  }
+
+  {
+    std::lock_guard lock(replaceable_mutex);
+    units[unit->module] = unit;
+
+    // Held, until its functions point to it (see addReplaceableFunction)
+    restored_units[bodyVersion(unit->module)] = unit;
+  }
+
+  // Spilled & recorded, as if it was compiled by this JIT
+  recordObject(module, object->getMemBufferRef());
+
+  return engine->getObjectLayer().add(unit->rt, std::move(object));
+}
+
+llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> JIT::compileObject(llvm::Module& module) {
+  return (*object_compiler)(module);
+}
+
+llvm::Error JIT::addTieredModule(llvm::orc::ThreadSafeModule tsm) {
+  auto err = tsm.withModuleDo([&](llvm::Module& module) -> llvm::Error {
+    std::vector<llvm::Function *> defined;
+
+    // Local functions (e.g. target clones) are only called from within module, so they don't need stubs
+    for (auto& fn : module) {
+      if (!fn.isDeclaration() && !fn.hasLocalLinkage()) {
+        defined.push_back(&fn);
+      }
+    }
+
+    // Uninstrumented copies are taken before any function is instrumented
+    std::vector<std::unique_ptr<llvm::Module>> originals;
+    for (size_t i = 0; i < defined.size(); ++i) {
+      originals.push_back(llvm::CloneModule(module));
+    }
+
+    for (size_t i = 0; i < defined.size(); ++i) {
+      auto fn = defined[i];
+      auto name = fn->getName().str();
+
+      size_t id;
+
+      {
+        std::lock_guard lock(tiered_mutex);
+        id = tiered_functions.size();
+        auto& tiered = tiered_functions.emplace_back();
+        tiered.name = name;
+        tiered.original = llvm::orc::ThreadSafeModule(std::move(originals[i]), tsm.getContext());
+      }
+
+      if (auto err = createFunctionStub(name)) {
+        return err;
+      }
+
+      fn->setName(name + TIER_BASELINE_SUFFIX);
+      instrumentBaseline(module, *fn, name, id, tier_threshold);
+
+      std::lock_guard lock(tiered_mutex);
+      pending_baselines.push_back(id);
+    }
+
+    return llvm::Error::success();
+  });
+
+  if (err) {
+    return err;
+  }
+
+  return addModule(std::move(tsm));
+}
+
+llvm::Expected<llvm::orc::ExecutorSymbolDef> JIT::lookup(llvm::StringRef name) {
+  if (auto err = resolveBaselines()) {
+    return std::move(err);
+  }
+
+  if (auto err = resolveReplacements()) {
+    return std::move(err);
+  }
+
+  return engine->getSession().lookup({&main_jd}, name);
+}
+
+void JIT::setObjectRecording(bool enabled) {
+  record_objects = enabled;
+}
+
+bool JIT::isObjectRecording() const {
+  return record_objects;
+}
+
+std::vector<std::pair<std::string, llvm::MemoryBufferRef>> JIT::getRecordedObjects() {
+  std::vector<std::pair<std::string, llvm::MemoryBufferRef>> result;
+
+  std::lock_guard lock(recorded_mutex);
+
+  for (auto& recorded : recorded_objects) {
+    result.emplace_back(recorded.module, recorded.object->getMemBufferRef());
+  }
+
+  return result;
+}
+
+std::string JIT::getTargetTriple() const {
+  return engine->getSession().getExecutorProcessControl().getTargetTriple().str();
+}
+
+std::string JIT::getTargetCPU() const {
+  return target_cpu;
+}
+
+void JIT::forgetRecordedObjects(const std::string& module) {
+  std::lock_guard lock(recorded_mutex);
+
+  std::erase_if(recorded_objects, [&](auto& recorded) {
+    return recorded.module == module;
+  });
+}
+
+void JIT::recordObject(const std::string& module, llvm::MemoryBufferRef object) {
+  // Evictable code spills its object to disk, to be relinked from
+  if (memory_limit) {
+    std::shared_ptr<CodeUnit> unit;
+    std::string path;
+
+    {
+      std::lock_guard lock(replaceable_mutex);
+
+      if (auto it = units.find(module); it != units.end()) {
+        unit = it->second.lock();
+        path = std::format("{}/{}.o", spill_directory, ++spill_counter);
+      }
+    }
+
+    if (unit) {
+      if (auto err = writeObject(path, object)) {
+        logger.error("Can't spill object of '{}', it won't be evicted: {}", module, llvm::toString(std::move(err)));
+      } else {
+        std::lock_guard lock(replaceable_mutex);
+        unit->spill = std::move(path);
+      }
+    }
+  }
+
+  if (!record_objects) {
+    return;
+  }
+
+  // Compiler/object layer own the original buffer, so a copy is kept
+  auto copy = llvm::MemoryBuffer::getMemBufferCopy(object.getBuffer(), object.getBufferIdentifier());
+
+  std::lock_guard lock(recorded_mutex);
+  recorded_objects.push_back({module, std::move(copy)});
+}
+
+llvm::Error JIT::resolveBaselines() {
+  std::vector<size_t> pending;
+
+  {
+    std::lock_guard lock(tiered_mutex);
+    pending.swap(pending_baselines);
+  }
+
+  if (pending.empty()) {
+    return llvm::Error::success();
+  }
+
+  llvm::orc::SymbolLookupSet lookup_set;
+
+  for (auto id : pending) {
+    auto& name = tiered_functions[id].name;
+    lookup_set.add(mangle(name + TIER_BASELINE_SUFFIX));
+    lookup_set.add(mangle(name + TIER_COUNTER_SUFFIX));
+  }
+
+  // Single lookup - all baseline modules are materialized at once
+  auto symbols = engine->getSession().lookup(llvm::orc::makeJITDylibSearchOrder({&main_jd}), std::move(lookup_set));
+
+  if (!symbols) {
+    return symbols.takeError();
+  }
+
+  for (auto id : pending) {
+    auto& fn = tiered_functions[id];
+
+    fn.counter = (*symbols)[mangle(fn.name + TIER_COUNTER_SUFFIX)].getAddress().toPtr<uint64_t *>();
+
+    if (auto err = stubs_manager->updatePointer(fn.name, (*symbols)[mangle(fn.name + TIER_BASELINE_SUFFIX)].getAddress())) {
+      return err;
+    }
+  }
+
+  return llvm::Error::success();
+}
+
+void JIT::tierUp(size_t id) {
+  TieredFunction * fn;
+
+  {
+    std::lock_guard lock(tiered_mutex);
+
+    if (id >= tiered_functions.size()) {
+      return;
+    }
+
+    fn = &tiered_functions[id];
+  }
+
+  // Baseline code keeps calling tierUp until stub is repointed, only the first call schedules compilation
+  auto expected = Tier::BASELINE;
+  if (!fn->tier.compare_exchange_strong(expected, Tier::COMPILING)) {
+    return;
+  }
+
+  tier_tasks->async([this, fn]() {
+    if (auto err = recompile(*fn)) {
+      fn->tier = Tier::FAILED;
+      logger.error("Optimized compilation of '{}' failed: {}", fn->name, llvm::toString(std::move(err)));
+    }
+  });
+}
+
+llvm::Error JIT::recompile(TieredFunction& fn) {
+  util::Timer timer;
+
+  auto optimized_name = fn.name + TIER_OPTIMIZED_SUFFIX;
+
+  auto tsm = fn.original.withModuleDo([&](llvm::Module& original) {
+    auto module = llvm::CloneModule(original);
+
+    // Other functions of the module are called through their stubs
+    for (auto& other : *module) {
+      if (!other.isDeclaration() && !other.hasLocalLinkage() && other.getName() != fn.name) {
+        other.deleteBody();
+      }
+    }
+
+    module->getFunction(fn.name)->setName(optimized_name);
+
+    optimizeModule(*module);
+
+    return llvm::orc::ThreadSafeModule(std::move(module), fn.original.getContext());
+  });
+
+  fn.rt = main_jd.createResourceTracker();
+
+  if (auto err = optimized_layer->add(fn.rt, std::move(tsm))) {
+    return err;
+  }
+
+  auto symbol = engine->getSession().lookup({&main_jd}, mangle(optimized_name));
+
+  if (!symbol) {
+    return symbol.takeError();
+  }
+
+  if (auto err = stubs_manager->updatePointer(fn.name, symbol->getAddress())) {
+    return err;
+  }
+
+  fn.compile_ms = timer.elapsedMs();
+  fn.tier = Tier::OPTIMIZED;
+
+  logger.debug("Function '{}' tiered up in {:.3f}ms", fn.name, fn.compile_ms.load());
+
+  return llvm::Error::success();
+}
+
+std::vector<JIT::TierState> JIT::getTierStates() {
+  std::vector<TierState> result;
+
+  std::lock_guard lock(tiered_mutex);
+
+  for (auto& fn : tiered_functions) {
+    uint64_t calls = fn.counter ? std::atomic_ref<uint64_t>(*fn.counter).load(std::memory_order_relaxed) : 0;
+    result.push_back({fn.name, fn.tier.load(), calls, fn.compile_ms.load()});
+  }
+
+  return result;
+}
+
+std::string JIT::tierToString(Tier tier) {
+  switch (tier) {
+    case Tier::BASELINE:  return "baseline";
+    case Tier::COMPILING: return "compiling";
+    case Tier::OPTIMIZED: return "optimized";
+    case Tier::FAILED:    return "failed";
+    default:              return "unknown";
+  }
 }
 
 void JIT::dump() {
   util::RawStreamCollector collector;
-  session->dump(*collector.stream());
+  engine->getSession().dump(*collector.stream());
   logger.debug("Dump of ExecutionSession:\n{}", collector.string());
 }
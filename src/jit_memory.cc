@@ -0,0 +1,571 @@
+#include "xcc/jit_memory.h"
+#include "xcc/exceptions.h"
+#include "xcc/util/log.h"
+
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/Support/Memory.h>
+#include <llvm/Support/Process.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <iterator>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace xcc::codegen;
+
+static auto logger = xcc::util::log::Logger("JIT_MEMORY");
+
+static size_t kindIndex(SectionKind kind) {
+  return static_cast<size_t>(kind);
+}
+
+static size_t alignTo(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+const char * xcc::codegen::sectionKindName(SectionKind kind) {
+  switch (kind) {
+    case SectionKind::CODE:
+      return "code";
+    case SectionKind::RODATA:
+      return "rodata";
+    case SectionKind::RWDATA:
+      return "rwdata";
+  }
+
+  return "<?>";
+}
+
+void MemoryStats::Counter::add(size_t bytes) {
+  auto value = current += bytes;
+  auto previous = peak.load();
+
+  while (value > previous && !peak.compare_exchange_weak(previous, value)) {}
+}
+
+void MemoryStats::Counter::remove(size_t bytes) {
+  current -= bytes;
+}
+
+void MemoryStats::addAllocated(SectionKind kind, size_t bytes) {
+  allocated[kindIndex(kind)].add(bytes);
+}
+
+void MemoryStats::removeAllocated(SectionKind kind, size_t bytes) {
+  allocated[kindIndex(kind)].remove(bytes);
+}
+
+void MemoryStats::addUsed(SectionKind kind, size_t bytes) {
+  used[kindIndex(kind)].add(bytes);
+}
+
+void MemoryStats::removeUsed(SectionKind kind, size_t bytes) {
+  used[kindIndex(kind)].remove(bytes);
+}
+
+size_t MemoryStats::getAllocated(SectionKind kind) const {
+  return allocated[kindIndex(kind)].current;
+}
+
+size_t MemoryStats::getUsed(SectionKind kind) const {
+  return used[kindIndex(kind)].current;
+}
+
+size_t MemoryStats::getTotalUsed() const {
+  size_t total = 0;
+
+  for (auto& counter : used) {
+    total += counter.current;
+  }
+
+  return total;
+}
+
+void MemoryStats::report() const {
+  for (size_t i = 0; i < SECTION_KIND_COUNT; ++i) {
+    size_t peak_allocated = allocated[i].peak;
+    size_t peak_used = used[i].peak;
+
+    logger.info("JIT memory '{}': {} bytes allocated, {} bytes used at peak ({:.1f}% utilization)",
+      sectionKindName(static_cast<SectionKind>(i)), peak_allocated, peak_used,
+      peak_allocated ? 100.0 * double(peak_used) / double(peak_allocated) : 0.0);
+  }
+}
+
+MemoryPool::MemoryPool(size_t slab_size, bool huge_pages, MemoryStats& stats)
+  : slab_size(slab_size), huge_pages(huge_pages), stats(stats) {}
+
+MemoryPool::~MemoryPool() {
+#if defined(__linux__)
+  for (size_t i = 0; i < SECTION_KIND_COUNT; ++i) {
+    for (auto& slab : slabs[i]) {
+      if (slab.target != slab.working) {
+        munmap(slab.target, slab.size);
+      }
+
+      munmap(slab.working, slab.size);
+      stats.removeAllocated(static_cast<SectionKind>(i), slab.size);
+    }
+  }
+#endif
+}
+
+bool MemoryPool::isSupported() {
+#if defined(__linux__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+MemoryPool::Block MemoryPool::allocate(SectionKind kind, size_t size, size_t alignment) {
+  size = std::max<size_t>(size, 1);
+  alignment = std::max<size_t>(alignment, 1);
+
+  std::lock_guard lock(mutex);
+
+  auto& kind_slabs = slabs[kindIndex(kind)];
+  Slab * slab = nullptr;
+  std::optional<size_t> offset;
+
+  for (auto& candidate : kind_slabs) {
+    if ((offset = fit(candidate, size, alignment))) {
+      slab = &candidate;
+      break;
+    }
+  }
+
+  if (!slab) {
+    slab = &map(kind, size + alignment);
+    offset = fit(*slab, size, alignment);
+  }
+
+  stats.addUsed(kind, size);
+
+  return {slab->working + *offset, slab->target + *offset, size, kind};
+}
+
+void MemoryPool::release(const Block& block) {
+  std::lock_guard lock(mutex);
+
+  for (auto& slab : slabs[kindIndex(block.kind)]) {
+    if (block.working < slab.working || block.working >= slab.working + slab.size) {
+      continue;
+    }
+
+    size_t offset = block.working - slab.working;
+    size_t size = block.size;
+
+    auto next = slab.free.lower_bound(offset);
+
+    if (next != slab.free.end() && offset + size == next->first) {
+      size += next->second;
+      next = slab.free.erase(next);
+    }
+
+    if (next != slab.free.begin()) {
+      auto prev = std::prev(next);
+
+      if (prev->first + prev->second == offset) {
+        prev->second += size;
+        stats.removeUsed(block.kind, block.size);
+        return;
+      }
+    }
+
+    slab.free.emplace(offset, size);
+    stats.removeUsed(block.kind, block.size);
+    return;
+  }
+
+  logger.error("Released block {} doesn't belong to any slab", static_cast<void *>(block.working));
+}
+
+std::optional<size_t> MemoryPool::fit(Slab& slab, size_t size, size_t alignment) {
+  for (auto it = slab.free.begin(); it != slab.free.end(); ++it) {
+    auto [offset, free_size] = *it;
+
+    // Alignment is relative to final view (the same within a page for both views)
+    auto address = reinterpret_cast<uintptr_t>(slab.target) + offset;
+    auto aligned = alignTo(address, alignment) - reinterpret_cast<uintptr_t>(slab.target);
+
+    if (aligned + size > offset + free_size) {
+      continue;
+    }
+
+    slab.free.erase(it);
+
+    if (aligned > offset) {
+      slab.free.emplace(offset, aligned - offset);
+    }
+
+    if (aligned + size < offset + free_size) {
+      slab.free.emplace(aligned + size, offset + free_size - aligned - size);
+    }
+
+    return aligned;
+  }
+
+  return std::nullopt;
+}
+
+uint8_t * MemoryPool::mapView(int fd, size_t size, int protection, uint8_t * address) {
+#if defined(__linux__)
+  auto flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED;
+
+  if (fd < 0 && huge_pages && !huge_fallback) {
+    auto result = mmap(address, size, protection, flags | MAP_HUGETLB, -1, 0);
+
+    if (result != MAP_FAILED) {
+      return static_cast<uint8_t *>(result);
+    }
+
+    logger.warn("Can't map huge pages ({}), using transparent huge pages", std::strerror(errno));
+    huge_fallback = true;
+  }
+
+  auto result = mmap(address, size, protection, flags, fd, 0);
+
+  if (result == MAP_FAILED) {
+    throw CodegenException(std::format("Can't map {} bytes of JIT memory: {}", size, std::strerror(errno)));
+  }
+
+  if (huge_pages && huge_fallback) {
+    madvise(result, size, MADV_HUGEPAGE);
+  }
+
+  return static_cast<uint8_t *>(result);
+#else
+  throw CodegenException("Pooled JIT memory isn't supported on this system");
+#endif
+}
+
+MemoryPool::Slab& MemoryPool::map(SectionKind kind, size_t size) {
+#if defined(__linux__)
+  size_t page_size = huge_pages ? HUGE_PAGE_SIZE : llvm::sys::Process::getPageSizeEstimate();
+  size = alignTo(std::max(size, slab_size), page_size);
+
+  Slab slab {nullptr, nullptr, size, {}};
+
+  if (kind == SectionKind::RWDATA) {
+    slab.working = slab.target = mapView(-1, size, PROT_READ | PROT_WRITE, hint);
+  } else {
+    int fd = -1;
+
+    if (huge_pages && !huge_fallback) {
+      fd = memfd_create("xcc-jit", MFD_CLOEXEC | MFD_HUGETLB);
+
+      // Huge pages of hugetlbfs are reserved on ftruncate
+      if (fd >= 0 && ftruncate(fd, size) != 0) {
+        close(fd);
+        fd = -1;
+      }
+
+      if (fd < 0) {
+        logger.warn("Can't allocate huge pages ({}), using transparent huge pages", std::strerror(errno));
+        huge_fallback = true;
+      }
+    }
+
+    if (fd < 0) {
+      fd = memfd_create("xcc-jit", MFD_CLOEXEC);
+
+      if (fd < 0 || ftruncate(fd, size) != 0) {
+        auto error = std::strerror(errno);
+
+        if (fd >= 0) {
+          close(fd);
+        }
+
+        throw CodegenException(std::format("Can't create JIT memory slab: {}", error));
+      }
+    }
+
+    try {
+      slab.working = mapView(fd, size, PROT_READ | PROT_WRITE, nullptr);
+      slab.target = mapView(fd, size, kind == SectionKind::CODE ? PROT_READ | PROT_EXEC : PROT_READ, hint);
+    } catch (...) {
+      if (slab.working) {
+        munmap(slab.working, size);
+      }
+
+      close(fd);
+      throw;
+    }
+
+    // Mappings keep memory alive
+    close(fd);
+  }
+
+  hint = slab.target + size;
+
+  slab.free.emplace(0, size);
+  stats.addAllocated(kind, size);
+
+  logger.debug("Mapped {} slab of {} bytes at {}", sectionKindName(kind), size, static_cast<void *>(slab.target));
+
+  auto& kind_slabs = slabs[kindIndex(kind)];
+  kind_slabs.push_back(std::move(slab));
+
+  return kind_slabs.back();
+#else
+  throw CodegenException("Pooled JIT memory isn't supported on this system");
+#endif
+}
+
+PooledMemoryManager::PooledMemoryManager(MemoryPool& pool) : pool(pool) {}
+
+PooledMemoryManager::~PooledMemoryManager() {
+  deregisterEHFrames();
+
+  for (auto& block : blocks) {
+    pool.release(block);
+  }
+}
+
+uint8_t * PooledMemoryManager::allocate(SectionKind kind, uintptr_t size, unsigned alignment) {
+  auto block = pool.allocate(kind, size, alignment);
+  blocks.push_back(block);
+  return block.working;
+}
+
+uint8_t * PooledMemoryManager::allocateCodeSection(uintptr_t size, unsigned alignment, unsigned, llvm::StringRef) {
+  return allocate(SectionKind::CODE, size, alignment);
+}
+
+uint8_t * PooledMemoryManager::allocateDataSection(uintptr_t size, unsigned alignment, unsigned, llvm::StringRef, bool read_only) {
+  return allocate(read_only ? SectionKind::RODATA : SectionKind::RWDATA, size, alignment);
+}
+
+void PooledMemoryManager::notifyObjectLoaded(llvm::RuntimeDyld& dyld, const llvm::object::ObjectFile&) {
+  for (auto& block : blocks) {
+    if (block.working != block.target) {
+      dyld.mapSectionAddress(block.working, reinterpret_cast<uint64_t>(block.target));
+    }
+  }
+}
+
+void PooledMemoryManager::registerEHFrames(uint8_t *, uint64_t load_address, size_t size) {
+  // Unwinder reads frames (with relocations resolved against final view) where code runs
+  auto address = reinterpret_cast<uint8_t *>(load_address);
+
+  registerEHFramesInProcess(address, size);
+  eh_frames.emplace_back(address, size);
+}
+
+void PooledMemoryManager::deregisterEHFrames() {
+  for (auto& [address, size] : eh_frames) {
+    deregisterEHFramesInProcess(address, size);
+  }
+
+  eh_frames.clear();
+}
+
+bool PooledMemoryManager::finalizeMemory(std::string *) {
+  // Protection of final views never changes, code was written through another view
+  for (auto& block : blocks) {
+    if (block.kind == SectionKind::CODE) {
+      llvm::sys::Memory::InvalidateInstructionCache(block.target, block.size);
+    }
+  }
+
+  return false;
+}
+
+void HugePageMemoryMapper::reserve(size_t size, OnReservedFunction on_reserved) {
+  InProcessMemoryMapper::reserve(size, [on_reserved = std::move(on_reserved)](llvm::Expected<llvm::orc::ExecutorAddrRange> range) mutable {
+#if defined(__linux__)
+    if (range) {
+      madvise(range->Start.toPtr<void *>(), range->size(), MADV_HUGEPAGE);
+    }
+#endif
+
+    on_reserved(std::move(range));
+  });
+}
+
+MemoryStatsPlugin::MemoryStatsPlugin(MemoryStats& stats, size_t page_size) : stats(stats), page_size(page_size) {}
+
+void MemoryStatsPlugin::modifyPassConfig(llvm::orc::MaterializationResponsibility& mr, llvm::jitlink::LinkGraph&, llvm::jitlink::PassConfiguration& config) {
+  config.PostAllocationPasses.push_back([this, &mr](llvm::jitlink::LinkGraph& graph) -> llvm::Error {
+    Usage usage {};
+
+    for (auto& section : graph.sections()) {
+      auto protection = section.getMemProt();
+
+      auto kind = (protection & llvm::orc::MemProt::Exec) != llvm::orc::MemProt::None ? SectionKind::CODE
+          : (protection & llvm::orc::MemProt::Write) != llvm::orc::MemProt::None ? SectionKind::RWDATA
+          : SectionKind::RODATA;
+
+      for (auto * block : section.blocks()) {
+        usage[kindIndex(kind)].second += block->getSize();
+      }
+    }
+
+    // Segments of a graph (one per protection) start at page boundary
+    for (auto& [allocated, used] : usage) {
+      allocated = alignTo(used, page_size);
+    }
+
+    return mr.withResourceKeyDo([&](llvm::orc::ResourceKey key) {
+      account(key, usage);
+    });
+  });
+}
+
+void MemoryStatsPlugin::account(llvm::orc::ResourceKey key, const Usage& usage) {
+  std::lock_guard lock(mutex);
+
+  auto& total = resources[key];
+
+  for (size_t i = 0; i < SECTION_KIND_COUNT; ++i) {
+    total[i].first += usage[i].first;
+    total[i].second += usage[i].second;
+
+    stats.addAllocated(static_cast<SectionKind>(i), usage[i].first);
+    stats.addUsed(static_cast<SectionKind>(i), usage[i].second);
+  }
+}
+
+llvm::Error MemoryStatsPlugin::notifyFailed(llvm::orc::MaterializationResponsibility&) {
+  return llvm::Error::success();
+}
+
+llvm::Error MemoryStatsPlugin::notifyRemovingResources(llvm::orc::JITDylib&, llvm::orc::ResourceKey key) {
+  std::lock_guard lock(mutex);
+
+  auto it = resources.find(key);
+
+  if (it == resources.end()) {
+    return llvm::Error::success();
+  }
+
+  for (size_t i = 0; i < SECTION_KIND_COUNT; ++i) {
+    stats.removeAllocated(static_cast<SectionKind>(i), it->second[i].first);
+    stats.removeUsed(static_cast<SectionKind>(i), it->second[i].second);
+  }
+
+  resources.erase(it);
+
+  return llvm::Error::success();
+}
+
+void MemoryStatsPlugin::notifyTransferringResources(llvm::orc::JITDylib&, llvm::orc::ResourceKey dst, llvm::orc::ResourceKey src) {
+  std::lock_guard lock(mutex);
+
+  auto it = resources.find(src);
+
+  if (it == resources.end()) {
+    return;
+  }
+
+  auto usage = it->second;
+  resources.erase(it);
+
+  auto& total = resources[dst];
+
+  for (size_t i = 0; i < SECTION_KIND_COUNT; ++i) {
+    total[i].first += usage[i].first;
+    total[i].second += usage[i].second;
+  }
+}
+
+void LinkedSizes::track(llvm::orc::ResourceKey key) {
+  std::lock_guard lock(mutex);
+  sizes.try_emplace(key, 0);
+}
+
+void LinkedSizes::untrack(llvm::orc::ResourceKey key) {
+  std::lock_guard lock(mutex);
+  sizes.erase(key);
+}
+
+void LinkedSizes::add(llvm::orc::ResourceKey key, size_t bytes) {
+  std::lock_guard lock(mutex);
+
+  if (auto it = sizes.find(key); it != sizes.end()) {
+    it->second += bytes;
+  }
+}
+
+void LinkedSizes::transfer(llvm::orc::ResourceKey dst, llvm::orc::ResourceKey src) {
+  std::lock_guard lock(mutex);
+
+  auto it = sizes.find(src);
+
+  if (it == sizes.end()) {
+    return;
+  }
+
+  auto bytes = it->second;
+  sizes.erase(it);
+
+  if (auto dst_it = sizes.find(dst); dst_it != sizes.end()) {
+    dst_it->second += bytes;
+  }
+}
+
+size_t LinkedSizes::get(llvm::orc::ResourceKey key) {
+  std::lock_guard lock(mutex);
+
+  auto it = sizes.find(key);
+
+  return it != sizes.end() ? it->second : 0;
+}
+
+void LinkedSizes::notifyLoaded(llvm::orc::MaterializationResponsibility& mr, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info) {
+  size_t bytes = 0;
+
+  // Only allocated sections get a load address
+  for (auto& section : object.sections()) {
+    if (info.getSectionLoadAddress(section)) {
+      bytes += section.getSize();
+    }
+  }
+
+  llvm::cantFail(mr.withResourceKeyDo([&](llvm::orc::ResourceKey key) {
+    add(key, bytes);
+  }));
+}
+
+LinkedSizePlugin::LinkedSizePlugin(LinkedSizes& sizes) : sizes(sizes) {}
+
+void LinkedSizePlugin::modifyPassConfig(llvm::orc::MaterializationResponsibility& mr, llvm::jitlink::LinkGraph&, llvm::jitlink::PassConfiguration& config) {
+  config.PostAllocationPasses.push_back([this, &mr](llvm::jitlink::LinkGraph& graph) -> llvm::Error {
+    size_t bytes = 0;
+
+    for (auto& section : graph.sections()) {
+      // Debug sections aren't allocated in target memory
+      if (section.getMemLifetime() == llvm::orc::MemLifetime::NoAlloc) {
+        continue;
+      }
+
+      for (auto * block : section.blocks()) {
+        bytes += block->getSize();
+      }
+    }
+
+    return mr.withResourceKeyDo([&](llvm::orc::ResourceKey key) {
+      sizes.add(key, bytes);
+    });
+  });
+}
+
+llvm::Error LinkedSizePlugin::notifyFailed(llvm::orc::MaterializationResponsibility&) {
+  return llvm::Error::success();
+}
+
+llvm::Error LinkedSizePlugin::notifyRemovingResources(llvm::orc::JITDylib&, llvm::orc::ResourceKey key) {
+  sizes.untrack(key);
+  return llvm::Error::success();
+}
+
+void LinkedSizePlugin::notifyTransferringResources(llvm::orc::JITDylib&, llvm::orc::ResourceKey dst, llvm::orc::ResourceKey src) {
+  sizes.transfer(dst, src);
+}
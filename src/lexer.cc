@@ -17,6 +17,7 @@ static const PrefixTree<TokenType> s_token_patterns(TOKEN_EOF, {
     {"return",  TOKEN_RETURN},
     {"as",      TOKEN_AS},
     {"self",    TOKEN_SELF},
+    {"import",  TOKEN_IMPORT},
     {"{",       TOKEN_LEFT_BRACE},
     {"}",       TOKEN_RIGHT_BRACE},
     {"[",       TOKEN_LEFT_SQUARE_BRACE},
@@ -29,6 +30,7 @@ static const PrefixTree<TokenType> s_token_patterns(TOKEN_EOF, {
     {":",       TOKEN_COLON},
     {";",       TOKEN_SEMICOLON},
     {"->",      TOKEN_RIGHT_ARROW},
+    {"#[",      TOKEN_ATTRIBUTE_START},
     {"=",       TOKEN_EQUALS},
     {"+=",      TOKEN_ADD_EQUALS},
     {"-=",      TOKEN_MIN_EQUALS},
@@ -72,6 +74,7 @@ static const std::unordered_map<TokenType, std::string> s_token_type_name_map {
     {TOKEN_RETURN,              "TOKEN_RETURN"},
     {TOKEN_AS,                  "TOKEN_AS"},
     {TOKEN_SELF,                "TOKEN_SELF"},
+    {TOKEN_IMPORT,              "TOKEN_IMPORT"},
     {TOKEN_LEFT_BRACE,          "TOKEN_LEFT_BRACE"},
     {TOKEN_RIGHT_BRACE,         "TOKEN_RIGHT_BRACE"},
     {TOKEN_LEFT_SQUARE_BRACE,   "TOKEN_LEFT_SQUARE_BRACE"},
@@ -84,6 +87,7 @@ static const std::unordered_map<TokenType, std::string> s_token_type_name_map {
     {TOKEN_3_DOTS,              "TOKEN_3_DOTS"},
     {TOKEN_SEMICOLON,           "TOKEN_SEMICOLON"},
     {TOKEN_RIGHT_ARROW,         "TOKEN_RIGHT_ARROW"},
+    {TOKEN_ATTRIBUTE_START,     "TOKEN_ATTRIBUTE_START"},
     {TOKEN_EQUALS,              "TOKEN_EQUALS"},
     {TOKEN_ADD_EQUALS,          "TOKEN_ADD_EQUALS"},
     {TOKEN_MIN_EQUALS,          "TOKEN_MIN_EQUALS"},
@@ -127,6 +131,7 @@ static const std::unordered_map<TokenType, std::string> s_token_type_value_map {
     {TOKEN_RETURN,              "return"},
     {TOKEN_AS,                  "as"},
     {TOKEN_SELF,                "self"},
+    {TOKEN_IMPORT,              "import"},
     {TOKEN_LEFT_BRACE,          "{"},
     {TOKEN_RIGHT_BRACE,         "}"},
     {TOKEN_LEFT_SQUARE_BRACE,   "["},
@@ -139,6 +144,7 @@ static const std::unordered_map<TokenType, std::string> s_token_type_value_map {
     {TOKEN_3_DOTS,              "..."},
     {TOKEN_SEMICOLON,           ";"},
     {TOKEN_RIGHT_ARROW,         "->"},
+    {TOKEN_ATTRIBUTE_START,     "#["},
     {TOKEN_EQUALS,              "="},
     {TOKEN_ADD_EQUALS,          "+="},
     {TOKEN_MIN_EQUALS,          "-="},
@@ -208,12 +214,17 @@ bool Lexer::check(char expected) {
   return current() == expected;
 }
 
+bool Lexer::isComment() {
+  // `#[` starts an attribute, not a comment
+  return check('#') && (current_index + 1 >= text.size() || text[current_index + 1] != '[');
+}
+
 void Lexer::skipWhitespace() {
   while (check(' ')
       || check('\n')
       || check('\t')
       || check('\r')
-      || check('#')
+      || isComment()
   ) {
     if (isAtEnd()) {
       return;
@@ -223,7 +234,7 @@ void Lexer::skipWhitespace() {
       ++line;
     }
 
-    if (check('#')) {
+    if (isComment()) {
       while (!isAtEnd() && !check('\n')) {
         consume();
       }
@@ -3,7 +3,14 @@
 #include <sstream>
 
 #include "xcc/xcc.h"
+#include "xcc/batch.h"
+#include "xcc/prelude.h"
+#include "xcc/server.h"
+#include "xcc/snapshot.h"
+#include "xcc/watch.h"
+#include "xcc/symbols.h"
 #include "xcc/util/string.h"
+#include "xcc/util/timer.h"
 
 static auto logger = xcc::util::log::Logger("MAIN");
 
@@ -35,15 +42,109 @@ extern "C" [[maybe_unused]] int32_t xcc_puts(int8_t * s) {
 #endif
 
 int main(int argc, char ** argv) {
+  xcc::Options options;
+
+  try {
+    options = xcc::Options::parse(argc, argv);
+  } catch (std::exception& e) {
+    logger.fatal("{}", e.what());
+    logger.print("{}", xcc::Options::usage(argv[0]));
+    return 1;
+  }
+
+  if (options.help) {
+    logger.print("{}", xcc::Options::usage(argv[0]));
+    return 0;
+  }
+
+  // Prelude is built from declarations only, nothing is compiled
+  if (options.emit == xcc::Emit::PRELUDE) {
+    std::ifstream fs(options.input);
+
+    if (!fs.is_open()) {
+      logger.fatal("Failed to open file '{}'", options.input);
+      return 1;
+    }
+
+    std::stringstream ss;
+    ss << fs.rdbuf();
+
+    try {
+      auto prelude = xcc::codegen::Prelude::build(ss.str());
+      prelude.write(options.output);
+      logger.info("Prelude of {} structs & {} functions written to '{}'", prelude.getStructCount(), prelude.getFunctionCount(), options.output);
+    } catch (std::exception& e) {
+      logger.fatal("{}", e.what());
+      return 1;
+    }
+
+    return 0;
+  }
+
   xcc::init();
 
-  auto globalContext = xcc::codegen::GlobalContext::create();
+#if USE_LEGACY_XCC_EXTERN_FUNCTIONS
+  auto& symbols = xcc::codegen::SymbolRegistry::instance();
+  symbols.add("xcc_putc", (void *) &xcc_putc, "fn xcc_putc(c: i32): i32");
+  symbols.add("xcc_putd", (void *) &xcc_putd, "fn xcc_putd(i: i32): i32");
+  symbols.add("xcc_putud", (void *) &xcc_putud, "fn xcc_putud(i: u32): i32");
+  symbols.add("xcc_putux", (void *) &xcc_putux, "fn xcc_putux(i: u32): i32");
+  symbols.add("xcc_puts", (void *) &xcc_puts, "fn xcc_puts(s: i8*): i32");
+#endif
+
+  if (!options.server.empty()) {
+    try {
+      xcc::Server::create(options)->run();
+    } catch (std::exception& e) {
+      logger.fatal("{}", e.what());
+    }
+    return 1;
+  }
+
+  if (options.batch) {
+    try {
+      return xcc::Batch::create(options)->run();
+    } catch (std::exception& e) {
+      logger.fatal("{}", e.what());
+    }
+    return 1;
+  }
+
+  if (options.sessions) {
+    std::ifstream fs(options.input);
+
+    if (!fs.is_open()) {
+      logger.fatal("Failed to open file '{}'", options.input);
+      return 1;
+    }
+
+    std::stringstream ss;
+    ss << fs.rdbuf();
+
+    try {
+      return xcc::runSessions(options, ss.str(), options.sessions) ? 1 : 0;
+    } catch (std::exception& e) {
+      logger.fatal("{}", e.what());
+    }
+    return 1;
+  }
+
+  // Functions can be redefined in REPL
+  if (options.input.empty()) {
+    options.hot_swap = true;
+  }
+
+  auto globalContext = xcc::codegen::GlobalContext::create(options);
+
+  if (options.watch) {
+    xcc::Watcher::create(globalContext, options.input)->run();
+  }
 
-  if (argc == 2) {
-    std::ifstream fs(argv[1]);
+  if (!options.input.empty()) {
+    std::ifstream fs(options.input);
 
     if (!fs.is_open()) {
-      logger.fatal("Failed to open file '{}'", argv[1]);
+      logger.fatal("Failed to open file '{}'", options.input);
       return 1;
     }
 
@@ -53,7 +154,7 @@ int main(int argc, char ** argv) {
 #if USE_CATCH_EXCEPTIONS
     try {
 #endif
-      xcc::run(globalContext, ss.str(), false);
+      xcc::run(globalContext, ss.str(), false, options.input);
 #if USE_CATCH_EXCEPTIONS
     } catch (std::exception& e) {
       logger.fatal("{}", e.what());
@@ -66,6 +167,9 @@ int main(int argc, char ** argv) {
 
   logger.print("xcc (experimental) repl {} by maxrt\n", xcc::getVersion());
 
+  // Compiled objects are only kept for /save, if snapshots were requested
+  globalContext->getJIT().setObjectRecording(options.snapshots);
+
   while (true) {
     logger.print("-> ");
 
@@ -94,11 +198,53 @@ int main(int argc, char ** argv) {
         logger.print("/help or /h - Prints this message\n");
         logger.print("/quit or /q - Exits from REPL\n");
         logger.print("/list or /l - List global function symbols\n");
+        logger.print("/symbols or /s - List resolved host symbols\n");
+        logger.print("/save FILE - Saves session (types, functions, globals & compiled code), requires --snapshots\n");
+        logger.print("/load FILE - Replaces session with a saved one\n");
+        continue;
+      }
+
+      if (command == "symbols" || command == "s") {
+        for (auto& [name, symbol] : xcc::codegen::SymbolRegistry::instance().list()) {
+          logger.print("{:<24} {:<18} {}\n", name, symbol.address, symbol.registered ? symbol.signature : "<dlsym>");
+        }
+        continue;
+      }
+
+      if (command == "save" || command == "load") {
+        if (tokens.size() != 2) {
+          logger.error("Usage: /{} FILE", command);
+          continue;
+        }
+
+#if USE_CATCH_EXCEPTIONS
+        try {
+#endif
+          if (command == "save") {
+            auto snapshot = xcc::codegen::Snapshot::capture(*globalContext);
+            snapshot.write(tokens[1]);
+            logger.print("Saved {} functions, {} globals & {} objects\n",
+              snapshot.getFunctionCount(), snapshot.getGlobalCount(), snapshot.getObjectCount());
+          } else {
+            // Restored code is only linked, so session starts with a fresh JIT
+            auto snapshot = xcc::codegen::Snapshot::read(tokens[1]);
+            auto restored = xcc::codegen::GlobalContext::create(options);
+            restored->getJIT().setObjectRecording(options.snapshots);
+            snapshot.restore(*restored);
+            globalContext = std::move(restored);
+            logger.print("Loaded {} functions, {} globals & {} objects\n",
+              snapshot.getFunctionCount(), snapshot.getGlobalCount(), snapshot.getObjectCount());
+          }
+#if USE_CATCH_EXCEPTIONS
+        } catch (std::exception& e) {
+          logger.error("{}\n", e.what());
+        }
+#endif
         continue;
       }
 
       if (command == "list" || command == "l") {
-        for (auto& [name, fn] : globalContext->functions) {
+        for (auto& fn : globalContext->getMetaFunctions()) {
           logger.print("{}\n", fn->toString());
         }
         continue;
@@ -111,7 +257,14 @@ int main(int argc, char ** argv) {
 #if USE_CATCH_EXCEPTIONS
     try {
 #endif
+      xcc::util::Timer timer;
+
       xcc::run(globalContext, line, true);
+
+      // Whole line turnaround (parse to result), used by bench/repl.py
+      if (options.timings) {
+        logger.info("Phase '{}' took {:.3f}ms", "repl-line", timer.elapsedMs());
+      }
 #if USE_CATCH_EXCEPTIONS
     } catch (std::exception& e) {
       logger.error("{}\n", e.what());
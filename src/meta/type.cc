@@ -3,9 +3,10 @@
 #include "xcc/exceptions.h"
 #include "xcc/util/string.h"
 
+#include <algorithm>
+
 using namespace xcc::meta;
 
-std::unordered_map<std::string, std::shared_ptr<Type>> Type::customTypes;
 
 Type::Type(TypeTag tag) : tag(tag) {}
 
@@ -200,6 +201,10 @@ std::shared_ptr<Type> Type::getMemberType(const std::string& name) const {
   throw CodegenException("Struct '" + toString() + "' has no member '" + name + "'");
 }
 
+const StructMembers& Type::getMembers() const {
+  return members;
+}
+
 llvm::Value * Type::getDefault(codegen::ModuleContext& ctx) const {
   switch (tag) {
     case TypeTag::U8:
@@ -252,13 +257,7 @@ std::shared_ptr<Type> Type::fromTypeName(const std::string& name) {
     case util::strhash("u64"):  return createU64();
     case util::strhash("f32"):  return createF32();
     case util::strhash("f64"):  return createF64();
-    default: {
-      if (customTypes.find(name) != customTypes.end()) {
-        return customTypes[name];
-      }
-
-      throw CodegenException("Unknown type '" + name + "'");
-    }
+    default:    return nullptr;
   }
 }
 
@@ -351,10 +350,6 @@ std::shared_ptr<Type> Type::inferFromNode(codegen::ModuleContext& ctx, std::shar
   return node->generateType(ctx, {});
 }
 
-void Type::registerCustomType(const std::string& name, std::shared_ptr<Type> type) {
-  customTypes[name] = std::move(type);
-}
-
 std::shared_ptr<Type> Type::alignTypes(std::shared_ptr<Type> lhs, std::shared_ptr<Type> rhs) {
   return (lhs->tag >= rhs->tag) ? std::move(lhs) : std::move(rhs);
 }
@@ -0,0 +1,207 @@
+#include "xcc/object_cache.h"
+#include "xcc/exceptions.h"
+#include "xcc/util/log.h"
+#include "xcc/xcc.h"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA256.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <vector>
+
+using namespace xcc::codegen;
+
+static auto logger = xcc::util::log::Logger("OBJECT_CACHE");
+
+constexpr char OBJECT_EXTENSION[] = ".o";
+
+ObjectCache::ObjectCache(std::string directory, size_t max_size, std::string salt, bool report_stats)
+  : directory(std::move(directory)), max_size(max_size), salt(std::move(salt)), report_stats(report_stats) {
+  if (auto ec = llvm::sys::fs::create_directories(this->directory)) {
+    throw CodegenException("Can't create object cache directory '" + this->directory + "': " + ec.message());
+  }
+
+  prune();
+}
+
+ObjectCache::~ObjectCache() {
+  prune();
+
+  if (report_stats) {
+    reportStats();
+  }
+}
+
+std::unique_ptr<ObjectCache> ObjectCache::create(const Options& options, const llvm::orc::JITTargetMachineBuilder& jtmb) {
+  if (options.cache_dir.empty()) {
+    return nullptr;
+  }
+
+  auto salt = std::format(
+    "xcc={};triple={};cpu={};features={};opt={};ir-opt={}",
+    getVersion(),
+    jtmb.getTargetTriple().str(),
+    jtmb.getCPU(),
+    jtmb.getFeatures().getString(),
+    int(jtmb.getCodeGenOptLevel()),
+    USE_OPTIMIZATION
+  );
+
+  return std::make_unique<ObjectCache>(options.cache_dir, options.cache_size, std::move(salt), options.cache_stats);
+}
+
+void ObjectCache::notifyObjectCompiled(const llvm::Module * module, llvm::MemoryBufferRef object) {
+  std::string key;
+
+  {
+    std::lock_guard lock(pending_mutex);
+
+    if (auto it = pending.find(module); it != pending.end()) {
+      key = std::move(it->second);
+      pending.erase(it);
+    }
+  }
+
+  if (key.empty()) {
+    key = getKey(module);
+  }
+
+  // Write into unique temporary file & rename, so concurrent writers (threads or processes)
+  // never expose partially written object
+  int fd;
+  llvm::SmallString<128> tmp_path;
+  llvm::SmallString<128> tmp_model(directory);
+  llvm::sys::path::append(tmp_model, "%%%%%%%%%%%%.tmp");
+
+  if (auto ec = llvm::sys::fs::createUniqueFile(tmp_model, fd, tmp_path)) {
+    logger.warn("Can't create temporary file in '{}': {}", directory, ec.message());
+    return;
+  }
+
+  {
+    llvm::raw_fd_ostream stream(fd, true);
+    stream << object.getBuffer();
+  }
+
+  if (auto ec = llvm::sys::fs::rename(tmp_path, getObjectPath(key))) {
+    logger.warn("Can't store object '{}': {}", key, ec.message());
+    llvm::sys::fs::remove(tmp_path);
+    return;
+  }
+
+  stats.stores++;
+  stats.bytes_stored += object.getBufferSize();
+}
+
+std::unique_ptr<llvm::MemoryBuffer> ObjectCache::getObject(const llvm::Module * module) {
+  auto key = getKey(module);
+  auto path = getObjectPath(key);
+
+  auto buffer = llvm::MemoryBuffer::getFile(path, false, false);
+
+  if (!buffer) {
+    stats.misses++;
+
+    std::lock_guard lock(pending_mutex);
+    pending[module] = std::move(key);
+
+    return nullptr;
+  }
+
+  stats.hits++;
+  stats.bytes_loaded += (*buffer)->getBufferSize();
+
+  // Mark object as recently used, so it's evicted last
+  std::error_code ec;
+  std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+
+  return std::move(*buffer);
+}
+
+void ObjectCache::prune() {
+  struct Entry {
+    std::filesystem::path path;
+    std::filesystem::file_time_type time;
+    uintmax_t size;
+  };
+
+  std::vector<Entry> entries;
+  uintmax_t total = 0;
+  std::error_code ec;
+
+  for (auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+    if (!entry.is_regular_file(ec) || entry.path().extension() != OBJECT_EXTENSION) {
+      continue;
+    }
+
+    auto size = entry.file_size(ec);
+    if (ec) {
+      continue;
+    }
+
+    auto time = entry.last_write_time(ec);
+    if (ec) {
+      continue;
+    }
+
+    entries.push_back({entry.path(), time, size});
+    total += size;
+  }
+
+  if (total <= max_size) {
+    return;
+  }
+
+  std::sort(entries.begin(), entries.end(), [](auto& lhs, auto& rhs) {
+    return lhs.time < rhs.time;
+  });
+
+  for (auto& entry : entries) {
+    if (total <= max_size) {
+      break;
+    }
+
+    if (std::filesystem::remove(entry.path, ec)) {
+      total -= entry.size;
+      stats.evictions++;
+    }
+  }
+}
+
+const ObjectCache::Stats& ObjectCache::getStats() const {
+  return stats;
+}
+
+void ObjectCache::reportStats() const {
+  size_t hits = stats.hits;
+  size_t misses = stats.misses;
+
+  logger.info("Object cache '{}': {} hits, {} misses ({:.1f}% hit rate)",
+    directory, hits, misses, hits + misses ? 100.0 * double(hits) / double(hits + misses) : 0.0);
+  logger.info("Object cache '{}': {} stored ({} bytes), {} bytes loaded, {} evicted",
+    directory, size_t(stats.stores), size_t(stats.bytes_stored), size_t(stats.bytes_loaded), size_t(stats.evictions));
+}
+
+std::string ObjectCache::getKey(const llvm::Module * module) const {
+  std::string ir;
+  llvm::raw_string_ostream stream(ir);
+  module->print(stream, nullptr);
+  stream.flush();
+
+  llvm::SHA256 hasher;
+  hasher.update(salt);
+  hasher.update(ir);
+
+  return llvm::toHex(hasher.final(), true);
+}
+
+std::string ObjectCache::getObjectPath(const std::string& key) const {
+  llvm::SmallString<128> path(directory);
+  llvm::sys::path::append(path, key + OBJECT_EXTENSION);
+  return std::string(path);
+}
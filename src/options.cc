@@ -0,0 +1,361 @@
+#include "xcc/options.h"
+
+#include <stdexcept>
+#include <filesystem>
+#include <format>
+#include <regex>
+#include <cctype>
+
+using namespace xcc;
+
+/**
+ * Returns value of an option that requires argument (e.g. `-j 4`), advancing idx
+ */
+static std::string getArgument(int argc, char ** argv, int& idx) {
+  if (idx + 1 >= argc) {
+    throw std::runtime_error(std::format("Option '{}' requires an argument", argv[idx]));
+  }
+
+  return argv[++idx];
+}
+
+/**
+ * Converts option argument to unsigned number
+ */
+static size_t toNumber(const std::string& option, const std::string& value) {
+  try {
+    size_t pos = 0;
+    auto result = std::stoul(value, &pos);
+
+    if (pos != value.size()) {
+      throw std::invalid_argument(value);
+    }
+
+    return result;
+  } catch (std::logic_error&) {
+    throw std::runtime_error(std::format("Option '{}' expects a number, got '{}'", option, value));
+  }
+}
+
+/**
+ * Converts option argument to size in bytes, `K`, `M` or `G` suffix selects KiB, MiB or GiB (MiB without suffix)
+ */
+static size_t toSize(const std::string& option, const std::string& value) {
+  static const std::string SUFFIXES = "KMG";
+
+  auto suffix = value.empty() ? std::string::npos : SUFFIXES.find(char(std::toupper(static_cast<unsigned char>(value.back()))));
+
+  if (suffix == std::string::npos) {
+    return toNumber(option, value) << 20;
+  }
+
+  return toNumber(option, value.substr(0, value.size() - 1)) << (10 * (suffix + 1));
+}
+
+/**
+ * Returns output file name for input, if -o is omitted (e.g. `dir/file.xc` -c -> `file.o`)
+ */
+static std::string getDefaultOutput(const std::string& input, Emit emit) {
+  auto stem = std::filesystem::path(input).stem().string();
+
+  switch (emit) {
+    case Emit::OBJECT:   return stem + ".o";
+    case Emit::ASSEMBLY: return stem + ".s";
+    case Emit::LLVM_IR:  return stem + ".ll";
+    case Emit::PRELUDE:  return stem + ".xcp";
+    case Emit::IR_ONLY:  return "-";
+    default:             return "a.out";
+  }
+}
+
+Options Options::parse(int argc, char ** argv) {
+  Options options;
+  std::vector<std::string> positional;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+
+    if (arg == "-h" || arg == "--help") {
+      options.help = true;
+    } else if (arg == "-j" || arg == "--jobs") {
+      options.jobs = toNumber(arg, getArgument(argc, argv, i));
+    } else if (arg.starts_with("-j") && arg.size() > 2) {
+      options.jobs = toNumber("-j", arg.substr(2));
+    } else if (arg == "-o") {
+      options.output = getArgument(argc, argv, i);
+    } else if (arg == "-c") {
+      options.emit = Emit::OBJECT;
+    } else if (arg.size() == 3 && arg.starts_with("-O") && arg[2] >= '0' && arg[2] <= '3') {
+      options.opt_level = arg[2] - '0';
+    } else if (arg == "--emit-asm" || arg == "-S") {
+      options.emit = Emit::ASSEMBLY;
+    } else if (arg == "--emit-llvm") {
+      options.emit = Emit::LLVM_IR;
+    } else if (arg == "--emit-prelude") {
+      options.emit = Emit::PRELUDE;
+    } else if (arg == "--emit-ir-only") {
+      options.emit = Emit::IR_ONLY;
+    } else if (arg == "--check") {
+      options.check = true;
+    } else if (arg.starts_with("-mcpu=")) {
+      options.target_cpu = arg.substr(6);
+    } else if (arg == "--target-cpu") {
+      options.target_cpu = getArgument(argc, argv, i);
+    } else if (arg == "--target-features") {
+      options.target_features = getArgument(argc, argv, i);
+    } else if (arg == "--time") {
+      options.timings = true;
+    } else if (arg == "--pipeline") {
+      options.pipeline = true;
+    } else if (arg == "--jit-linker") {
+      auto linker = getArgument(argc, argv, i);
+      if (linker == "rtdyld") {
+        options.jit_linker = JitLinker::RTDYLD;
+      } else if (linker == "jitlink") {
+        options.jit_linker = JitLinker::JITLINK;
+      } else {
+        throw std::runtime_error(std::format("Unknown JIT linker '{}' (expected 'rtdyld' or 'jitlink')", linker));
+      }
+    } else if (arg == "--jit-slab-size") {
+      options.jit_slab_size = toNumber(arg, getArgument(argc, argv, i)) * 1024 * 1024;
+    } else if (arg == "--jit-huge-pages") {
+      options.jit_huge_pages = true;
+    } else if (arg == "--jit-memory-stats") {
+      options.jit_memory_stats = true;
+    } else if (arg == "--jit-memory-limit") {
+      options.jit_memory_limit = toSize(arg, getArgument(argc, argv, i));
+    } else if (arg == "-g" || arg == "--debug-info") {
+      options.debug_info = true;
+    } else if (arg == "--perf-map") {
+      options.perf_map = true;
+    } else if (arg == "--jitdump") {
+      options.jitdump = true;
+      options.debug_info = true;
+    } else if (arg == "--remarks") {
+      options.remarks = ".*";
+    } else if (arg.starts_with("--remarks=")) {
+      options.remarks = arg.size() > 10 ? arg.substr(10) : ".*";
+    } else if (arg == "--remarks-file") {
+      options.remarks_file = getArgument(argc, argv, i);
+    } else if (arg == "--tiered") {
+      options.tiered = true;
+    } else if (arg == "--tier-threshold") {
+      options.tier_threshold = toNumber(arg, getArgument(argc, argv, i));
+    } else if (arg == "--profile-generate") {
+      options.profile_generate = getArgument(argc, argv, i);
+    } else if (arg == "--profile-use") {
+      options.profile_use = getArgument(argc, argv, i);
+    } else if (arg == "--cache-dir") {
+      options.cache_dir = getArgument(argc, argv, i);
+    } else if (arg == "--cache-size") {
+      options.cache_size = toNumber(arg, getArgument(argc, argv, i)) * 1024 * 1024;
+    } else if (arg == "--cache-stats") {
+      options.cache_stats = true;
+    } else if (arg == "--watch") {
+      options.watch = true;
+    } else if (arg == "--server") {
+      options.server = getArgument(argc, argv, i);
+    } else if (arg == "--batch") {
+      options.batch = true;
+    } else if (arg == "--sessions") {
+      options.sessions = toNumber(arg, getArgument(argc, argv, i));
+    } else if (arg == "--out-of-process") {
+      options.out_of_process = true;
+    } else if (arg == "--executor") {
+      options.executor = getArgument(argc, argv, i);
+      options.out_of_process = true;
+    } else if (arg == "--hot-swap") {
+      options.hot_swap = true;
+    } else if (arg == "--snapshots") {
+      options.snapshots = true;
+    } else if (arg == "--no-interpreter") {
+      options.interpreter = false;
+    } else if (arg == "--load") {
+      options.libraries.push_back(getArgument(argc, argv, i));
+    } else if (arg == "--prelude") {
+      options.preludes.push_back(getArgument(argc, argv, i));
+    } else if (arg.starts_with("-")) {
+      throw std::runtime_error(std::format("Unknown option '{}'", arg));
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  // Every positional argument is a program (or @manifest) in batch mode, only one input file otherwise
+  if (options.batch) {
+    options.batch_inputs = std::move(positional);
+  } else if (!positional.empty()) {
+    if (positional.size() > 1) {
+      throw std::runtime_error(std::format("Unexpected argument '{}' (input file is already set to '{}')", positional[1], positional[0]));
+    }
+    options.input = positional[0];
+  }
+
+  if (!options.profile_generate.empty() && !options.profile_use.empty()) {
+    throw std::runtime_error("Options '--profile-generate' and '--profile-use' are mutually exclusive");
+  }
+
+  if (!options.output.empty() && options.emit == Emit::NONE) {
+    options.emit = Emit::EXECUTABLE;
+  }
+
+  if (options.emit != Emit::NONE) {
+    if (options.input.empty()) {
+      throw std::runtime_error("Ahead of time compilation requires an input file");
+    }
+
+    if (options.output.empty()) {
+      options.output = getDefaultOutput(options.input, options.emit);
+    }
+  }
+
+  // JIT optimizes hot functions with --tiered & profiled code with --profile-use
+  if (options.opt_level && (options.emit == Emit::NONE || options.emit == Emit::PRELUDE || options.emit == Emit::IR_ONLY)) {
+    throw std::runtime_error("Option '-O' only applies to ahead of time compilation into executable, object, assembly or LLVM IR");
+  }
+
+  if (options.check && ((options.input.empty() && !options.batch) || options.emit != Emit::NONE)) {
+    throw std::runtime_error("Option '--check' requires an input file & can't be used with ahead of time compilation");
+  }
+
+  if (options.watch) {
+    if (options.input.empty() || !options.isExecuting()) {
+      throw std::runtime_error("Option '--watch' requires an input file & can't be used with ahead of time compilation or '--check'");
+    }
+
+    options.hot_swap = true;
+  }
+
+  // Hot swap stubs & tiered stubs of the same function would clash on redefinition (REPL always hot swaps)
+  if (options.tiered && (options.hot_swap || (options.input.empty() && !options.batch && options.server.empty()))) {
+    throw std::runtime_error("Option '--tiered' can't be used with '--hot-swap', '--watch' or in REPL");
+  }
+
+  if (options.pipeline && (options.tiered || options.hot_swap)) {
+    throw std::runtime_error("Option '--pipeline' can't be used with '--tiered', '--hot-swap' or '--watch'");
+  }
+
+  if (options.jit_memory_limit) {
+    // Evicted functions are called through the same stubs, as replaceable ones (see JIT::evict)
+    if (options.tiered || options.pipeline || options.out_of_process) {
+      throw std::runtime_error("Option '--jit-memory-limit' can't be used with '--tiered', '--pipeline' or '--out-of-process'");
+    }
+  }
+
+  if (!options.remarks_file.empty() && options.remarks.empty()) {
+    options.remarks = ".*";
+  }
+
+  if (!options.remarks.empty()) {
+    try {
+      std::regex filter(options.remarks);
+    } catch (std::regex_error& e) {
+      throw std::runtime_error(std::format("Invalid '--remarks' filter '{}': {}", options.remarks, e.what()));
+    }
+  }
+
+  if (!options.server.empty() && (!options.input.empty() || options.emit != Emit::NONE || options.watch || options.check)) {
+    throw std::runtime_error("Option '--server' can't be used with an input file, ahead of time compilation, '--watch' or '--check'");
+  }
+
+  if (options.snapshots && (!options.input.empty() || options.batch || !options.server.empty())) {
+    throw std::runtime_error("Option '--snapshots' can only be used in REPL");
+  }
+
+  if (options.batch) {
+    if (options.batch_inputs.empty()) {
+      throw std::runtime_error("Option '--batch' requires at least one program or @manifest");
+    }
+
+    if (options.emit != Emit::NONE || options.watch || !options.server.empty()) {
+      throw std::runtime_error("Option '--batch' can't be used with ahead of time compilation, '--watch' or '--server'");
+    }
+  }
+
+  // jitdump is started with JIT engine, which is created before server/batch fork their children
+  if (options.jitdump && (!options.server.empty() || options.batch)) {
+    throw std::runtime_error("Option '--jitdump' can't be used with '--server' or '--batch' (use '--perf-map')");
+  }
+
+  if (options.out_of_process && options.isExecuting()) {
+    // Stubs, tier up callback & profile counters live in compiler's memory
+    if (options.tiered || options.hot_swap || !options.profile_generate.empty() || !options.server.empty()) {
+      throw std::runtime_error("Option '--out-of-process' can't be used with '--tiered', '--hot-swap', '--watch', '--profile-generate' or '--server'");
+    }
+
+    if (options.input.empty() && !options.batch) {
+      throw std::runtime_error("Option '--out-of-process' requires an input file (REPL runs in-process)");
+    }
+
+    // GDB JIT interface, perf map & jitdump are written by the compiler, so they'd describe the wrong process
+    if (options.debug_info || options.perf_map) {
+      throw std::runtime_error("Option '--out-of-process' can't be used with '--debug-info', '--perf-map' or '--jitdump'");
+    }
+
+    // Code is linked into executor's memory by JITLink, RuntimeDyld & slab allocator link in-process only
+    options.jit_linker = JitLinker::JITLINK;
+  }
+
+  if (options.sessions) {
+    if (options.input.empty() || !options.isExecuting()) {
+      throw std::runtime_error("Option '--sessions' requires an input file & can't be used with ahead of time compilation or '--check'");
+    }
+
+    if (options.watch || options.batch || !options.server.empty()) {
+      throw std::runtime_error("Option '--sessions' can't be used with '--watch', '--batch' or '--server'");
+    }
+  }
+
+  return options;
+}
+
+std::string Options::usage(const std::string& program) {
+  return std::format(
+    "Usage: {} [options] [FILE]\n"
+    "  FILE                  Source file to run (REPL is started if omitted)\n"
+    "  -h, --help            Print this message\n"
+    "  -o FILE               Compile ahead of time into executable FILE (or into object/asm/IR)\n"
+    "  -c                    Compile into object file, don't link\n"
+    "  -O0 .. -O3            Optimization level of ahead of time output (default -O0)\n"
+    "  -S, --emit-asm        Compile into target assembly\n"
+    "  --emit-llvm           Emit LLVM IR of the whole program\n"
+    "  --emit-prelude        Precompile declarations of FILE into a prelude (.xcp)\n"
+    "  --emit-ir-only        Print LLVM IR of every module (or write into -o FILE), no target/JIT init\n"
+    "  --check               Only check that FILE compiles (lex, parse & lower), don't run it\n"
+    "  -mcpu=CPU             Same as --target-cpu CPU\n"
+    "  --target-cpu CPU      Target CPU, 'native' - host (default: host for JIT, generic for AOT)\n"
+    "  --target-features F   Comma separated target features, e.g. '+avx2,-avx512f'\n"
+    "  -j N, --jobs N        Lower function bodies on N threads (0 - all hardware threads)\n"
+    "  --time                Report time spent in each compilation phase\n"
+    "  --pipeline            Overlap parsing, lowering & codegen (stage stats with --time)\n"
+    "  --jit-linker L        Object linking layer: 'rtdyld' (default) or 'jitlink'\n"
+    "  --jit-slab-size M     JIT memory slab size in MiB (0 - allocate per object, default 64)\n"
+    "  --jit-huge-pages      Back JIT memory slabs by 2MB huge pages\n"
+    "  --jit-memory-stats    Report allocated vs used JIT memory per section kind at exit\n"
+    "  --jit-memory-limit N  Evict least recently called functions over N MiB (or NK, NM, NG) of JIT'd code\n"
+    "  -g, --debug-info      Emit DWARF line tables & register JIT'd code with GDB\n"
+    "  --perf-map            Write /tmp/perf-PID.map with JIT'd functions (perf symbols)\n"
+    "  --jitdump             Write jitdump for 'perf inject --jit' (source lines, implies -g)\n"
+    "  --remarks[=REGEX]     Report optimization remarks of passes matching REGEX per source line\n"
+    "  --remarks-file F      Write remarks into F (.json - JSON, otherwise YAML), implies --remarks\n"
+    "  --tiered              Tiered JIT: compile at O0 first, recompile hot functions at O3\n"
+    "  --tier-threshold N    Calls/loop iterations before function is recompiled (default 1000)\n"
+    "  --profile-generate F  Instrument code & write PGO profile into F at exit\n"
+    "  --profile-use F       Optimize code using PGO profile F\n"
+    "  --cache-dir DIR       Store compiled objects in DIR & reuse them on later runs\n"
+    "  --cache-size M        Object cache size limit in MiB (default 512)\n"
+    "  --cache-stats         Report object cache hits/misses on exit\n"
+    "  --watch               Rerun FILE on every change, recompiling only changed functions\n"
+    "  --server SOCKET       Serve requests of xcc-client on Unix socket SOCKET\n"
+    "  --batch               Run every FILE (or programs listed in @MANIFEST) in forked children, -j at once\n"
+    "  --sessions N          Run FILE in N concurrent sessions (threads) sharing one JIT, report throughput\n"
+    "  --out-of-process      Run JIT'd code in a separate executor process (compilation stays here)\n"
+    "  --executor PATH       Executor binary for --out-of-process (default: bundled xcc-executor)\n"
+    "  --hot-swap            Call functions through stubs, so they can be redefined (REPL default)\n"
+    "  --snapshots           Keep compiled objects of REPL session, so it can be saved with /save\n"
+    "  --no-interpreter      JIT compile every REPL expression, don't interpret simple ones\n"
+    "  --load LIB            Load shared library LIB, so its symbols can be called (repeatable)\n"
+    "  --prelude P           Declare prelude P ('std' - libc, or built by --emit-prelude) (repeatable)\n",
+    program
+  );
+}
@@ -101,10 +101,47 @@ std::shared_ptr<ast::TypedIdentifier> Parser::parseValueDecl() {
   return ast::TypedIdentifier::create(name, type, value);
 }
 
+std::vector<ast::FnAttribute> Parser::parseAttributes() {
+  std::vector<ast::FnAttribute> attributes;
+
+  while (checkAdvance(TOKEN_ATTRIBUTE_START)) {
+    do {
+      ast::FnAttribute attribute;
+      attribute.name = parseIdentifier("for attribute name")->value;
+
+      if (checkAdvance(TOKEN_LEFT_PAREN)) {
+        if (!check(TOKEN_RIGHT_PAREN)) {
+          do {
+            if (!checkAdvance(TOKEN_STRING)) {
+              throw ParserException(current().line, "Expected string as attribute argument");
+            }
+            attribute.args.push_back(previous().value);
+          } while (checkAdvance(TOKEN_COMMA));
+        }
+
+        if (!checkAdvance(TOKEN_RIGHT_PAREN)) {
+          throw ParserException(current().line, "Expected ')' after attribute arguments");
+        }
+      }
+
+      attributes.push_back(std::move(attribute));
+    } while (checkAdvance(TOKEN_COMMA));
+
+    if (!checkAdvance(TOKEN_RIGHT_SQUARE_BRACE)) {
+      throw ParserException(current().line, "Expected ']' after attributes");
+    }
+  }
+
+  return attributes;
+}
+
 std::shared_ptr<ast::Node> Parser::parseFunction(bool isMethod) {
+  size_t line = current().line;
   bool is_extern = false;
   bool is_variadic = false;
 
+  auto attributes = parseAttributes();
+
   if (check(TOKEN_EXTERN)) {
     advance();
     is_extern = true;
@@ -158,6 +195,8 @@ std::shared_ptr<ast::Node> Parser::parseFunction(bool isMethod) {
   return_type = parseType();
 
   auto fndecl = ast::FnDecl::create(name, return_type, args, is_extern, is_variadic);
+  fndecl->attributes = std::move(attributes);
+  fndecl->line = line;
 
   if (!check(TOKEN_LEFT_BRACE)) {
     if (!checkAdvance(TOKEN_SEMICOLON)) {
@@ -168,7 +207,10 @@ std::shared_ptr<ast::Node> Parser::parseFunction(bool isMethod) {
 
   auto body = parseBlock();
 
-  return ast::FnDef::create(fndecl, body);
+  auto fndef = ast::FnDef::create(fndecl, body);
+  fndef->line = line;
+
+  return fndef;
 }
 
 std::shared_ptr<ast::Block> Parser::parseBlock() {
@@ -228,7 +270,7 @@ std::shared_ptr<ast::Node> Parser::parseStruct() {
       break;
     }
 
-    if (check(TOKEN_FN)) {
+    if (checkAnyOf(TOKEN_FN, TOKEN_ATTRIBUTE_START)) {
       methods.push_back(std::dynamic_pointer_cast<ast::FnDef>(parseFunction(true)));
     } else {
       fields.push_back(parseValueDecl());
@@ -337,16 +379,41 @@ std::shared_ptr<ast::Node> Parser::parseReturn() {
   return ast::Return::create(expr);
 }
 
+std::shared_ptr<ast::Node> Parser::parseImport() {
+  if (!checkAdvance(TOKEN_IMPORT)) {
+    throw ParserException(current().line, "Expected 'import'");
+  }
+
+  if (!checkAdvance(TOKEN_STRING)) {
+    throw ParserException(current().line, "Expected path string after 'import'");
+  }
+
+  auto path = previous().value;
+
+  if (!checkAdvance(TOKEN_SEMICOLON)) {
+    throw ParserException(current().line, "Expected ';' after import");
+  }
+
+  return ast::Import::create(path);
+}
+
 std::shared_ptr<ast::Node> Parser::parseStmt() {
+  size_t line = current().line;
+  std::shared_ptr<ast::Node> node;
+
   switch (current().type) {
-    case TOKEN_VAR:         return parseVar(false);
-    case TOKEN_IF:          return parseIf();
-    case TOKEN_FOR:         return parseFor();
-    case TOKEN_WHILE:       return parseWhile();
-    case TOKEN_RETURN:      return parseReturn();
-    case TOKEN_LEFT_BRACE:  return parseBlock();
-    default:                return parseExpr();
+    case TOKEN_VAR:         node = parseVar(false); break;
+    case TOKEN_IF:          node = parseIf(); break;
+    case TOKEN_FOR:         node = parseFor(); break;
+    case TOKEN_WHILE:       node = parseWhile(); break;
+    case TOKEN_RETURN:      node = parseReturn(); break;
+    case TOKEN_LEFT_BRACE:  node = parseBlock(); break;
+    default:                node = parseExpr(); break;
   }
+
+  node->line = line;
+
+  return node;
 }
 
 std::shared_ptr<ast::Node> Parser::parseExpr() {
@@ -589,25 +656,46 @@ Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), current_idx(0
 std::shared_ptr<ast::Block> Parser::parse(bool isRepl) {
   auto block = ast::Block::create({});
 
-  while (!isAtEnd()) {
-    if (checkAnyOf(TOKEN_FN, TOKEN_EXTERN)) {
-      block->body.push_back(parseFunction(false));
-    } else if (check(TOKEN_VAR)) {
-      block->body.push_back(parseVar(true));
-      if (!checkAdvance(TOKEN_SEMICOLON)) {
-        throw ParserException(current().line, "Expected ';' variable declaration (global scope)");
-      }
-    } else if (check(TOKEN_STRUCT)) {
-      block->body.push_back(parseStruct());
+  while (auto node = parseNext(isRepl)) {
+    block->body.push_back(node);
+  }
+
+  return block;
+}
+
+std::shared_ptr<ast::Node> Parser::parseNext(bool isRepl) {
+  if (isAtEnd()) {
+    return nullptr;
+  }
+
+  size_t begin = current_idx;
+  std::shared_ptr<ast::Node> node;
+
+  if (checkAnyOf(TOKEN_FN, TOKEN_EXTERN, TOKEN_ATTRIBUTE_START)) {
+    node = parseFunction(false);
+  } else if (check(TOKEN_VAR)) {
+    node = parseVar(true);
+    if (!checkAdvance(TOKEN_SEMICOLON)) {
+      throw ParserException(current().line, "Expected ';' variable declaration (global scope)");
+    }
+  } else if (check(TOKEN_STRUCT)) {
+    node = parseStruct();
+  } else if (check(TOKEN_IMPORT)) {
+    node = parseImport();
+  } else {
+    if (isRepl) {
+      node = parseStmt();
     } else {
-      if (isRepl) {
-        block->body.push_back(parseStmt());
-      } else {
-        throw ParserException(current().line, "Unexpected token at top-level scope: '" + current().value + "' (" + Token::typeToString(current().type) + ")");
-      }
+      throw ParserException(current().line, "Unexpected token at top-level scope: '" + current().value + "' (" + Token::typeToString(current().type) + ")");
     }
   }
 
-  return block;
+  ranges.emplace_back(begin, current_idx);
+
+  return node;
+}
+
+const std::vector<std::pair<size_t, size_t>>& Parser::getTopLevelRanges() const {
+  return ranges;
 }
 
@@ -0,0 +1,129 @@
+#include "xcc/perf_map.h"
+#include "xcc/util/log.h"
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Object/SymbolSize.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+#include <unistd.h>
+
+using namespace xcc::codegen;
+
+static auto logger = xcc::util::log::Logger("PERF_MAP");
+
+/**
+ * Returns name of a JITLink symbol (interned since LLVM 20)
+ */
+static llvm::StringRef getSymbolName(const llvm::jitlink::Symbol& symbol) {
+#if LLVM_VERSION_MAJOR >= 20
+  return *symbol.getName();
+#else
+  return symbol.getName();
+#endif
+}
+
+PerfMap::~PerfMap() {
+  if (file) {
+    std::fclose(file);
+  }
+}
+
+std::unique_ptr<PerfMap> PerfMap::create(const Options& options) {
+  if (!options.perf_map) {
+    return nullptr;
+  }
+
+  return std::make_unique<PerfMap>();
+}
+
+void PerfMap::add(uint64_t address, uint64_t size, const std::string& name) {
+  if (!size) {
+    return;
+  }
+
+  auto line = std::format("{:x} {:x} {}\n", address, size, name);
+
+  std::lock_guard lock(mutex);
+
+  if (pid != getpid()) {
+    // Inherited from parent process, which keeps writing its own map
+    if (file) {
+      std::fclose(file);
+    }
+
+    pid = getpid();
+
+    auto path = std::format("/tmp/perf-{}.map", pid);
+    file = std::fopen(path.c_str(), "w");
+
+    if (!file) {
+      logger.error("Can't open perf map '{}': {}", path, std::strerror(errno));
+      return;
+    }
+
+    logger.debug("Writing perf map '{}'", path);
+  }
+
+  if (!file) {
+    return;
+  }
+
+  // Flushed right away, so profile of a crashed (or killed) process is still symbolized
+  std::fputs(line.c_str(), file);
+  std::fflush(file);
+}
+
+PerfMapListener::PerfMapListener(PerfMap& map) : map(map) {}
+
+void PerfMapListener::notifyObjectLoaded(ObjectKey, const llvm::object::ObjectFile& object, const llvm::RuntimeDyld::LoadedObjectInfo& info) {
+  // Sections of debug object are at their load addresses
+  auto debug_object = info.getObjectForDebug(object);
+  auto& loaded = debug_object.getBinary() ? *debug_object.getBinary() : object;
+
+  for (auto& [symbol, size] : llvm::object::computeSymbolSizes(loaded)) {
+    auto type = symbol.getType();
+
+    if (!type || *type != llvm::object::SymbolRef::ST_Function) {
+      llvm::consumeError(type.takeError());
+      continue;
+    }
+
+    auto name = symbol.getName();
+    auto address = symbol.getAddress();
+
+    if (!name || !address) {
+      llvm::consumeError(name.takeError());
+      llvm::consumeError(address.takeError());
+      continue;
+    }
+
+    map.add(*address, size, name->str());
+  }
+}
+
+PerfMapPlugin::PerfMapPlugin(PerfMap& map) : map(map) {}
+
+void PerfMapPlugin::modifyPassConfig(llvm::orc::MaterializationResponsibility&, llvm::jitlink::LinkGraph&, llvm::jitlink::PassConfiguration& config) {
+  config.PostFixupPasses.push_back([this](llvm::jitlink::LinkGraph& graph) -> llvm::Error {
+    for (auto * symbol : graph.defined_symbols()) {
+      if (symbol->hasName() && symbol->isCallable()) {
+        map.add(symbol->getAddress().getValue(), symbol->getSize(), getSymbolName(*symbol).str());
+      }
+    }
+
+    return llvm::Error::success();
+  });
+}
+
+llvm::Error PerfMapPlugin::notifyFailed(llvm::orc::MaterializationResponsibility&) {
+  return llvm::Error::success();
+}
+
+llvm::Error PerfMapPlugin::notifyRemovingResources(llvm::orc::JITDylib&, llvm::orc::ResourceKey) {
+  return llvm::Error::success();
+}
+
+void PerfMapPlugin::notifyTransferringResources(llvm::orc::JITDylib&, llvm::orc::ResourceKey, llvm::orc::ResourceKey) {}
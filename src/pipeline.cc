@@ -0,0 +1,337 @@
+#include "xcc/pipeline.h"
+#include "xcc/exceptions.h"
+#include "xcc/importer.h"
+#include "xcc/parser.h"
+#include "xcc/util/log.h"
+#include "xcc/util/queue.h"
+#include "xcc/util/timer.h"
+#include "xcc/xcc.h"
+
+#include <llvm/ADT/ScopeExit.h>
+#include <llvm/Support/Threading.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace xcc;
+
+static auto logger = xcc::util::log::Logger("PIPELINE");
+
+/**
+ * Function node, queued for lowering (index - position in source, among functions)
+ */
+struct LowerItem {
+  size_t idx;
+  std::shared_ptr<ast::Node> node;
+};
+
+/**
+ * Lowered module, queued for codegen
+ */
+struct CodegenItem {
+  size_t idx;
+  std::unique_ptr<codegen::ModuleContext> ctx;
+};
+
+Pipeline::Pipeline(std::unique_ptr<codegen::GlobalContext>& globalContext) : globalContext(globalContext) {}
+
+std::unique_ptr<Pipeline> Pipeline::create(std::unique_ptr<codegen::GlobalContext>& globalContext) {
+  return std::make_unique<Pipeline>(globalContext);
+}
+
+void Pipeline::run(const std::vector<Token>& tokens, const std::string& path) {
+  auto& options = globalContext->options;
+  bool aot = !options.isExecuting();
+  size_t workers = llvm::hardware_concurrency(options.jobs).compute_thread_count();
+
+  util::Timer wall;
+
+  stats = {
+    {"parse", 1},
+    {"lower", workers},
+    {"codegen", aot ? 1 : workers},
+  };
+
+  auto& parse_stats = stats[0];
+  auto& lower_stats = stats[1];
+  auto& codegen_stats = stats[2];
+
+  util::Queue<LowerItem> lower_queue;
+  util::Queue<CodegenItem> codegen_queue;
+
+  // Set once every declaration is registered, failures after that are not caused by forward references
+  std::atomic<bool> parsed = false;
+
+  // Guards everything below & stage stats of workers
+  std::mutex mutex;
+  std::vector<LowerItem> deferred;
+  std::map<size_t, std::exception_ptr> errors;
+  std::map<size_t, std::unique_ptr<codegen::ModuleContext>> modules;
+  std::map<size_t, std::pair<std::string, std::unique_ptr<llvm::MemoryBuffer>>> objects;
+
+  auto lower = [&](LowerItem& item, bool may_defer) {
+    try {
+      auto ctx = globalContext->createModule();
+      item.node->generateFunction(*ctx, {});
+      codegen_queue.push({item.idx, std::move(ctx)});
+    } catch (...) {
+      std::lock_guard lock(mutex);
+
+      if (may_defer) {
+        deferred.push_back(std::move(item));
+      } else {
+        errors[item.idx] = std::current_exception();
+      }
+    }
+  };
+
+  auto lower_worker = [&]() {
+    double busy = 0;
+    size_t items = 0;
+
+    while (auto item = lower_queue.pop()) {
+      util::Timer timer;
+      lower(*item, !parsed);
+      busy += timer.elapsedMs();
+      ++items;
+    }
+
+    std::lock_guard lock(mutex);
+    lower_stats.busy_ms += busy;
+    lower_stats.items += items;
+  };
+
+  auto codegen_worker = [&]() {
+    double busy = 0;
+    size_t items = 0;
+
+    while (auto item = codegen_queue.pop()) {
+      util::Timer timer;
+
+      if (aot) {
+        std::lock_guard lock(mutex);
+        modules[item->idx] = std::move(item->ctx);
+      } else {
+        try {
+          auto& module = *item->ctx->llvm.module;
+
+          if (globalContext->profiler) {
+            globalContext->profiler->apply(module);
+          }
+
+          auto object = globalContext->getJIT().compileObject(module);
+
+          if (!object) {
+            throw CodegenException(object.takeError());
+          }
+
+          std::lock_guard lock(mutex);
+          objects[item->idx] = {module.getModuleIdentifier(), std::move(*object)};
+        } catch (...) {
+          std::lock_guard lock(mutex);
+          errors[item->idx] = std::current_exception();
+        }
+      }
+
+      busy += timer.elapsedMs();
+      ++items;
+    }
+
+    std::lock_guard lock(mutex);
+    codegen_stats.busy_ms += busy;
+    codegen_stats.items += items;
+  };
+
+  std::vector<std::thread> lower_threads;
+  std::vector<std::thread> codegen_threads;
+
+  for (size_t i = 0; i < lower_stats.workers; ++i) {
+    lower_threads.emplace_back(lower_worker);
+  }
+
+  for (size_t i = 0; i < codegen_stats.workers; ++i) {
+    codegen_threads.emplace_back(codegen_worker);
+  }
+
+  auto stop_lowering = [&]() {
+    lower_queue.close();
+    for (auto& thread : lower_threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  };
+
+  auto stop_codegen = [&]() {
+    codegen_queue.close();
+    for (auto& thread : codegen_threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  };
+
+  // Workers must be stopped before anything they reference goes out of scope (also on error)
+  auto stop = llvm::make_scope_exit([&]() {
+    stop_lowering();
+    stop_codegen();
+  });
+
+  Parser parser(tokens);
+
+  std::vector<std::string> imports;
+  std::unique_ptr<Importer> importer;
+
+  bool declared = false;
+  size_t fn_count = 0;
+
+  auto queueFunction = [&](std::shared_ptr<ast::Node> node) {
+    auto decl = node->is(ast::AST_FUNCTION_DEF)
+        ? node->as<ast::FnDef>()->decl
+        : ast::Node::cast<ast::FnDecl>(node);
+
+    globalContext->addFunction(decl->name->value, decl->generateMetaFunction(*globalContext->globalModule));
+
+    lower_queue.push({fn_count++, std::move(node)});
+  };
+
+  // Imported units are compiled before anything else is declared, so their declarations are visible
+  auto importUnits = [&]() {
+    if (!imports.empty()) {
+      importer = Importer::create(globalContext);
+      importer->import(path, imports);
+    }
+  };
+
+  while (true) {
+    util::Timer timer;
+
+    auto node = parser.parseNext(false);
+
+    if (!node) {
+      break;
+    }
+
+    if (node->is(ast::AST_IMPORT)) {
+      assertThrow(!declared, CodegenException("Imports must precede all other declarations in pipelined mode"));
+      imports.push_back(node->as<ast::Import>()->path);
+    } else {
+      if (!declared) {
+        declared = true;
+        importUnits();
+      }
+
+      if (node->isAnyOf(ast::AST_FUNCTION_DEF, ast::AST_FUNCTION_DECL)) {
+        queueFunction(node);
+      } else if (node->is(ast::AST_VAR_DECL)) {
+        node->generateValue(*globalContext->globalModule, {});
+      } else if (node->is(ast::AST_STRUCT)) {
+        node->generateType(*globalContext->globalModule, {});
+        for (auto& method : node->as<ast::Struct>()->methods) {
+          queueFunction(method);
+        }
+      } else {
+        throw std::runtime_error("Unexpected node at top-level scope: " + ast::Node::typeToString(node->type));
+      }
+    }
+
+    parse_stats.busy_ms += timer.elapsedMs();
+    ++parse_stats.items;
+  }
+
+  if (!declared) {
+    importUnits();
+  }
+
+  parsed = true;
+
+  stop_lowering();
+
+  // Forward references are resolved now, deferred functions are lowered while codegen is still running
+  {
+    util::Timer timer;
+
+    std::sort(deferred.begin(), deferred.end(), [](auto& lhs, auto& rhs) {
+      return lhs.idx < rhs.idx;
+    });
+
+    for (auto& item : deferred) {
+      lower(item, false);
+    }
+
+    lower_stats.busy_ms += timer.elapsedMs();
+    lower_stats.items += deferred.size();
+
+    if (!deferred.empty()) {
+      logger.debug("{} functions were deferred until parsing was done", deferred.size());
+    }
+  }
+
+  stop_codegen();
+
+  lower_stats.max_depth = lower_queue.getMaxDepth();
+  lower_stats.avg_depth = lower_queue.getAverageDepth();
+  codegen_stats.max_depth = codegen_queue.getMaxDepth();
+  codegen_stats.avg_depth = codegen_queue.getAverageDepth();
+
+  wall_ms = wall.elapsedMs();
+
+  report();
+
+  // Error of the first (in source order) failed function
+  if (!errors.empty()) {
+    std::rethrow_exception(errors.begin()->second);
+  }
+
+  if (aot) {
+    std::vector<const llvm::Module *> aot_modules = {globalContext->globalModule->llvm.module.get()};
+
+    if (importer) {
+      for (auto module : importer->getModules()) {
+        aot_modules.push_back(module);
+      }
+    }
+
+    for (auto& [idx, ctx] : modules) {
+      aot_modules.push_back(ctx->llvm.module.get());
+    }
+
+    emit(globalContext, aot_modules);
+    return;
+  }
+
+  for (auto& [idx, object] : objects) {
+    CodegenException::throwIfError(globalContext->getJIT().addObject(object.first, std::move(object.second)));
+  }
+
+  util::Timer timer;
+
+  globalContext->runFunction("main");
+
+  if (options.timings) {
+    logger.info("Phase '{}' took {:.3f}ms", "run", timer.elapsedMs());
+  }
+}
+
+const std::vector<Pipeline::StageStats>& Pipeline::getStats() const {
+  return stats;
+}
+
+void Pipeline::report() const {
+  if (!globalContext->options.timings) {
+    return;
+  }
+
+  logger.info("Phase '{}' took {:.3f}ms", "pipeline", wall_ms);
+
+  // Utilization - share of wall time workers of a stage were busy. Queue, that keeps growing, is in front of the bottleneck
+  for (auto& stage : stats) {
+    double utilization = wall_ms > 0 ? 100 * stage.busy_ms / (wall_ms * stage.workers) : 0;
+
+    logger.info("Stage '{}': {} items, {} workers, busy {:.3f}ms, utilization {:.1f}%, queue depth max {} avg {:.2f}",
+      stage.name, stage.items, stage.workers, stage.busy_ms, utilization, stage.max_depth, stage.avg_depth);
+  }
+}
@@ -0,0 +1,232 @@
+#include "xcc/prelude.h"
+#include "xcc/ast.h"
+#include "xcc/declarations.h"
+#include "xcc/exceptions.h"
+#include "xcc/lexer.h"
+#include "xcc/parser.h"
+#include "xcc/util/log.h"
+#include "xcc/util/serialize.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace xcc;
+using namespace xcc::codegen;
+
+/* File starts with magic (including terminating zero) & version */
+constexpr char PRELUDE_MAGIC[] = "XCCPRLD";
+constexpr uint32_t PRELUDE_VERSION = 1;
+
+static auto logger = xcc::util::log::Logger("PRELUDE");
+
+/**
+ * Returns type name of a type node, as it is written in source
+ */
+static std::string typeName(ast::Type& type) {
+  auto name = type.name->is(ast::AST_EXPR_TYPE)
+    ? typeName(*type.name->as<ast::Type>())
+    : type.name->as<ast::Identifier>()->value;
+
+  return type.pointer ? name + "*" : name;
+}
+
+/**
+ * Reverse of typeName() - builds type node, the same as parser would
+ */
+static std::shared_ptr<ast::Type> typeNode(llvm::StringRef name) {
+  if (!name.ends_with("*")) {
+    return ast::Type::create(ast::Identifier::create(name.str()), false);
+  }
+
+  auto pointed = name.drop_back();
+
+  if (!pointed.ends_with("*")) {
+    return ast::Type::create(ast::Identifier::create(pointed.str()), true);
+  }
+
+  return ast::Type::create(typeNode(pointed), true);
+}
+
+static std::vector<std::pair<std::string, std::string>> argsOf(const std::vector<std::shared_ptr<ast::TypedIdentifier>>& args, const std::string& owner) {
+  std::vector<std::pair<std::string, std::string>> result;
+
+  for (auto& arg : args) {
+    assertThrow(arg->value_type, CodegenException(std::format("'{}' of '{}' has no type", arg->name->value, owner)));
+    result.emplace_back(arg->name->value, typeName(*arg->value_type));
+  }
+
+  return result;
+}
+
+Prelude Prelude::build(const std::string& source) {
+  auto tree = Parser(Lexer(source).tokenize()).parse(false);
+
+  Prelude prelude;
+
+  for (auto& node : tree->body) {
+    if (node->is(ast::AST_STRUCT)) {
+      auto type = node->as<ast::Struct>();
+
+      assertThrow(type->methods.empty(), CodegenException(std::format("Struct '{}' has methods, preludes can only contain declarations", type->name->value)));
+
+      prelude.structs.push_back({type->name->value, argsOf(type->fields, type->name->value)});
+    } else if (node->is(ast::AST_FUNCTION_DECL) && node->as<ast::FnDecl>()->isExtern) {
+      auto decl = node->as<ast::FnDecl>();
+      prelude.functions.push_back({decl->name->value, typeName(*decl->return_type), argsOf(decl->args, decl->name->value), decl->isVariadic});
+    } else {
+      throw CodegenException(std::format("Unexpected {} in prelude, only structs & extern functions can be declared", ast::Node::typeToString(node->type)));
+    }
+  }
+
+  return prelude;
+}
+
+Prelude Prelude::getBuiltin() {
+  Prelude prelude;
+
+  prelude.functions = {
+    {"printf",   "i32",  {{"fmt", "i8*"}}, true},
+    {"sprintf",  "i32",  {{"buffer", "i8*"}, {"fmt", "i8*"}}, true},
+    {"snprintf", "i32",  {{"buffer", "i8*"}, {"size", "u64"}, {"fmt", "i8*"}}, true},
+    {"puts",     "i32",  {{"str", "i8*"}}},
+    {"putchar",  "i32",  {{"c", "i32"}}},
+    {"getchar",  "i32",  {}},
+    {"malloc",   "i8*",  {{"size", "u64"}}},
+    {"calloc",   "i8*",  {{"count", "u64"}, {"size", "u64"}}},
+    {"realloc",  "i8*",  {{"ptr", "i8*"}, {"size", "u64"}}},
+    {"free",     "void", {{"ptr", "i8*"}}},
+    {"memcpy",   "i8*",  {{"dst", "i8*"}, {"src", "i8*"}, {"size", "u64"}}},
+    {"memmove",  "i8*",  {{"dst", "i8*"}, {"src", "i8*"}, {"size", "u64"}}},
+    {"memset",   "i8*",  {{"dst", "i8*"}, {"c", "i32"}, {"size", "u64"}}},
+    {"memcmp",   "i32",  {{"lhs", "i8*"}, {"rhs", "i8*"}, {"size", "u64"}}},
+    {"strlen",   "u64",  {{"str", "i8*"}}},
+    {"strcmp",   "i32",  {{"lhs", "i8*"}, {"rhs", "i8*"}}},
+    {"strncmp",  "i32",  {{"lhs", "i8*"}, {"rhs", "i8*"}, {"size", "u64"}}},
+    {"strcpy",   "i8*",  {{"dst", "i8*"}, {"src", "i8*"}}},
+    {"strncpy",  "i8*",  {{"dst", "i8*"}, {"src", "i8*"}, {"size", "u64"}}},
+    {"strcat",   "i8*",  {{"dst", "i8*"}, {"src", "i8*"}}},
+    {"atoi",     "i32",  {{"str", "i8*"}}},
+    {"atol",     "i64",  {{"str", "i8*"}}},
+    {"abs",      "i32",  {{"x", "i32"}}},
+    {"rand",     "i32",  {}},
+    {"srand",    "void", {{"seed", "u32"}}},
+    {"exit",     "void", {{"code", "i32"}}},
+  };
+
+  return prelude;
+}
+
+Prelude Prelude::load(const std::string& name) {
+  return name == BUILTIN_PRELUDE_NAME ? getBuiltin() : read(name);
+}
+
+Prelude Prelude::read(const std::string& path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+
+  if (!buffer) {
+    throw CodegenException(std::format("Can't open '{}': {}", path, buffer.getError().message()));
+  }
+
+  util::BinaryReader reader((*buffer)->getBuffer(), PRELUDE_MAGIC);
+
+  assertThrow(reader.getVersion().has_value(),
+    CodegenException(std::format("'{}' is not a prelude (preludes are built with --emit-prelude)", path)));
+
+  assertThrow(reader.getVersion() == PRELUDE_VERSION,
+    CodegenException(std::format("Prelude '{}' has unsupported version {} (expected {})", path, *reader.getVersion(), PRELUDE_VERSION)));
+
+  Prelude prelude;
+
+  auto structs = reader.read<uint32_t>();
+
+  for (uint32_t i = 0; i < structs && reader; ++i) {
+    Struct type;
+    type.name = reader.readString();
+    type.members = reader.readPairs();
+
+    prelude.structs.push_back(std::move(type));
+  }
+
+  auto functions = reader.read<uint32_t>();
+
+  for (uint32_t i = 0; i < functions && reader; ++i) {
+    Function fn;
+    fn.name = reader.readString();
+    fn.return_type = reader.readString();
+    fn.variadic = reader.read<uint8_t>();
+    fn.args = reader.readPairs();
+
+    prelude.functions.push_back(std::move(fn));
+  }
+
+  if (auto err = reader.takeError()) {
+    throw CodegenException(std::format("Malformed prelude '{}': {}", path, llvm::toString(std::move(err))));
+  }
+
+  return prelude;
+}
+
+void Prelude::write(const std::string& path) const {
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+
+  if (ec) {
+    throw CodegenException(std::format("Can't open '{}': {}", path, ec.message()));
+  }
+
+  util::BinaryWriter writer(out, PRELUDE_MAGIC, PRELUDE_VERSION);
+
+  writer.write<uint32_t>(structs.size());
+
+  for (auto& type : structs) {
+    writer.writeString(type.name);
+    writer.writePairs(type.members);
+  }
+
+  writer.write<uint32_t>(functions.size());
+
+  for (auto& fn : functions) {
+    writer.writeString(fn.name);
+    writer.writeString(fn.return_type);
+    writer.write<uint8_t>(fn.variadic);
+    writer.writePairs(fn.args);
+  }
+
+  logger.debug("Prelude of {} structs & {} functions written to '{}'", structs.size(), functions.size(), path);
+}
+
+void Prelude::declare(GlobalContext& globalContext) const {
+  for (auto& type : structs) {
+    meta::StructMembers members;
+
+    for (auto& [name, member] : type.members) {
+      members.emplace_back(name, typeFromName(globalContext, member));
+    }
+
+    globalContext.addType(type.name, meta::Type::createStruct(type.name, std::move(members)));
+  }
+
+  // Declaration node is still needed, LLVM declarations of functions are generated from it on first use
+  for (auto& fn : functions) {
+    std::vector<std::shared_ptr<ast::TypedIdentifier>> args;
+    OrderedMap<std::string, std::shared_ptr<meta::Type>> arg_types;
+
+    for (auto& [name, type] : fn.args) {
+      args.push_back(ast::TypedIdentifier::create(ast::Identifier::create(name), typeNode(type)));
+      arg_types[name] = typeFromName(globalContext, type);
+    }
+
+    auto decl = ast::FnDecl::create(ast::Identifier::create(fn.name), typeNode(fn.return_type), std::move(args), true, fn.variadic);
+
+    globalContext.addFunction(fn.name, meta::Function::create(fn.name, typeFromName(globalContext, fn.return_type), std::move(arg_types), std::move(decl)));
+  }
+}
+
+size_t Prelude::getStructCount() const {
+  return structs.size();
+}
+
+size_t Prelude::getFunctionCount() const {
+  return functions.size();
+}
@@ -0,0 +1,192 @@
+#include "xcc/profile.h"
+#include "xcc/exceptions.h"
+#include "xcc/util/log.h"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/InstrProfWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Transforms/Instrumentation/PGOInstrumentation.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
+#include <format>
+#include <functional>
+#include <unordered_map>
+
+using namespace xcc::codegen;
+
+static auto logger = xcc::util::log::Logger("PROFILE");
+
+constexpr char PROFILE_COUNTERS_SUFFIX[] = "$prof";
+constexpr char PROFILE_RAW_VERSION_VAR[] = "__llvm_profile_raw_version";
+
+/**
+ * Runs module pass pipeline, built by `build`, with all analyses registered
+ */
+static void runPasses(llvm::Module& module, const std::function<void(llvm::ModulePassManager&, llvm::PassBuilder&)>& build) {
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  llvm::PassBuilder pass_builder;
+
+  pass_builder.registerModuleAnalyses(mam);
+  pass_builder.registerCGSCCAnalyses(cgam);
+  pass_builder.registerFunctionAnalyses(fam);
+  pass_builder.registerLoopAnalyses(lam);
+  pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+  llvm::ModulePassManager mpm;
+  build(mpm, pass_builder);
+  mpm.run(module, mam);
+}
+
+Profiler::Profiler(Mode mode, std::string path) : mode(mode), path(std::move(path)) {}
+
+std::unique_ptr<Profiler> Profiler::create(const Options& options) {
+  if (!options.profile_generate.empty()) {
+    return std::make_unique<Profiler>(Mode::GENERATE, options.profile_generate);
+  }
+
+  if (!options.profile_use.empty()) {
+    if (!llvm::sys::fs::exists(options.profile_use)) {
+      throw CodegenException(std::format("Profile '{}' doesn't exist", options.profile_use));
+    }
+
+    return std::make_unique<Profiler>(Mode::USE, options.profile_use);
+  }
+
+  return nullptr;
+}
+
+Profiler::Mode Profiler::getMode() const {
+  return mode;
+}
+
+void Profiler::apply(llvm::Module& module) {
+  if (mode == Mode::GENERATE) {
+    instrument(module);
+  } else {
+    annotate(module);
+  }
+}
+
+void Profiler::instrument(llvm::Module& module) {
+  runPasses(module, [](llvm::ModulePassManager& mpm, llvm::PassBuilder&) {
+    mpm.addPass(llvm::PGOInstrumentationGen());
+  });
+
+  // Instead of InstrProfilingLoweringPass (which needs compiler-rt profile runtime), increments
+  // are lowered into atomic adds on plain arrays, which are read back from JIT in write()
+  std::vector<llvm::InstrProfInstBase *> intrinsics;
+
+  for (auto& fn : module) {
+    for (auto& block : fn) {
+      for (auto& inst : block) {
+        if (auto intrinsic = llvm::dyn_cast<llvm::InstrProfInstBase>(&inst)) {
+          intrinsics.push_back(intrinsic);
+        }
+      }
+    }
+  }
+
+  auto i64 = llvm::Type::getInt64Ty(module.getContext());
+  std::unordered_map<std::string, llvm::GlobalVariable *> counters;
+
+  for (auto intrinsic : intrinsics) {
+    // Value profiling & other intrinsics are dropped - only edge counters are collected
+    if (auto increment = llvm::dyn_cast<llvm::InstrProfIncrementInst>(intrinsic)) {
+      auto name = llvm::getPGOFuncNameVarInitializer(increment->getName()).str();
+      auto& counter = counters[name];
+
+      if (!counter) {
+        size_t size = increment->getNumCounters()->getZExtValue();
+        auto type = llvm::ArrayType::get(i64, size);
+
+        counter = new llvm::GlobalVariable(
+          module, type, false, llvm::GlobalValue::ExternalLinkage, llvm::ConstantAggregateZero::get(type), name + PROFILE_COUNTERS_SUFFIX);
+
+        std::lock_guard lock(functions_mutex);
+        functions.push_back({name, increment->getHash()->getZExtValue(), size});
+      }
+
+      llvm::IRBuilder<> builder(increment);
+
+      auto slot = builder.CreateConstInBoundsGEP2_64(counter->getValueType(), counter, 0, increment->getIndex()->getZExtValue());
+      auto step = builder.CreateZExtOrTrunc(increment->getStep(), i64);
+
+      builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, slot, step, llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+    }
+
+    intrinsic->eraseFromParent();
+  }
+
+  // Name variables & raw version variable are only needed by profile runtime
+  llvm::removeFromUsedLists(module, [](llvm::Constant * constant) {
+    return constant->getName() == PROFILE_RAW_VERSION_VAR;
+  });
+
+  std::vector<llvm::GlobalVariable *> unused;
+
+  for (auto& global : module.globals()) {
+    if ((global.getName().starts_with(llvm::getInstrProfNameVarPrefix()) || global.getName() == PROFILE_RAW_VERSION_VAR) && global.use_empty()) {
+      unused.push_back(&global);
+    }
+  }
+
+  for (auto global : unused) {
+    global->eraseFromParent();
+  }
+}
+
+void Profiler::annotate(llvm::Module& module) {
+  // Must run on the same (unoptimized) IR as PGOInstrumentationGen did, otherwise CFG hashes won't match
+  runPasses(module, [&](llvm::ModulePassManager& mpm, llvm::PassBuilder& pass_builder) {
+    mpm.addPass(llvm::PGOInstrumentationUse(path, "", false, llvm::vfs::getRealFileSystem()));
+    mpm.addPass(pass_builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2));
+  });
+}
+
+void Profiler::write(JIT& jit) {
+  if (mode != Mode::GENERATE) {
+    return;
+  }
+
+  llvm::InstrProfWriter writer;
+
+  CodegenException::throwIfError(writer.mergeProfileKind(llvm::InstrProfKind::IRInstrumentation));
+
+  std::lock_guard lock(functions_mutex);
+
+  for (auto& fn : functions) {
+    auto symbol = jit.lookup(fn.name + PROFILE_COUNTERS_SUFFIX);
+
+    if (!symbol) {
+      logger.warn("Can't read counters of '{}': {}", fn.name, llvm::toString(symbol.takeError()));
+      continue;
+    }
+
+    auto counts = symbol->getAddress().toPtr<uint64_t *>();
+
+    llvm::NamedInstrProfRecord record(fn.name, fn.hash, std::vector<uint64_t>(counts, counts + fn.size));
+
+    writer.addRecord(std::move(record), 1, [&](llvm::Error err) {
+      logger.warn("Profile record of '{}': {}", fn.name, llvm::toString(std::move(err)));
+    });
+  }
+
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+
+  if (ec) {
+    throw CodegenException(std::format("Can't open '{}': {}", path, ec.message()));
+  }
+
+  CodegenException::throwIfError(writer.write(out));
+
+  logger.debug("Profile of {} functions written to '{}'", functions.size(), path);
+}
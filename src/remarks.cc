@@ -0,0 +1,228 @@
+#include "xcc/remarks.h"
+#include "xcc/exceptions.h"
+#include "xcc/util/log.h"
+
+#include <llvm/IR/DiagnosticHandler.h>
+#include <llvm/Remarks/Remark.h>
+#include <llvm/Remarks/RemarkSerializer.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <format>
+#include <map>
+#include <tuple>
+
+using namespace xcc::codegen;
+
+static auto logger = xcc::util::log::Logger("REMARKS");
+
+/**
+ * Diagnostic handler of an LLVMContext, passes optimization remarks into Remarks, other diagnostics are handled by default
+ */
+class RemarkHandler : public llvm::DiagnosticHandler {
+public:
+  Remarks& remarks;
+
+  explicit RemarkHandler(Remarks& remarks) : llvm::DiagnosticHandler(&remarks), remarks(remarks) {}
+
+  bool handleDiagnostics(const llvm::DiagnosticInfo& diagnostic) override {
+    auto remark = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&diagnostic);
+
+    if (!remark) {
+      return false;
+    }
+
+    if (remarks.isEnabled(remark->getPassName())) {
+      remarks.add(*remark);
+    }
+
+    return true;
+  }
+
+  bool isAnalysisRemarkEnabled(llvm::StringRef pass) const override {
+    return remarks.isEnabled(pass);
+  }
+
+  bool isMissedOptRemarkEnabled(llvm::StringRef pass) const override {
+    return remarks.isEnabled(pass);
+  }
+
+  bool isPassedOptRemarkEnabled(llvm::StringRef pass) const override {
+    return remarks.isEnabled(pass);
+  }
+
+  bool isAnyRemarkEnabled() const override {
+    return true;
+  }
+};
+
+static const char * kindName(Remarks::Kind kind) {
+  switch (kind) {
+    case Remarks::Kind::PASSED:   return "passed";
+    case Remarks::Kind::MISSED:   return "missed";
+    case Remarks::Kind::ANALYSIS: return "analysis";
+  }
+
+  return "<?>";
+}
+
+/**
+ * Strips JIT suffixes (replaceable body version, tier) from LLVM function name
+ */
+static std::string getSourceFunction(llvm::StringRef name) {
+  return name.substr(0, name.find('$')).str();
+}
+
+Remarks::Remarks(const std::string& filter, std::string path) : filter(filter), path(std::move(path)) {}
+
+std::unique_ptr<Remarks> Remarks::create(const Options& options) {
+  if (options.remarks.empty()) {
+    return nullptr;
+  }
+
+  // Remarks report pipelines, that run anyway, they don't enable any
+  if (!options.opt_level && !options.tiered && options.profile_use.empty()) {
+    logger.warn("'--remarks' without an optimization pipeline ('-O1'..'-O3', '--tiered' or '--profile-use') reports only codegen remarks (no inlining or vectorization)");
+  }
+
+  return std::make_unique<Remarks>(options.remarks, options.remarks_file);
+}
+
+bool Remarks::isEnabled(llvm::StringRef pass) const {
+  return std::regex_search(pass.begin(), pass.end(), filter);
+}
+
+void Remarks::install(llvm::LLVMContext& ctx) {
+  // Pooled contexts are reused by many modules (and may be compiling one right now)
+  if (ctx.getDiagHandlerPtr()->DiagnosticContext == this) {
+    return;
+  }
+
+  ctx.setDiagnosticHandler(std::make_unique<RemarkHandler>(*this));
+}
+
+void Remarks::add(const llvm::DiagnosticInfoOptimizationBase& diagnostic) {
+  Remark remark {
+    .kind = diagnostic.isPassed() ? Kind::PASSED : diagnostic.isAnalysis() ? Kind::ANALYSIS : Kind::MISSED,
+    .pass = diagnostic.getPassName().str(),
+    .name = diagnostic.getRemarkName().str(),
+    .function = getSourceFunction(diagnostic.getFunction().getName()),
+    .message = diagnostic.getMsg(),
+  };
+
+  if (diagnostic.isLocationAvailable()) {
+    auto location = diagnostic.getLocation();
+    remark.file = location.getRelativePath();
+    remark.line = location.getLine();
+  }
+
+  std::lock_guard lock(mutex);
+  remarks.push_back(std::move(remark));
+}
+
+void Remarks::report() {
+  std::lock_guard lock(mutex);
+
+  std::stable_sort(remarks.begin(), remarks.end(), [](const Remark& lhs, const Remark& rhs) {
+    return std::tie(lhs.file, lhs.line) < std::tie(rhs.file, rhs.line);
+  });
+
+  struct Summary {
+    size_t vectorized = 0;
+    size_t not_vectorized = 0;
+    size_t inlined = 0;
+    size_t total = 0;
+  };
+
+  std::map<std::string, Summary> functions;
+
+  for (auto& remark : remarks) {
+    auto location = remark.line ? std::format("{}:{}", remark.file, remark.line) : std::string("<unknown>");
+    logger.print("{}: {} remark: {}: {} [{}]\n", location, kindName(remark.kind), remark.function, remark.message, remark.pass);
+
+    auto& summary = functions[remark.function];
+    summary.total++;
+
+    bool vectorizer = remark.pass == "loop-vectorize" || remark.pass == "slp-vectorizer";
+
+    if (remark.kind == Kind::PASSED && vectorizer) {
+      summary.vectorized++;
+    } else if (remark.kind == Kind::MISSED && remark.pass == "loop-vectorize") {
+      summary.not_vectorized++;
+    } else if (remark.kind == Kind::PASSED && remark.pass == "inline") {
+      summary.inlined++;
+    }
+  }
+
+  logger.print("{:<24} {:>10} {:>14} {:>8} {:>8}\n", "function", "vectorized", "not vectorized", "inlined", "remarks");
+
+  for (auto& [name, summary] : functions) {
+    logger.print("{:<24} {:>10} {:>14} {:>8} {:>8}\n", name, summary.vectorized, summary.not_vectorized, summary.inlined, summary.total);
+  }
+
+  if (!path.empty()) {
+    write();
+  }
+}
+
+void Remarks::write() {
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_Text);
+
+  if (ec) {
+    throw CodegenException(std::format("Can't open '{}': {}", path, ec.message()));
+  }
+
+  if (llvm::StringRef(path).ends_with(".json")) {
+    llvm::json::OStream json(out, 2);
+
+    json.array([&] {
+      for (auto& remark : remarks) {
+        json.object([&] {
+          json.attribute("kind", kindName(remark.kind));
+          json.attribute("pass", remark.pass);
+          json.attribute("name", remark.name);
+          json.attribute("function", remark.function);
+          json.attribute("file", remark.file);
+          json.attribute("line", int64_t(remark.line));
+          json.attribute("message", remark.message);
+        });
+      }
+    });
+
+    return;
+  }
+
+  auto serializer = llvm::remarks::createRemarkSerializer(llvm::remarks::Format::YAML, llvm::remarks::SerializerMode::Standalone, out);
+
+  if (!serializer) {
+    throw CodegenException(serializer.takeError());
+  }
+
+  for (auto& remark : remarks) {
+    llvm::remarks::Remark record;
+
+    switch (remark.kind) {
+      case Kind::PASSED:   record.RemarkType = llvm::remarks::Type::Passed; break;
+      case Kind::MISSED:   record.RemarkType = llvm::remarks::Type::Missed; break;
+      case Kind::ANALYSIS: record.RemarkType = llvm::remarks::Type::Analysis; break;
+    }
+
+    record.PassName = remark.pass;
+    record.RemarkName = remark.name;
+    record.FunctionName = remark.function;
+
+    if (remark.line) {
+      record.Loc = llvm::remarks::RemarkLocation {remark.file, unsigned(remark.line), 0};
+    }
+
+    llvm::remarks::Argument message;
+    message.Key = "String";
+    message.Val = remark.message;
+    record.Args.push_back(message);
+
+    (*serializer)->emit(record);
+  }
+}
@@ -0,0 +1,386 @@
+#include "xcc/server.h"
+#include "xcc/server_protocol.h"
+#include "xcc/xcc.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace xcc;
+
+static auto logger = xcc::util::log::Logger("SERVER");
+
+/* SIGCHLD handler wakes up poll() through this pipe */
+static int s_sigchld_pipe[2] = {-1, -1};
+
+static void onSigchld(int) {
+  auto saved_errno = errno;
+  char byte = 0;
+  [[maybe_unused]] auto written = write(s_sigchld_pipe[1], &byte, 1);
+  errno = saved_errno;
+}
+
+static bool readExact(int fd, void * data, size_t size) {
+  auto ptr = static_cast<char *>(data);
+
+  while (size) {
+    auto result = read(fd, ptr, size);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (result <= 0) {
+      return false;
+    }
+
+    ptr += result;
+    size -= result;
+  }
+
+  return true;
+}
+
+static bool writeExact(int fd, const void * data, size_t size) {
+  auto ptr = static_cast<const char *>(data);
+
+  while (size) {
+    auto result = write(fd, ptr, size);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (result <= 0) {
+      return false;
+    }
+
+    ptr += result;
+    size -= result;
+  }
+
+  return true;
+}
+
+static std::string readString(int fd, size_t limit) {
+  uint32_t size;
+
+  if (!readExact(fd, &size, sizeof(size)) || size > limit) {
+    throw std::runtime_error("Malformed request");
+  }
+
+  std::string result(size, '\0');
+
+  if (!readExact(fd, result.data(), size)) {
+    throw std::runtime_error("Malformed request");
+  }
+
+  return result;
+}
+
+/**
+ * Receives first byte of a request with client's stdin, stdout & stderr & installs them as own
+ */
+static void receiveDescriptors(int conn) {
+  char version;
+  iovec iov {&version, 1};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * XCC_SERVER_FD_COUNT)];
+
+  msghdr msg {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if (recvmsg(conn, &msg, 0) != 1) {
+    throw std::runtime_error("Malformed request");
+  }
+
+  if (version != XCC_SERVER_PROTOCOL_VERSION) {
+    throw std::runtime_error(std::format("Unsupported protocol version {} (expected {})", (int) version, XCC_SERVER_PROTOCOL_VERSION));
+  }
+
+  auto cmsg = CMSG_FIRSTHDR(&msg);
+
+  if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * XCC_SERVER_FD_COUNT)) {
+    throw std::runtime_error("Request doesn't carry client's descriptors");
+  }
+
+  int fds[XCC_SERVER_FD_COUNT];
+  std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  std::fflush(nullptr);
+
+  for (int i = 0; i < XCC_SERVER_FD_COUNT; ++i) {
+    dup2(fds[i], i);
+    close(fds[i]);
+  }
+}
+
+/**
+ * Returns true if GlobalContext, created with `image` options, can run a request with `request` options.
+ * Only options, which are used on GlobalContext (JIT) creation, must match
+ */
+static bool isCompatible(const Options& image, const Options& request) {
+  return image.target_cpu == request.target_cpu
+      && image.target_features == request.target_features
+      && image.jit_linker == request.jit_linker
+      && image.jit_slab_size == request.jit_slab_size
+      && image.jit_huge_pages == request.jit_huge_pages
+      && image.jit_memory_stats == request.jit_memory_stats
+      && image.jit_memory_limit == request.jit_memory_limit
+      && image.debug_info == request.debug_info
+      && image.perf_map == request.perf_map
+      // Image never has jitdump (see Options::parse), so such requests get a JIT of their own, created in the child
+      && image.jitdump == request.jitdump
+      && image.remarks == request.remarks
+      && image.remarks_file == request.remarks_file
+      && image.tiered == request.tiered
+      && image.tier_threshold == request.tier_threshold
+      && image.profile_generate == request.profile_generate
+      && image.profile_use == request.profile_use
+      && image.cache_dir == request.cache_dir
+      && image.cache_size == request.cache_size
+      && image.hot_swap == request.hot_swap
+      && image.libraries == request.libraries
+      && image.preludes == request.preludes;
+}
+
+/**
+ * Makes relative paths of options absolute against current working directory, so options of the image & of requests,
+ * given relative to working directories of the server & of clients, can be compared. Libraries without a slash
+ * are searched by the dynamic loader & are kept as is
+ */
+static void resolvePaths(Options& options) {
+  auto resolve = [](std::string& path) {
+    if (!path.empty()) {
+      path = std::filesystem::absolute(path).string();
+    }
+  };
+
+  for (auto& prelude : options.preludes) {
+    resolve(prelude);
+  }
+
+  for (auto& library : options.libraries) {
+    if (library.find('/') != std::string::npos) {
+      resolve(library);
+    }
+  }
+
+  resolve(options.remarks_file);
+  resolve(options.profile_generate);
+  resolve(options.profile_use);
+  resolve(options.cache_dir);
+}
+
+Server::Server(Options options) : options(std::move(options)), path(this->options.server) {
+  resolvePaths(this->options);
+}
+
+Server::~Server() {
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(path.c_str());
+  }
+}
+
+std::unique_ptr<Server> Server::create(Options options) {
+  return std::make_unique<Server>(std::move(options));
+}
+
+void Server::run() {
+  sockaddr_un addr {};
+  addr.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error(std::format("Socket path '{}' is too long", path));
+  }
+
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  if (pipe(s_sigchld_pipe) != 0) {
+    throw std::runtime_error(std::format("Can't create pipe: {}", std::strerror(errno)));
+  }
+
+  fcntl(s_sigchld_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(s_sigchld_pipe[1], F_SETFL, O_NONBLOCK);
+
+  struct sigaction action {};
+  action.sa_handler = onSigchld;
+  action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &action, nullptr);
+
+  // Client may disconnect before its exit code is sent
+  signal(SIGPIPE, SIG_IGN);
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  // Stale socket of a previous server
+  unlink(path.c_str());
+
+  if (listen_fd < 0 || bind(listen_fd, (sockaddr *) &addr, sizeof(addr)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+    throw std::runtime_error(std::format("Can't listen on '{}': {}", path, std::strerror(errno)));
+  }
+
+  // Everything, that is the same for all requests, is done before the first fork
+  image = codegen::GlobalContext::create(options);
+  image->getJIT();
+
+  logger.info("Listening on '{}'", path);
+
+  while (true) {
+    pollfd fds[] = {
+      {listen_fd, POLLIN, 0},
+      {s_sigchld_pipe[0], POLLIN, 0},
+    };
+
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::format("poll() failed: {}", std::strerror(errno)));
+    }
+
+    if (fds[1].revents & POLLIN) {
+      char buffer[64];
+      while (read(s_sigchld_pipe[0], buffer, sizeof(buffer)) > 0) {}
+
+      reap();
+    }
+
+    if (!(fds[0].revents & POLLIN)) {
+      continue;
+    }
+
+    int conn = accept(listen_fd, nullptr, nullptr);
+
+    if (conn < 0) {
+      continue;
+    }
+
+    std::fflush(nullptr);
+
+    auto pid = fork();
+
+    if (pid == 0) {
+      close(listen_fd);
+      close(s_sigchld_pipe[0]);
+      close(s_sigchld_pipe[1]);
+      signal(SIGCHLD, SIG_DFL);
+
+      auto code = serve(conn);
+
+      std::cout.flush();
+      std::fflush(nullptr);
+
+      // Server's atexit handlers & static destructors must not run in a child
+      _exit(code);
+    }
+
+    if (pid < 0) {
+      logger.error("fork() failed: {}", std::strerror(errno));
+      int32_t code = 1;
+      writeExact(conn, &code, sizeof(code));
+      close(conn);
+      continue;
+    }
+
+    requests[pid] = conn;
+  }
+}
+
+int Server::serve(int conn) {
+  try {
+    receiveDescriptors(conn);
+
+    uint32_t argc;
+
+    if (!readExact(conn, &argc, sizeof(argc)) || argc > XCC_SERVER_MAX_ARGS) {
+      throw std::runtime_error("Malformed request");
+    }
+
+    std::vector<std::string> args = {"xcc"};
+
+    for (uint32_t i = 0; i < argc; ++i) {
+      args.push_back(readString(conn, XCC_SERVER_MAX_ARG_SIZE));
+    }
+
+    auto cwd = readString(conn, XCC_SERVER_MAX_PATH_SIZE);
+    auto input = readString(conn, XCC_SERVER_MAX_PATH_SIZE);
+    auto source = readString(conn, XCC_SERVER_MAX_SOURCE_SIZE);
+
+    // Request runs as `xcc [OPTIONS] FILE` would in client's working directory
+    if (chdir(cwd.c_str()) != 0) {
+      throw std::runtime_error(std::format("Can't change directory to '{}': {}", cwd, std::strerror(errno)));
+    }
+
+    args.push_back(input);
+
+    std::vector<char *> argv;
+
+    for (auto& arg : args) {
+      argv.push_back(arg.data());
+    }
+
+    auto request = Options::parse((int) argv.size(), argv.data());
+    resolvePaths(request);
+
+    // FILE is passed as an input file, so modes, which take one too, are rejected here
+    if (request.emit != Emit::NONE || request.watch || request.check || request.batch || request.sessions || !request.server.empty()) {
+      throw std::runtime_error("Ahead of time compilation, --watch, --check, --batch, --sessions & --server aren't supported by server requests");
+    }
+
+    std::unique_ptr<codegen::GlobalContext> globalContext;
+
+    if (isCompatible(image->options, request)) {
+      globalContext = std::move(image);
+      globalContext->options = request;
+    } else {
+      globalContext = codegen::GlobalContext::create(request);
+    }
+
+    xcc::run(globalContext, source, false, request.input);
+  } catch (std::exception& e) {
+    logger.fatal("{}", e.what());
+    return 1;
+  }
+
+  return 0;
+}
+
+void Server::reap() {
+  int status;
+  pid_t pid;
+
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    auto it = requests.find(pid);
+
+    if (it == requests.end()) {
+      continue;
+    }
+
+    int32_t code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    if (!writeExact(it->second, &code, sizeof(code))) {
+      logger.warn("Client of request {} disconnected", pid);
+    }
+
+    close(it->second);
+    requests.erase(it);
+  }
+}
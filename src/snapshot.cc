@@ -0,0 +1,280 @@
+#include "xcc/snapshot.h"
+#include "xcc/ast.h"
+#include "xcc/declarations.h"
+#include "xcc/exceptions.h"
+#include "xcc/lexer.h"
+#include "xcc/parser.h"
+#include "xcc/util/log.h"
+#include "xcc/util/serialize.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+using namespace xcc;
+using namespace xcc::codegen;
+
+/* File starts with magic (including terminating zero) & version */
+constexpr char SNAPSHOT_MAGIC[] = "XCCSNAP";
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+static auto logger = xcc::util::log::Logger("SNAPSHOT");
+
+Snapshot Snapshot::capture(GlobalContext& globalContext) {
+  auto& jit = globalContext.getJIT();
+
+  assertThrow(!globalContext.options.tiered, CodegenException("Snapshots aren't supported in tiered mode"));
+  assertThrow(jit.isObjectRecording(), CodegenException("Compiled objects aren't kept, REPL must be started with '--snapshots' to save session"));
+
+  globalContext.commitGlobals();
+
+  Snapshot snapshot;
+  snapshot.triple = jit.getTargetTriple();
+  snapshot.cpu = jit.getTargetCPU();
+
+  std::unordered_set<std::string> declared;
+
+  for (auto& type : globalContext.getTypes()) {
+    declareStruct(snapshot.declarations, type, declared);
+  }
+
+  for (auto& fn : globalContext.getMetaFunctions()) {
+    if (fn->name.starts_with(ANONYMOUS_EXPR_FN_NAME)) {
+      continue;
+    }
+
+    // Only materialized code gets recorded, externs are resolved from host on restore
+    if (!fn->decl || !fn->decl->isExtern) {
+      if (auto symbol = jit.lookup(fn->name); !symbol) {
+        logger.warn("Function '{}' can't be materialized: {}", fn->name, llvm::toString(symbol.takeError()));
+        continue;
+      }
+    }
+
+    declareFunction(snapshot.declarations, *fn);
+    ++snapshot.functions;
+  }
+
+  std::vector<std::string> committed;
+
+  {
+    std::shared_lock lock(globalContext.globals_mutex);
+    committed.assign(globalContext.committed_globals.begin(), globalContext.committed_globals.end());
+  }
+
+  std::sort(committed.begin(), committed.end());
+
+  for (auto& name : committed) {
+    auto symbol = jit.lookup(name);
+
+    if (!symbol) {
+      logger.warn("Global '{}' can't be materialized: {}", name, llvm::toString(symbol.takeError()));
+      continue;
+    }
+
+    Global global {name};
+
+    // Strings are constant, so only variables need their values saved
+    if (globalContext.hasGlobal(name)) {
+      auto type = globalContext.getGlobalType(name);
+
+      size_t size;
+
+      {
+        std::lock_guard lock(globalContext.global_module_mutex);
+        size = jit.getDataLayout().getTypeAllocSize(type->getLLVMType(*globalContext.globalModule));
+      }
+
+      auto address = symbol->getAddress().toPtr<const uint8_t *>();
+
+      global.type = typeName(type);
+      global.value.assign(address, address + size);
+    }
+
+    snapshot.globals.push_back(std::move(global));
+  }
+
+  // Retired bodies of redefined functions are already forgotten by JIT
+  snapshot.stubs = jit.getReplaceableFunctions();
+
+  for (auto& [module, object] : jit.getRecordedObjects()) {
+    // Expression modules are removed from JIT right after the call
+    if (llvm::StringRef(module).starts_with(ANONYMOUS_EXPR_FN_NAME)) {
+      continue;
+    }
+
+    snapshot.objects.push_back({module, object.getBuffer().str()});
+  }
+
+  return snapshot;
+}
+
+Snapshot Snapshot::read(const std::string& path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+
+  if (!buffer) {
+    throw CodegenException(std::format("Can't open '{}': {}", path, buffer.getError().message()));
+  }
+
+  util::BinaryReader reader((*buffer)->getBuffer(), SNAPSHOT_MAGIC);
+
+  assertThrow(reader.getVersion().has_value(), CodegenException(std::format("'{}' is not a snapshot", path)));
+
+  assertThrow(reader.getVersion() == SNAPSHOT_VERSION,
+    CodegenException(std::format("Snapshot '{}' has unsupported version {} (expected {})", path, *reader.getVersion(), SNAPSHOT_VERSION)));
+
+  Snapshot snapshot;
+  snapshot.triple = reader.readString();
+  snapshot.cpu = reader.readString();
+  snapshot.declarations = reader.readString();
+  snapshot.functions = reader.read<uint32_t>();
+
+  auto globals = reader.read<uint32_t>();
+
+  for (uint32_t i = 0; i < globals && reader; ++i) {
+    Global global;
+    global.name = reader.readString();
+    global.type = reader.readString();
+
+    auto value = reader.readString();
+    global.value.assign(value.begin(), value.end());
+
+    snapshot.globals.push_back(std::move(global));
+  }
+
+  auto objects = reader.read<uint32_t>();
+
+  for (uint32_t i = 0; i < objects && reader; ++i) {
+    Object object;
+    object.module = reader.readString();
+    object.data = reader.readString();
+
+    snapshot.objects.push_back(std::move(object));
+  }
+
+  snapshot.stubs = reader.readPairs();
+
+  if (auto err = reader.takeError()) {
+    throw CodegenException(std::format("Malformed snapshot '{}': {}", path, llvm::toString(std::move(err))));
+  }
+
+  return snapshot;
+}
+
+void Snapshot::write(const std::string& path) const {
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::OF_None);
+
+  if (ec) {
+    throw CodegenException(std::format("Can't open '{}': {}", path, ec.message()));
+  }
+
+  util::BinaryWriter writer(out, SNAPSHOT_MAGIC, SNAPSHOT_VERSION);
+
+  writer.writeString(triple);
+  writer.writeString(cpu);
+  writer.writeString(declarations);
+  writer.write<uint32_t>(functions);
+
+  writer.write<uint32_t>(globals.size());
+
+  for (auto& global : globals) {
+    writer.writeString(global.name);
+    writer.writeString(global.type);
+    writer.writeString(llvm::StringRef(reinterpret_cast<const char *>(global.value.data()), global.value.size()));
+  }
+
+  writer.write<uint32_t>(objects.size());
+
+  for (auto& object : objects) {
+    writer.writeString(object.module);
+    writer.writeString(object.data);
+  }
+
+  writer.writePairs(stubs);
+
+  logger.debug("Snapshot of {} functions, {} globals & {} objects written to '{}'", functions, globals.size(), objects.size(), path);
+}
+
+void Snapshot::restore(GlobalContext& globalContext) const {
+  auto& jit = globalContext.getJIT();
+
+  assertThrow(!globalContext.options.tiered, CodegenException("Snapshots aren't supported in tiered mode"));
+  // Only preludes (extern declarations) may be declared before restore
+  assertThrow(std::ranges::all_of(globalContext.getMetaFunctions(), [](auto& fn) { return fn->decl && fn->decl->isExtern; }),
+    CodegenException("Snapshot can only be restored into a fresh session"));
+
+  // Objects contain machine code, compiled for a specific CPU
+  assertThrow(triple == jit.getTargetTriple() && cpu == jit.getTargetCPU(),
+    CodegenException(std::format("Snapshot targets {} ({}), but JIT targets {} ({})", triple, cpu, jit.getTargetTriple(), jit.getTargetCPU())));
+
+  assertThrow(stubs.empty() || globalContext.options.hot_swap,
+    CodegenException("Snapshot was saved in hot swap mode & can only be restored in it"));
+
+  // Declaration phase, same as for source code, but without any bodies to lower
+  auto tree = Parser(Lexer(declarations).tokenize()).parse(false);
+
+  for (auto& node : tree->body) {
+    if (node->is(ast::AST_STRUCT)) {
+      node->generateType(*globalContext.globalModule, {});
+    } else if (node->is(ast::AST_FUNCTION_DECL)) {
+      auto decl = ast::Node::cast<ast::FnDecl>(node);
+      globalContext.addFunction(decl->name->value, decl->generateMetaFunction(*globalContext.globalModule));
+    }
+  }
+
+  for (auto& global : globals) {
+    if (!global.type.empty()) {
+      globalContext.addGlobal(global.name, typeFromName(globalContext, global.type));
+    }
+  }
+
+  for (auto& object : objects) {
+    CodegenException::throwIfError(jit.addObject(object.module, llvm::MemoryBuffer::getMemBufferCopy(object.data, object.module)));
+  }
+
+  for (auto& [name, body] : stubs) {
+    CodegenException::throwIfError(jit.addReplaceableFunction(name, body));
+  }
+
+  // Lookup links objects, that define globals, then saved values overwrite initializers
+  for (auto& global : globals) {
+    if (global.value.empty()) {
+      continue;
+    }
+
+    auto symbol = jit.lookup(global.name);
+
+    if (!symbol) {
+      throw CodegenException(std::format("Can't restore global '{}': {}", global.name, llvm::toString(symbol.takeError())));
+    }
+
+    std::memcpy(symbol->getAddress().toPtr<void *>(), global.value.data(), global.value.size());
+  }
+
+  {
+    std::unique_lock lock(globalContext.globals_mutex);
+
+    for (auto& global : globals) {
+      globalContext.committed_globals.insert(global.name);
+    }
+  }
+
+  logger.debug("Snapshot of {} functions, {} globals & {} objects restored", functions, globals.size(), objects.size());
+}
+
+size_t Snapshot::getFunctionCount() const {
+  return functions;
+}
+
+size_t Snapshot::getGlobalCount() const {
+  return globals.size();
+}
+
+size_t Snapshot::getObjectCount() const {
+  return objects.size();
+}
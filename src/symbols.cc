@@ -0,0 +1,104 @@
+#include "xcc/symbols.h"
+#include "xcc/exceptions.h"
+#include "xcc/util/log.h"
+
+#include <llvm/ExecutionEngine/Orc/AbsoluteSymbols.h>
+#include <llvm/Support/DynamicLibrary.h>
+
+#include <algorithm>
+#include <format>
+#include <mutex>
+
+using namespace xcc::codegen;
+
+static auto logger = xcc::util::log::Logger("SYMBOLS");
+
+SymbolRegistry& SymbolRegistry::instance() {
+  static SymbolRegistry registry;
+  return registry;
+}
+
+void SymbolRegistry::add(const std::string& name, void * address, std::string signature) {
+  std::unique_lock lock(mutex);
+  symbols[name] = {address, std::move(signature), true};
+}
+
+void * SymbolRegistry::resolve(const std::string& name) {
+  {
+    std::shared_lock lock(mutex);
+
+    if (auto it = symbols.find(name); it != symbols.end()) {
+      return it->second.address;
+    }
+  }
+
+  // Misses aren't cached - library providing the symbol may be loaded later
+  auto address = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(name);
+
+  if (address) {
+    std::unique_lock lock(mutex);
+    symbols.try_emplace(name, Symbol{address, "", false});
+  }
+
+  return address;
+}
+
+std::vector<std::pair<std::string, SymbolRegistry::Symbol>> SymbolRegistry::list() {
+  std::vector<std::pair<std::string, Symbol>> result;
+
+  {
+    std::shared_lock lock(mutex);
+    result.assign(symbols.begin(), symbols.end());
+  }
+
+  std::sort(result.begin(), result.end(), [](auto& lhs, auto& rhs) {
+    return lhs.first < rhs.first;
+  });
+
+  return result;
+}
+
+void SymbolRegistry::loadLibrary(const std::string& path) {
+  std::string error;
+
+  if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(path.c_str(), &error)) {
+    throw CodegenException(std::format("Can't load library '{}': {}", path, error));
+  }
+}
+
+SymbolRegistryGenerator::SymbolRegistryGenerator(SymbolRegistry& registry, char global_prefix)
+  : registry(registry), global_prefix(global_prefix) {}
+
+std::unique_ptr<SymbolRegistryGenerator> SymbolRegistryGenerator::create(char global_prefix, SymbolRegistry& registry) {
+  return std::make_unique<SymbolRegistryGenerator>(registry, global_prefix);
+}
+
+llvm::Error SymbolRegistryGenerator::tryToGenerate(llvm::orc::LookupState& state, llvm::orc::LookupKind kind, llvm::orc::JITDylib& jd,
+                                                   llvm::orc::JITDylibLookupFlags flags, const llvm::orc::SymbolLookupSet& set) {
+  llvm::orc::SymbolMap symbols;
+
+  for (auto& [sym_name, sym_flags] : set) {
+    llvm::StringRef name = llvm::orc::SymbolStringPoolEntryUnsafe::from(sym_name).rawPtr()->first();
+
+    if (global_prefix != '\0') {
+      if (name.empty() || name.front() != global_prefix) {
+        continue;
+      }
+      name = name.drop_front();
+    }
+
+    if (auto address = registry.resolve(name.str())) {
+#if USE_REPORT_SYMBOL_RESOLVER_SUCCESS
+      logger.info("Found symbol '{}' at {}", name.str(), address);
+#endif
+      symbols[sym_name] = {llvm::orc::ExecutorAddr::fromPtr(address), llvm::JITSymbolFlags::Exported};
+    }
+  }
+
+  // Unresolved symbols are reported by the session itself
+  if (symbols.empty()) {
+    return llvm::Error::success();
+  }
+
+  return jd.define(llvm::orc::absoluteSymbols(std::move(symbols)));
+}
@@ -1,5 +1,9 @@
 #include "xcc/util/llvm.h"
 
+#include <llvm/Support/TargetSelect.h>
+
+#include <mutex>
+
 using namespace xcc::util;
 using namespace xcc::meta;
 
@@ -36,4 +40,14 @@ GenericValueContainer xcc::util::call(std::shared_ptr<xcc::meta::Type> type, llv
       call<void>(symbol);
       return GenericValueContainer();
   }
-}
\ No newline at end of file
+}
+
+void xcc::util::initNativeTarget() {
+  static std::once_flag initialized;
+
+  std::call_once(initialized, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+  });
+}
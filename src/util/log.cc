@@ -1,6 +1,7 @@
 #include "xcc/util/log.h"
 #include "xcc/exceptions.h"
 #include <fstream>
+#include <mutex>
 
 #define LOG_LEVEL_CASE(__name, __color)           \
   case Level::__name:                             \
@@ -12,6 +13,12 @@ using namespace xcc::util;
 
 static std::unordered_map<std::string, log::Logger*> * loggers = nullptr;
 
+/* Loggers are registered from static initializers, but may be enabled/disabled from any thread (sessions) */
+static std::mutex loggers_mutex;
+
+/* Guards OutputFile instance pool */
+static std::mutex output_files_mutex;
+
 std::shared_ptr<log::outputs::OutputStdout> log::outputs::OutputStdout::instance;
 
 log::outputs::OutputStdout::OutputStdout()
@@ -22,9 +29,11 @@ void log::outputs::OutputStdout::output(const std::string& message) {
 }
 
 std::shared_ptr<log::outputs::OutputStdout> log::outputs::OutputStdout::get() {
-  if (!instance) {
+  static std::once_flag once;
+
+  std::call_once(once, [] {
     instance = std::make_shared<OutputStdout>();
-  }
+  });
 
   return instance;
 }
@@ -44,6 +53,8 @@ void log::outputs::OutputFile::output(const std::string& message) {
 }
 
 std::shared_ptr<log::outputs::OutputFile> log::outputs::OutputFile::get(std::string filename) {
+  std::lock_guard lock(output_files_mutex);
+
   if (instances.find(filename) == instances.end()) {
     instances[filename] = std::make_unique<OutputFile>(filename);
   }
@@ -134,6 +145,8 @@ void log::registerModule(Logger * logger) {
       std::runtime_error("registerModule got NULL pointer as logger")
   );
 
+  std::lock_guard lock(loggers_mutex);
+
   if (!loggers) {
     loggers = new std::unordered_map<std::string, log::Logger*>();
   }
@@ -147,6 +160,8 @@ void log::enableModule(const std::string& name, bool enable) {
       std::runtime_error("enableModule is called before global logger init")
   );
 
+  std::lock_guard lock(loggers_mutex);
+
   if (loggers->find(name) == loggers->end()) {
     throw std::runtime_error(name + " - logger not found");
   }
@@ -155,5 +170,7 @@ void log::enableModule(const std::string& name, bool enable) {
 }
 
 void log::cleanup() {
+  std::lock_guard lock(loggers_mutex);
   delete loggers;
+  loggers = nullptr;
 }
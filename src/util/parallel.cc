@@ -0,0 +1,39 @@
+#include "xcc/util/parallel.h"
+
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+
+#include <exception>
+#include <vector>
+
+void xcc::util::parallelFor(size_t count, size_t jobs, const std::function<void(size_t)>& fn) {
+  std::vector<std::exception_ptr> errors(count);
+
+  auto run = [&](size_t idx) {
+    try {
+      fn(idx);
+    } catch (...) {
+      errors[idx] = std::current_exception();
+    }
+  };
+
+  if (jobs != 1 && count > 1) {
+    llvm::DefaultThreadPool pool(llvm::hardware_concurrency(jobs));
+
+    for (size_t i = 0; i < count; ++i) {
+      pool.async(run, i);
+    }
+
+    pool.wait();
+  } else {
+    for (size_t i = 0; i < count; ++i) {
+      run(i);
+    }
+  }
+
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
@@ -0,0 +1,55 @@
+#include "xcc/util/serialize.h"
+
+#include <cstring>
+
+using namespace xcc::util;
+
+BinaryWriter::BinaryWriter(llvm::raw_ostream& out, const char * magic, uint32_t version) : out(out), writer(out, llvm::endianness::little) {
+  out.write(magic, std::strlen(magic) + 1);
+  writer.write<uint32_t>(version);
+}
+
+void BinaryWriter::writeString(llvm::StringRef str) {
+  writer.write<uint64_t>(str.size());
+  out << str;
+}
+
+void BinaryWriter::writePairs(const StringPairs& pairs) {
+  writer.write<uint32_t>(pairs.size());
+
+  for (auto& [first, second] : pairs) {
+    writeString(first);
+    writeString(second);
+  }
+}
+
+BinaryReader::BinaryReader(llvm::StringRef data, const char * magic)
+  : extractor(data, true, sizeof(void *)), cursor(std::strlen(magic) + 1 + sizeof(uint32_t)) {
+  auto magic_size = std::strlen(magic) + 1;
+
+  if (data.size() >= magic_size + sizeof(uint32_t) && data.starts_with(llvm::StringRef(magic, magic_size))) {
+    version = llvm::support::endian::read32le(data.data() + magic_size);
+  }
+}
+
+BinaryReader::~BinaryReader() {
+  // Error of a reader, which wasn't checked (e.g. file had unsupported version), is dropped
+  llvm::consumeError(cursor.takeError());
+}
+
+std::string BinaryReader::readString() {
+  auto size = extractor.getU64(cursor);
+  return extractor.getBytes(cursor, size).str();
+}
+
+StringPairs BinaryReader::readPairs() {
+  StringPairs pairs;
+  auto count = extractor.getU32(cursor);
+
+  for (uint32_t i = 0; i < count && cursor; ++i) {
+    auto first = readString();
+    pairs.emplace_back(std::move(first), readString());
+  }
+
+  return pairs;
+}
@@ -0,0 +1,283 @@
+#include "xcc/watch.h"
+#include "xcc/xcc.h"
+#include "xcc/ast.h"
+#include "xcc/util/timer.h"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/xxhash.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+using namespace xcc;
+
+static auto logger = xcc::util::log::Logger("WATCH");
+
+/**
+ * Top-level definition of the current source
+ */
+struct Definition {
+  std::shared_ptr<ast::Node> node;
+  std::string name;
+
+  /* Hash of definition's own tokens */
+  uint64_t own;
+
+  /* Hash of interface tokens (function signature, whole struct/global) */
+  uint64_t interface;
+
+  /* Identifiers, referenced by the whole definition & by its interface only */
+  std::set<std::string> refs;
+  std::set<std::string> interface_refs;
+};
+
+static uint64_t hashString(const std::string& str) {
+  return llvm::xxh3_64bits(llvm::arrayRefFromStringRef(str));
+}
+
+/**
+ * Hashes token types & values, so edits of whitespace, comments & line numbers don't count as changes
+ */
+static uint64_t hashTokens(const std::vector<Token>& tokens, size_t begin, size_t end) {
+  std::string buffer;
+
+  for (size_t i = begin; i < end; ++i) {
+    buffer += std::to_string(tokens[i].type);
+    buffer += ':';
+    buffer += tokens[i].value;
+    buffer += '\0';
+  }
+
+  return hashString(buffer);
+}
+
+static std::set<std::string> collectIdentifiers(const std::vector<Token>& tokens, size_t begin, size_t end) {
+  std::set<std::string> result;
+
+  for (size_t i = begin; i < end; ++i) {
+    if (tokens[i].is(TOKEN_IDENTIFIER)) {
+      result.insert(tokens[i].value);
+    }
+  }
+
+  return result;
+}
+
+static std::string getDefinitionName(const std::shared_ptr<ast::Node>& node) {
+  switch (node->type) {
+    case ast::AST_FUNCTION_DEF:  return node->as<ast::FnDef>()->decl->name->value;
+    case ast::AST_FUNCTION_DECL: return node->as<ast::FnDecl>()->name->value;
+    case ast::AST_STRUCT:        return node->as<ast::Struct>()->name->value;
+    case ast::AST_VAR_DECL:      return node->as<ast::VarDecl>()->name->value;
+    default:                     return "";
+  }
+}
+
+/**
+ * Returns interface hash of a definition, combined with interfaces of definitions it references (transitively)
+ */
+static uint64_t getInterfaceHash(
+  const std::string& name,
+  const std::unordered_map<std::string, Definition>& definitions,
+  std::unordered_map<std::string, uint64_t>& memo,
+  std::unordered_set<std::string>& visiting
+) {
+  if (auto it = memo.find(name); it != memo.end()) {
+    return it->second;
+  }
+
+  auto it = definitions.find(name);
+
+  if (it == definitions.end()) {
+    return 0;
+  }
+
+  auto& definition = it->second;
+
+  // Recursive references (e.g. mutually recursive structs through pointers) stop here
+  if (!visiting.insert(name).second) {
+    return definition.interface;
+  }
+
+  auto buffer = std::to_string(definition.interface);
+
+  for (auto& ref : definition.interface_refs) {
+    if (ref != name && definitions.contains(ref)) {
+      buffer += std::format(";{}:{}", ref, getInterfaceHash(ref, definitions, memo, visiting));
+    }
+  }
+
+  visiting.erase(name);
+
+  return memo[name] = hashString(buffer);
+}
+
+Watcher::Watcher(std::unique_ptr<codegen::GlobalContext>& globalContext, std::string path, std::chrono::milliseconds poll_interval)
+  : globalContext(globalContext), path(std::move(path)), poll_interval(poll_interval) {}
+
+std::unique_ptr<Watcher> Watcher::create(std::unique_ptr<codegen::GlobalContext>& globalContext, std::string path, std::chrono::milliseconds poll_interval) {
+  return std::make_unique<Watcher>(globalContext, std::move(path), poll_interval);
+}
+
+void Watcher::run() {
+  std::optional<std::filesystem::file_time_type> last_write;
+
+  while (true) {
+    std::error_code ec;
+    auto write_time = std::filesystem::last_write_time(path, ec);
+
+    if (ec || write_time == last_write) {
+      std::this_thread::sleep_for(poll_interval);
+      continue;
+    }
+
+    last_write = write_time;
+
+    std::ifstream fs(path);
+
+    if (!fs.is_open()) {
+      logger.error("Failed to open file '{}'", path);
+      continue;
+    }
+
+    std::stringstream ss;
+    ss << fs.rdbuf();
+
+    // Errors are reported & watching goes on, previous code stays in JIT
+    try {
+      update(ss.str());
+    } catch (std::exception& e) {
+      logger.error("{}", e.what());
+    }
+
+    logger.info("Watching '{}' for changes", path);
+  }
+}
+
+size_t Watcher::update(const std::string& src) {
+  util::Timer timer;
+
+  auto tokens = Lexer(src).tokenize();
+
+  Parser parser(tokens);
+  auto tree = parser.parse(false);
+  auto& ranges = parser.getTopLevelRanges();
+
+  std::vector<std::string> order;
+  std::unordered_map<std::string, Definition> definitions;
+
+  for (size_t i = 0; i < tree->body.size(); ++i) {
+    auto& node = tree->body[i];
+    auto [begin, end] = ranges[i];
+
+    // Imported units would need their own change tracking
+    if (node->is(ast::AST_IMPORT)) {
+      throw CodegenException("'import' isn't supported in watch mode");
+    }
+
+    Definition definition {node, getDefinitionName(node)};
+
+    // Function interface is its signature (up to body), anything else is an interface as a whole
+    size_t interface_end = end;
+
+    if (node->is(ast::AST_FUNCTION_DEF)) {
+      interface_end = begin;
+      while (interface_end < end && !tokens[interface_end].is(TOKEN_LEFT_BRACE)) {
+        ++interface_end;
+      }
+    }
+
+    definition.own = hashTokens(tokens, begin, end);
+    definition.interface = hashTokens(tokens, begin, interface_end);
+    definition.refs = collectIdentifiers(tokens, begin, end);
+    definition.interface_refs = collectIdentifiers(tokens, begin, interface_end);
+
+    // Later definition (e.g. body after `extern fn` declaration) takes the place of an earlier one
+    if (!definitions.contains(definition.name)) {
+      order.push_back(definition.name);
+    }
+
+    definitions[definition.name] = std::move(definition);
+  }
+
+  std::unordered_map<std::string, uint64_t> memo;
+  std::unordered_set<std::string> visiting;
+
+  std::vector<std::shared_ptr<ast::Node>> fn_nodes;
+  std::unordered_map<std::string, uint64_t> updated;
+  size_t recompiled = 0;
+
+  for (auto& name : order) {
+    auto& definition = definitions[name];
+
+    // Definition has to be recompiled, if its tokens or interface of anything it references changed
+    auto buffer = std::to_string(definition.own);
+
+    for (auto& ref : definition.refs) {
+      if (ref != name && definitions.contains(ref)) {
+        buffer += std::format(";{}:{}", ref, getInterfaceHash(ref, definitions, memo, visiting));
+      }
+    }
+
+    auto hash = hashString(buffer);
+    updated[name] = hash;
+
+    auto previous = hashes.find(name);
+
+    if (previous != hashes.end() && previous->second == hash) {
+      continue;
+    }
+
+    ++recompiled;
+
+    auto& node = definition.node;
+
+    if (node->is(ast::AST_VAR_DECL)) {
+      // Global is already in JIT (and may hold state), so it can't be redefined
+      if (previous != hashes.end()) {
+        logger.warn("Global '{}' changed, new definition takes effect after restart", name);
+      } else {
+        node->generateValue(*globalContext->globalModule, {});
+      }
+    } else if (node->is(ast::AST_STRUCT)) {
+      node->generateType(*globalContext->globalModule, {});
+      for (auto& method : node->as<ast::Struct>()->methods) {
+        fn_nodes.push_back(method);
+      }
+    } else {
+      fn_nodes.push_back(node);
+    }
+  }
+
+  // Declaration phase - signatures of unchanged functions are still registered from previous runs
+  for (auto& node : fn_nodes) {
+    auto decl = node->is(ast::AST_FUNCTION_DEF)
+        ? node->as<ast::FnDef>()->decl
+        : ast::Node::cast<ast::FnDecl>(node);
+
+    globalContext->addFunction(decl->name->value, decl->generateMetaFunction(*globalContext->globalModule));
+  }
+
+  auto modules = lowerFunctions(globalContext, fn_nodes);
+
+  for (auto& ctx : modules) {
+    globalContext->addModule(ctx);
+  }
+
+  // Hashes are only updated once everything is added, so failed definitions are retried on next change
+  for (auto& [name, hash] : updated) {
+    hashes[name] = hash;
+  }
+
+  logger.info("Recompiled {} of {} definitions in {:.3f}ms", recompiled, order.size(), timer.elapsedMs());
+
+  globalContext->runFunction("main");
+
+  return recompiled;
+}
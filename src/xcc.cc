@@ -1,12 +1,28 @@
 #include "xcc/xcc.h"
+#include "xcc/aot.h"
+#include "xcc/importer.h"
+#include "xcc/pipeline.h"
+#include "xcc/symbols.h"
+#include "xcc/util/parallel.h"
 #include "xcc/util/string.h"
+#include "xcc/util/timer.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <atomic>
+#include <thread>
 
 static auto logger = xcc::util::log::Logger("XCC");
 
+/* runtime/xcc_cpu.c */
+extern "C" int32_t xcc_cpu_supports(int8_t * feature);
+
 void xcc::init(bool autoCleanup) {
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmPrinter();
-  llvm::InitializeNativeTargetAsmParser();
+  // Native target is initialized lazily (util::initNativeTarget), by the first JIT or AOT compiler
+
+  // Host functions, JIT'd code depends on, are registered explicitly (doesn't rely on -rdynamic)
+  codegen::SymbolRegistry::instance().add("xcc_cpu_supports", (void *) &xcc_cpu_supports, "fn xcc_cpu_supports(feature: i8*): i32");
 
   if (autoCleanup) {
     std::atexit(xcc::cleanup);
@@ -20,9 +36,106 @@ void xcc::cleanup() {
   util::log::cleanup();
 }
 
-void xcc::run(std::unique_ptr<codegen::GlobalContext>& globalContext, const std::string& src, bool isRepl) {
+/**
+ * Reports phase time, if enabled by options
+ */
+static void reportPhase(std::unique_ptr<xcc::codegen::GlobalContext>& globalContext, const char * phase, const xcc::util::Timer& timer) {
+  if (globalContext->options.timings) {
+    logger.info("Phase '{}' took {:.3f}ms", phase, timer.elapsedMs());
+  }
+}
+
+std::vector<std::unique_ptr<xcc::codegen::ModuleContext>> xcc::lowerFunctions(
+  std::unique_ptr<xcc::codegen::GlobalContext>& globalContext,
+  const std::vector<std::shared_ptr<xcc::ast::Node>>& fn_nodes,
+  const std::vector<xcc::codegen::ModuleContext *>& data_modules
+) {
+  std::vector<std::unique_ptr<xcc::codegen::ModuleContext>> modules(fn_nodes.size());
+
+  util::parallelFor(fn_nodes.size(), globalContext->options.jobs, [&](size_t idx) {
+    auto ctx = globalContext->createModule();
+    if (!data_modules.empty()) {
+      ctx->data_module = data_modules[idx];
+    }
+    fn_nodes[idx]->generateFunction(*ctx, {});
+    modules[idx] = std::move(ctx);
+  });
+
+  return modules;
+}
+
+size_t xcc::runSessions(const Options& options, const std::string& src, size_t sessions) {
+  util::Timer timer;
+
+  // Out of process, every session gets its own engine & executor, as executor runs code of a single session
+  auto engine = options.out_of_process ? nullptr : codegen::JITEngine::create(options);
+
+  if (options.timings) {
+    logger.info("Phase '{}' took {:.3f}ms", "engine", timer.elapsedMs());
+  }
+
+  std::atomic<size_t> failed = 0;
+  std::vector<std::thread> threads;
+
+  timer.reset();
+
+  for (size_t i = 0; i < sessions; ++i) {
+    threads.emplace_back([&]() {
+      try {
+        auto globalContext = codegen::GlobalContext::create(options, engine);
+        run(globalContext, src, false, options.input);
+      } catch (std::exception& e) {
+        logger.error("{}", e.what());
+        ++failed;
+      }
+    });
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto ms = timer.elapsedMs();
+
+  logger.info("Sessions: {} concurrent, {} failed, wall {:.3f}ms, {:.1f} runs/s", sessions, failed.load(), ms, ms > 0 ? 1000 * sessions / ms : 0);
+
+  return failed;
+}
+
+void xcc::emit(std::unique_ptr<codegen::GlobalContext>& globalContext, const std::vector<const llvm::Module *>& modules) {
+  auto& options = globalContext->options;
+
+  // Everything compiles, if lowering didn't throw
+  if (options.check) {
+    logger.debug("'{}' checked ({} modules)", options.input, modules.size());
+    return;
+  }
+
+  if (options.emit == Emit::IR_ONLY) {
+    std::error_code ec;
+    llvm::raw_fd_ostream out(options.output, ec, llvm::sys::fs::OF_Text);
+
+    if (ec) {
+      throw CodegenException(std::format("Can't open '{}': {}", options.output, ec.message()));
+    }
+
+    for (auto module : modules) {
+      module->print(out, nullptr);
+    }
+
+    return;
+  }
+
+  codegen::AOT::create(options)->compile(modules, globalContext->getRemarks());
+}
+
+void xcc::run(std::unique_ptr<codegen::GlobalContext>& globalContext, const std::string& src, bool isRepl, const std::string& path) {
+  util::Timer timer;
+
   auto tokens = Lexer(src).tokenize();
 
+  reportPhase(globalContext, "lex", timer);
+
 #if USE_PRINT_TOKENS
   logger.info("TOKENS:");
   for (auto& token : tokens) {
@@ -34,18 +147,52 @@ void xcc::run(std::unique_ptr<codegen::GlobalContext>& globalContext, const std:
   }
 #endif
 
+  timer.reset();
+
+  // REPL lines are too short to be worth pipelining
+  if (globalContext->options.pipeline && !isRepl) {
+    Pipeline::create(globalContext)->run(tokens, path);
+    return;
+  }
+
   auto ast = Parser(tokens).parse(isRepl);
 
+  reportPhase(globalContext, "parse", timer);
+
 #if USE_PRINT_AST
   logger.info("AST:");
   ast::printAst(ast);
 #endif
 
+  timer.reset();
+
+  std::vector<std::string> imports;
+
+  for (auto& node : ast->body) {
+    if (node->is(ast::AST_IMPORT)) {
+      imports.push_back(node->as<ast::Import>()->path);
+    }
+  }
+
+  // Imported units are compiled (or loaded from cache) first, so their declarations are visible here
+  std::unique_ptr<Importer> importer;
+
+  if (!imports.empty()) {
+    importer = Importer::create(globalContext);
+    importer->import(path, imports);
+
+    reportPhase(globalContext, "import", timer);
+
+    timer.reset();
+  }
+
   std::vector<std::shared_ptr<ast::Node>> fn_nodes;
   std::vector<std::shared_ptr<ast::Node>> expr_nodes;
 
   for (auto& node : ast->body) {
-    if (node->isAnyOf(ast::AST_FUNCTION_DEF, ast::AST_FUNCTION_DECL)) {
+    if (node->is(ast::AST_IMPORT)) {
+      continue;
+    } else if (node->isAnyOf(ast::AST_FUNCTION_DEF, ast::AST_FUNCTION_DECL)) {
       fn_nodes.push_back(node);
     } else if (node->is(ast::AST_VAR_DECL)) {
       node->generateValue(*globalContext->globalModule, {});
@@ -63,23 +210,65 @@ void xcc::run(std::unique_ptr<codegen::GlobalContext>& globalContext, const std:
     }
   }
 
+  // Declaration phase - register all signatures before any body is lowered
   for (auto& node : fn_nodes) {
-    auto ctx = globalContext->createModule();
+    auto decl = node->is(ast::AST_FUNCTION_DEF)
+        ? node->as<ast::FnDef>()->decl
+        : ast::Node::cast<ast::FnDecl>(node);
+
+    auto fn = decl->generateMetaFunction(*globalContext->globalModule);
+
+    // Code, compiled against old signature, keeps calling (hot swapped) function through its stub
+    if (globalContext->options.hot_swap) {
+      if (auto existing = globalContext->getMetaFunction(fn->name); existing && existing->toString() != fn->toString()) {
+        throw CodegenException(std::format("Redefinition of '{}' changes its signature ('{}' -> '{}')", fn->name, existing->toString(), fn->toString()));
+      }
+    }
 
-    if (node->isAnyOf(ast::AST_FUNCTION_DEF, ast::AST_FUNCTION_DECL)) {
-      auto fn = node->generateFunction(*ctx, {});
+    globalContext->addFunction(decl->name->value, fn);
+  }
+
+  reportPhase(globalContext, "declare", timer);
+
+  timer.reset();
+
+  auto modules = lowerFunctions(globalContext, fn_nodes);
+
+  reportPhase(globalContext, "lower", timer);
+
+  if (!globalContext->options.isExecuting()) {
+    std::vector<const llvm::Module *> aot_modules = {globalContext->globalModule->llvm.module.get()};
+
+    if (importer) {
+      for (auto module : importer->getModules()) {
+        aot_modules.push_back(module);
+      }
+    }
+
+    for (auto& ctx : modules) {
+      aot_modules.push_back(ctx->llvm.module.get());
+    }
+
+    emit(globalContext, aot_modules);
+    return;
+  }
+
+  timer.reset();
+
+  for (auto& ctx : modules) {
 #if USE_PRINT_LLVM_IR
-      logger.info("LLVM IR for function {}:", fn->getName().str());
-      util::RawStreamCollector collector;
-      fn->print(*collector.stream());
-      logger.print("{}", collector.string());
+    util::RawStreamCollector collector;
+    ctx->llvm.module->print(*collector.stream(), nullptr);
+    logger.info("LLVM IR for module:");
+    logger.print("{}", collector.string());
 #endif
-      globalContext->addModule(ctx);
-    } else {
-      throw std::runtime_error("Unexpected node at top-level scope: " + ast::Node::typeToString(node->type));
-    }
+    globalContext->addModule(ctx);
   }
 
+  reportPhase(globalContext, "jit-add", timer);
+
+  timer.reset();
+
   if (isRepl) {
     if (!expr_nodes.empty()) {
       globalContext->runExpr(ast::Block::create(expr_nodes));
@@ -87,4 +276,6 @@ void xcc::run(std::unique_ptr<codegen::GlobalContext>& globalContext, const std:
   } else {
     globalContext->runFunction("main");
   }
+
+  reportPhase(globalContext, isRepl ? "run-expr" : "run", timer);
 }
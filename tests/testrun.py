@@ -2,6 +2,7 @@ from dataclasses import dataclass
 import subprocess
 import argparse
 import json
+import tempfile
 import re
 import os
 
@@ -31,6 +32,9 @@ class Test:
     name: str
     file: str
     expect: Expected
+    options: list[str]
+    repl: bool
+    jit: bool
 
     @classmethod
     def from_json(cls, config):
@@ -38,7 +42,10 @@ class Test:
             config['id'],
             config['name'],
             config['file'],
-            cls.Expected.from_json(config['expect'])
+            cls.Expected.from_json(config['expect']),
+            config.get('options', []),
+            config.get('repl', False),
+            config.get('jit', False)
         )
 
 @dataclass
@@ -52,9 +59,12 @@ class TestRun:
 
 class Runner:
     RESULT_REGEX = re.compile(r'Result: (\d+)', re.MULTILINE)
+    BATCH_HEADER_REGEX = re.compile(r'^==> (.+) <== exit (\d+) [\d.]+ms$', re.MULTILINE)
 
-    def __init__(self, config: str, executable: str, test_dir: str | None, verbose: bool, print_output: bool):
+    def __init__(self, config: str, executable: str, test_dir: str | None, verbose: bool, print_output: bool, aot: bool, batch: bool):
         self.tests = Runner.__parse(config)
+        self.aot = aot
+        self.batch = batch
         self.test_dir = test_dir if test_dir else os.path.dirname(config)
         self.executable = executable
         self.verbose = verbose
@@ -98,6 +108,14 @@ class Runner:
         self.runs[id] = self.__run(self.tests[id])
 
     def run_range(self, ids: list[int]):
+        if self.batch and not self.aot:
+            # Tests with own options or REPL input need own process
+            single = [id for id in ids if id in self.tests and (self.tests[id].options or self.tests[id].repl)]
+            self.__run_batch([id for id in ids if id not in single])
+            for id in single:
+                self.run(id)
+            return
+
         for id in ids:
             self.run(id)
 
@@ -105,12 +123,88 @@ class Runner:
         self.run_range(list(self.tests.keys()))
 
     def __run(self, test: Test) -> TestRun:
-        result = subprocess.run([self.executable, os.path.join(self.test_dir, test.file)], capture_output=True, text=True)
+        if test.repl:
+            return self.__run_repl(test)
+
+        # JIT only tests run in JIT even with --aot
+        if self.aot and not test.jit:
+            return self.__run_aot(test)
+
+        result = subprocess.run([self.executable, *test.options, os.path.join(self.test_dir, test.file)], capture_output=True, text=True)
         run = TestRun(True, result.returncode, 0, result.stdout, result.stderr, [])
 
         if match := self.RESULT_REGEX.search(run.stdout):
             run.result = int(match.group(1))
 
+        return self.__check(test, run, test.expect.retcode)
+
+    def __run_repl(self, test: Test) -> TestRun:
+        # Lines of file are typed into REPL (always JIT), so every line is its own top-level call
+        with open(os.path.join(self.test_dir, test.file)) as f:
+            lines = f.read()
+
+        executable = os.path.abspath(self.executable) if os.path.exists(self.executable) else self.executable
+
+        # Files, written by REPL commands (e.g. /save), go into a temporary working directory
+        with tempfile.TemporaryDirectory() as tmp:
+            result = subprocess.run([executable, *test.options], input=lines, capture_output=True, text=True, cwd=tmp)
+
+        run = TestRun(True, result.returncode, 0, result.stdout, result.stderr, [])
+
+        if match := self.RESULT_REGEX.search(run.stdout):
+            run.result = int(match.group(1))
+
+        return self.__check(test, run, test.expect.retcode)
+
+    def __run_batch(self, ids: list[int]):
+        if not ids:
+            return
+
+        for id in ids:
+            if id not in self.tests:
+                raise ValueError(f'Invalid test ID: {id}')
+
+        paths = [os.path.join(self.test_dir, self.tests[id].file) for id in ids]
+        result = subprocess.run([self.executable, '--batch', *paths], capture_output=True, text=True)
+
+        # Output of every program follows its header, in input order
+        headers = list(self.BATCH_HEADER_REGEX.finditer(result.stdout))
+        sections = dict()
+
+        for idx, header in enumerate(headers):
+            end = headers[idx + 1].start() if idx + 1 < len(headers) else len(result.stdout)
+            sections[header.group(1)] = (int(header.group(2)), result.stdout[header.end():end])
+
+        for id, path in zip(ids, paths):
+            if path not in sections:
+                self.runs[id] = TestRun(False, result.returncode, 0, result.stdout, result.stderr, ['Missing from batch output'])
+                continue
+
+            retcode, stdout = sections[path]
+            run = TestRun(True, retcode, 0, stdout, '', [])
+
+            if match := self.RESULT_REGEX.search(run.stdout):
+                run.result = int(match.group(1))
+
+            self.runs[id] = self.__check(self.tests[id], run, self.tests[id].expect.retcode)
+
+    def __run_aot(self, test: Test) -> TestRun:
+        with tempfile.TemporaryDirectory() as tmp:
+            binary = os.path.join(tmp, 'test')
+            result = subprocess.run([self.executable, *test.options, os.path.join(self.test_dir, test.file), '-o', binary], capture_output=True, text=True)
+
+            if result.returncode != 0:
+                return TestRun(False, result.returncode, 0, result.stdout, result.stderr, ['Compilation failed'])
+
+            result = subprocess.run([binary], capture_output=True, text=True)
+
+        # Result of main is the exit status of compiled executable, which is truncated to 8 bits
+        retcode = test.expect.retcode if test.expect.retcode == '*' else test.expect.retcode & 0xFF
+        run = TestRun(True, result.returncode, result.returncode, result.stdout, result.stderr, [])
+
+        return self.__check(test, run, retcode)
+
+    def __check(self, test: Test, run: TestRun, retcode: int | str) -> TestRun:
         for out in ['stdout', 'stderr']:
             for expect in getattr(test.expect, out):
                 if expect.search(run.stdout):
@@ -119,8 +213,8 @@ class Runner:
                 run.passed = False
 
         # FIXME: For now, return code isn't returned from xcc process
-        if test.expect.retcode != '*' and test.expect.retcode != run.result:
-            run.fail_reasons.append(f'Result values mismatch: expected={COLOR_GREEN}{test.expect.retcode}{COLOR_RESET} actual={COLOR_RED}{run.result}{COLOR_RESET}')
+        if retcode != '*' and retcode != run.result:
+            run.fail_reasons.append(f'Result values mismatch: expected={COLOR_GREEN}{retcode}{COLOR_RESET} actual={COLOR_RED}{run.result}{COLOR_RESET}')
             run.passed = False
 
         return run
@@ -164,9 +258,15 @@ def main():
     parser.add_argument('-p', '--print-output', action='store_true', dest='print_output', default=False,
                         help='Print stdout/stderr output')
 
+    parser.add_argument('-a', '--aot', action='store_true', dest='aot', default=False,
+                        help='Compile tests ahead of time into executables & run them')
+
+    parser.add_argument('-b', '--batch', action='store_true', dest='batch', default=False,
+                        help='Run all tests in one xcc --batch invocation (JIT only)')
+
     args = parser.parse_args()
 
-    runner = Runner(args.config, args.executable, args.testdir, args.verbose, args.print_output)
+    runner = Runner(args.config, args.executable, args.testdir, args.verbose, args.print_output, args.aot, args.batch)
 
     if args.tests:
         runner.run_range([int(id) for id in args.tests.split(',')])